@@ -44,6 +44,12 @@
 
 #define DLDI_CTRL (*(vu32*) 0x4fff444)
 #define DLDI_DATA (*(vu32*) 0x4fff448)
+#define DLDI_BUF (*(vu32*) 0x4fff44c)
+#define DLDI_COUNT (*(vu32*) 0x4fff450)
+#define DLDI_CMD (*(vu32*) 0x4fff454)
+
+#define CMD_READ 1
+#define CMD_WRITE 2
 
 /*-----------------------------------------------------------------
 startUp
@@ -80,15 +86,11 @@ The buffer may be unaligned, and the driver must deal with this correctly.
 return true if it was successful, false if it failed for any reason
 -----------------------------------------------------------------*/
 bool readSectors(u32 sector, u32 numSectors, void* buffer) {
-    u32* p = buffer;
-    for (int i = 0; i < numSectors; i++) {
-        DLDI_CTRL = sector + i;
-        if (!DLDI_CTRL) return false;
-        for (int j = 0; j < BYTES_PER_READ / 4; j++) {
-            *p++ = DLDI_DATA;
-        }
-    }
-    return true;
+    DLDI_CTRL = sector;
+    DLDI_BUF = (u32) buffer;
+    DLDI_COUNT = numSectors;
+    DLDI_CMD = CMD_READ;
+    return DLDI_CMD;
 }
 
 /*-----------------------------------------------------------------
@@ -99,15 +101,11 @@ The buffer may be unaligned, and the driver must deal with this correctly.
 return true if it was successful, false if it failed for any reason
 -----------------------------------------------------------------*/
 bool writeSectors(u32 sector, u32 numSectors, void* buffer) {
-    u32* p = buffer;
-    for (int i = 0; i < numSectors; i++) {
-        DLDI_CTRL = sector + i;
-        if (!DLDI_CTRL) return false;
-        for (int j = 0; j < BYTES_PER_READ / 4; j++) {
-            DLDI_DATA = *p++;
-        }
-    }
-    return true;
+    DLDI_CTRL = sector;
+    DLDI_BUF = (u32) buffer;
+    DLDI_COUNT = numSectors;
+    DLDI_CMD = CMD_WRITE;
+    return DLDI_CMD;
 }
 
 /*-----------------------------------------------------------------
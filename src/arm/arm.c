@@ -125,6 +125,8 @@ static inline bool eval_cond(ArmCore* cpu, ArmInstr instr) {
 void arm_exec_instr(ArmCore* cpu) {
     ArmInstr instr = cpu->cur_instr;
 
+    if (cpu->exec_hook) cpu->exec_hook(cpu);
+
 #ifdef CPULOG
     cpu->log[cpu->log_idx].addr = cpu->cur_instr_addr;
     cpu->log[cpu->log_idx].instr = instr;
@@ -570,6 +572,7 @@ void exec_arm_branch_ex(ArmCore* cpu, ArmInstr instr) {
         } else {
             cpu->lr = cpu->pc - 4;
         }
+        if (cpu->call_hook) cpu->call_hook(cpu, dest & ~1);
     }
     cpu_fetch_instr(cpu);
     cpu->pc = dest;
@@ -894,6 +897,7 @@ void exec_arm_branch(ArmCore* cpu, ArmInstr instr) {
                 cpu->cpsr.t = 1;
             }
         }
+        if (cpu->call_hook) cpu->call_hook(cpu, dest & ~1);
     }
     cpu->pc = dest;
     cpu_flush(cpu);
@@ -921,6 +925,11 @@ void exec_arm_cp_reg_trans(ArmCore* cpu, ArmInstr instr) {
 }
 
 void exec_arm_sw_intr(ArmCore* cpu, ArmInstr instr) {
+    if (cpu->swi_hle) {
+        u32 num = cpu->cpsr.t ? instr.sw_intr.arg & 0xff
+                              : (instr.sw_intr.arg >> 16) & 0xff;
+        if (cpu->swi_hle(cpu, num)) return;
+    }
     cpu_handle_interrupt(cpu, I_SWI);
 }
 
@@ -82,6 +82,15 @@ typedef struct _ArmCore {
     u32 (*cp15_read)(ArmCore* cpu, u32 cn, u32 cm, u32 cp);
     void (*cp15_write)(ArmCore* cpu, u32 cn, u32 cm, u32 cp, u32 data);
 
+    // returns true if the swi was handled, the handler advances the pipeline
+    bool (*swi_hle)(ArmCore* cpu, u32 num);
+
+    // called with the destination of every bl/blx when set
+    void (*call_hook)(ArmCore* cpu, u32 dest);
+
+    // called before every instruction is executed when set
+    void (*exec_hook)(ArmCore* cpu);
+
     bool v5;
     u32 vector_base;
 
@@ -4,6 +4,7 @@
 
 #include "arm/arm.h"
 #include "arm/arm_core.h"
+#include "bios.h"
 #include "bus7.h"
 #include "nds.h"
 #include "arm/thumb.h"
@@ -21,10 +22,12 @@ void arm7_init(Arm7TDMI* cpu) {
     cpu->c.fetch32 = (void*) arm7_fetch32;
     cpu->c.cp15_read = NULL;
     cpu->c.cp15_write = NULL;
+    cpu->c.swi_hle = NULL;
 }
 
 void arm7_step(Arm7TDMI* cpu) {
     cpu->c.cycles = 0;
+    if (cpu->master->hle7.check) bios_check_result(&cpu->c, &cpu->master->hle7);
     if (!cpu->c.cpsr.i && cpu->c.irq) {
         cpu_handle_interrupt((ArmCore*) cpu, I_IRQ);
         return;
@@ -32,15 +35,23 @@ void arm7_step(Arm7TDMI* cpu) {
     arm_exec_instr((ArmCore*) cpu);
 }
 
+static inline int arm7_waitstates(Arm7TDMI* cpu, u32 addr, int size) {
+    int i = (size == 4) << 1 | (addr == cpu->next_seq);
+    cpu->next_seq = addr + size;
+    return cpu->waitstates[addr >> 24][i];
+}
+
 u32 arm7_read8(Arm7TDMI* cpu, u32 addr, bool sx) {
-    cpu->c.cycles++;
+    WATCH(cpu->master, CPU7, addr, 1, WATCH_READ, 0);
+    cpu->c.cycles += arm7_waitstates(cpu, addr, 1);
     u32 data = bus7_read8(cpu->master, addr);
     if (sx) data = (s8) data;
     return data;
 }
 
 u32 arm7_read16(Arm7TDMI* cpu, u32 addr, bool sx) {
-    cpu->c.cycles++;
+    WATCH(cpu->master, CPU7, addr & ~1, 2, WATCH_READ, 0);
+    cpu->c.cycles += arm7_waitstates(cpu, addr, 2);
     u32 data = bus7_read16(cpu->master, addr & ~1);
     if (addr & 1) {
         if (sx) {
@@ -51,7 +62,8 @@ u32 arm7_read16(Arm7TDMI* cpu, u32 addr, bool sx) {
 }
 
 u32 arm7_read32(Arm7TDMI* cpu, u32 addr) {
-    cpu->c.cycles++;
+    WATCH(cpu->master, CPU7, addr & ~3, 4, WATCH_READ, 0);
+    cpu->c.cycles += arm7_waitstates(cpu, addr, 4);
     u32 data = bus7_read32(cpu->master, addr & ~3);
     if (addr & 0b11) {
         data =
@@ -61,36 +73,43 @@ u32 arm7_read32(Arm7TDMI* cpu, u32 addr) {
 }
 
 void arm7_write8(Arm7TDMI* cpu, u32 addr, u8 b) {
-    cpu->c.cycles++;
+    WATCH(cpu->master, CPU7, addr, 1, WATCH_WRITE, b);
+    cpu->c.cycles += arm7_waitstates(cpu, addr, 1);
     bus7_write8(cpu->master, addr, b);
 }
 
 void arm7_write16(Arm7TDMI* cpu, u32 addr, u16 h) {
-    cpu->c.cycles++;
+    WATCH(cpu->master, CPU7, addr & ~1, 2, WATCH_WRITE, h);
+    cpu->c.cycles += arm7_waitstates(cpu, addr, 2);
     bus7_write16(cpu->master, addr & ~1, h);
 }
 
 void arm7_write32(Arm7TDMI* cpu, u32 addr, u32 w) {
-    cpu->c.cycles++;
+    WATCH(cpu->master, CPU7, addr & ~3, 4, WATCH_WRITE, w);
+    cpu->c.cycles += arm7_waitstates(cpu, addr, 4);
     bus7_write32(cpu->master, addr & ~3, w);
 }
 
 u16 arm7_fetch16(Arm7TDMI* cpu, u32 addr) {
-    cpu->c.cycles++;
+    cpu->c.cycles += arm7_waitstates(cpu, addr, 2);
     u16 data = bus7_read16(cpu->master, addr & ~1);
     if (cpu->master->memerr && !cpu->master->cpuerr) {
-        printf("Invalid CPU7 (thumb) instruction fetch at 0x%08x\n", addr);
+        eprintf("Invalid CPU7 (thumb) instruction fetch at 0x%08x\n", addr);
         cpu->master->cpuerr = true;
+        cpu->master->cpuerr_cpu = CPU7;
+        cpu->master->cpuerr_addr = addr;
     }
     return data;
 }
 
 u32 arm7_fetch32(Arm7TDMI* cpu, u32 addr) {
-    cpu->c.cycles++;
+    cpu->c.cycles += arm7_waitstates(cpu, addr, 4);
     u32 data = bus7_read32(cpu->master, addr & ~3);
     if (cpu->master->memerr && !cpu->master->cpuerr) {
-        printf("Invalid CPU7 instruction fetch at 0x%08x\n", addr);
+        eprintf("Invalid CPU7 instruction fetch at 0x%08x\n", addr);
         cpu->master->cpuerr = true;
+        cpu->master->cpuerr_cpu = CPU7;
+        cpu->master->cpuerr_addr = addr;
     }
     return data;
 }
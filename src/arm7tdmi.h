@@ -3,6 +3,7 @@
 
 #include "arm/arm.h"
 #include "arm/arm_core.h"
+#include "memtiming.h"
 #include "types.h"
 
 typedef struct _NDS NDS;
@@ -12,6 +13,9 @@ typedef struct _Arm7TDMI {
 
     NDS* master;
 
+    u8 waitstates[1 << 8][WS_MAX];
+    u32 next_seq;
+
 } Arm7TDMI;
 
 void arm7_init(Arm7TDMI* cpu);
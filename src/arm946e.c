@@ -1,9 +1,11 @@
 #include "arm946e.h"
 
 #include <stdio.h>
+#include <string.h>
 
 #include "arm/arm.h"
 #include "arm/arm_core.h"
+#include "bios.h"
 #include "bus9.h"
 #include "nds.h"
 #include "arm/thumb.h"
@@ -23,6 +25,7 @@ void arm9_init(Arm946E* cpu) {
     cpu->c.fetch32 = (void*) arm9_fetch32;
     cpu->c.cp15_read = (void*) cp15_read;
     cpu->c.cp15_write = (void*) cp15_write;
+    cpu->c.swi_hle = NULL;
 
     cpu->c.v5 = true;
     cpu->c.vector_base = 0xffff0000;
@@ -37,6 +40,7 @@ bool arm9_step(Arm946E* cpu) {
             return false;
         }
     }
+    if (cpu->master->hle9.check) bios_check_result(&cpu->c, &cpu->master->hle9);
     if (!cpu->c.cpsr.i && cpu->c.irq) {
         cpu_handle_interrupt((ArmCore*) cpu, I_IRQ);
     } else {
@@ -46,34 +50,93 @@ bool arm9_step(Arm946E* cpu) {
     return true;
 }
 
+#define PAGE_BIT(map, addr) ((map)[(addr) >> 18] >> ((addr) >> 12 & 63) & 1)
+
+static inline int arm9_bus_waitstates(Arm946E* cpu, u32 addr, int size,
+                                      u32* next_seq) {
+    int i = (size == 4) << 1 | (addr == *next_seq);
+    *next_seq = addr + size;
+    return cpu->waitstates[addr >> 24][i];
+}
+
+static inline int arm9_linefill_waitstates(Arm946E* cpu, u32 addr) {
+    return cpu->waitstates[addr >> 24][WS_N32] +
+           (CACHE_LINE / 4 - 1) * cpu->waitstates[addr >> 24][WS_S32];
+}
+
+static bool cache_lookup(u32* set, u8* next, u32 addr) {
+    u32 tag = (addr & ~(CACHE_LINE - 1)) | 1;
+    for (int i = 0; i < CACHE_WAYS; i++) {
+        if (set[i] == tag) return true;
+    }
+    set[*next] = tag;
+    *next = (*next + 1) % CACHE_WAYS;
+    return false;
+}
+
+static void cache_invalidate(u32* set, u32 addr) {
+    u32 tag = (addr & ~(CACHE_LINE - 1)) | 1;
+    for (int i = 0; i < CACHE_WAYS; i++) {
+        if (set[i] == tag) set[i] = 0;
+    }
+}
+
+static inline int arm9_data_waitstates(Arm946E* cpu, u32 addr, int size,
+                                       bool write) {
+    if (cpu->cp15_control.dcache_on && PAGE_BIT(cpu->dcacheable, addr)) {
+        if (write || !cpu->cache_model) return 1;
+        int set = (addr / CACHE_LINE) % DCACHE_SETS;
+        if (cache_lookup(cpu->dcache[set], &cpu->dcache_next[set], addr))
+            return 1;
+        return arm9_linefill_waitstates(cpu, addr);
+    }
+    return arm9_bus_waitstates(cpu, addr, size, &cpu->next_seq_data);
+}
+
+static inline int arm9_code_waitstates(Arm946E* cpu, u32 addr, int size) {
+    if (cpu->cp15_control.icache_on && PAGE_BIT(cpu->icacheable, addr)) {
+        if (!cpu->cache_model) return 0;
+        int set = (addr / CACHE_LINE) % ICACHE_SETS;
+        if (cache_lookup(cpu->icache[set], &cpu->icache_next[set], addr))
+            return 0;
+        return arm9_linefill_waitstates(cpu, addr);
+    }
+    return arm9_bus_waitstates(cpu, addr, size, &cpu->next_seq_code);
+}
+
 #define READ(size, addr)                                                       \
     if (cpu->cp15_control.itcm_on && !cpu->cp15_control.itcm_load &&           \
-        (addr) < cpu->itcm_virtsize)                                           \
+        (addr) < cpu->itcm_virtsize) {                                         \
         data = *(u##size*) &cpu->itcm[(addr) % ITCMSIZE];                      \
-    else if (cpu->cp15_control.dtcm_on && !cpu->cp15_control.dtcm_load &&      \
-             (addr) - cpu->dtcm_base < cpu->dtcm_virtsize)                     \
+        cpu->c.cycles++;                                                       \
+    } else if (cpu->cp15_control.dtcm_on && !cpu->cp15_control.dtcm_load &&    \
+               (addr) - cpu->dtcm_base < cpu->dtcm_virtsize) {                 \
         data = *(u##size*) &cpu->dtcm[(addr) % DTCMSIZE];                      \
-    else data = bus9_read##size(cpu->master, addr);
+        cpu->c.cycles++;                                                       \
+    } else {                                                                   \
+        data = bus9_read##size(cpu->master, addr);                             \
+        cpu->c.cycles += arm9_data_waitstates(cpu, addr, size / 8, false);     \
+    }
 
 u32 arm9_read8(Arm946E* cpu, u32 addr, bool sx) {
-    cpu->c.cycles++;
     u32 data;
+    WATCH(cpu->master, CPU9, addr, 1, WATCH_READ, 0);
     READ(8, addr);
     if (sx) data = (s8) data;
     return data;
 }
 
 u32 arm9_read16(Arm946E* cpu, u32 addr, bool sx) {
-    cpu->c.cycles++;
     u32 data;
+    WATCH(cpu->master, CPU9, addr & ~1, 2, WATCH_READ, 0);
     READ(16, addr & ~1);
     if (sx) data = (s16) data;
     return data;
 }
 
 u32 arm9_read32(Arm946E* cpu, u32 addr) {
-    cpu->c.cycles++;
     u32 data;
+    WATCH(cpu->master, CPU9, addr & ~3, 4, WATCH_READ, 0);
     READ(32, addr & ~3);
     if (addr & 0b11) {
         data =
@@ -83,25 +146,30 @@ u32 arm9_read32(Arm946E* cpu, u32 addr) {
 }
 
 #define WRITE(size, addr)                                                      \
-    if (cpu->cp15_control.itcm_on && (addr) < cpu->itcm_virtsize)              \
+    if (cpu->cp15_control.itcm_on && (addr) < cpu->itcm_virtsize) {            \
         *(u##size*) &cpu->itcm[(addr) % ITCMSIZE] = data;                      \
-    else if (cpu->cp15_control.dtcm_on &&                                      \
-             (addr) - cpu->dtcm_base < cpu->dtcm_virtsize)                     \
+        cpu->c.cycles++;                                                       \
+    } else if (cpu->cp15_control.dtcm_on &&                                    \
+               (addr) - cpu->dtcm_base < cpu->dtcm_virtsize) {                 \
         *(u##size*) &cpu->dtcm[(addr) % DTCMSIZE] = data;                      \
-    else bus9_write##size(cpu->master, addr, data);
+        cpu->c.cycles++;                                                       \
+    } else {                                                                   \
+        bus9_write##size(cpu->master, addr, data);                             \
+        cpu->c.cycles += arm9_data_waitstates(cpu, addr, size / 8, true);      \
+    }
 
 void arm9_write8(Arm946E* cpu, u32 addr, u8 data) {
-    cpu->c.cycles++;
+    WATCH(cpu->master, CPU9, addr, 1, WATCH_WRITE, data);
     WRITE(8, addr);
 }
 
 void arm9_write16(Arm946E* cpu, u32 addr, u16 data) {
-    cpu->c.cycles++;
+    WATCH(cpu->master, CPU9, addr & ~1, 2, WATCH_WRITE, data);
     WRITE(16, addr & ~1);
 }
 
 void arm9_write32(Arm946E* cpu, u32 addr, u32 data) {
-    cpu->c.cycles++;
+    WATCH(cpu->master, CPU9, addr & ~3, 4, WATCH_WRITE, data);
     WRITE(32, addr & ~3);
 }
 
@@ -112,9 +180,12 @@ u16 arm9_fetch16(Arm946E* cpu, u32 addr) {
         data = *(u16*) &cpu->itcm[(addr & ~1) % ITCMSIZE];
     else {
         data = bus9_read16(cpu->master, addr & ~1);
+        cpu->c.cycles += arm9_code_waitstates(cpu, addr, 2);
         if (cpu->master->memerr && !cpu->master->cpuerr) {
-            printf("Invalid CPU9 (thumb) instruction fetch at 0x%08x\n", addr);
+            eprintf("Invalid CPU9 (thumb) instruction fetch at 0x%08x\n", addr);
             cpu->master->cpuerr = true;
+            cpu->master->cpuerr_cpu = CPU9;
+            cpu->master->cpuerr_addr = addr;
         }
     }
     return data;
@@ -127,14 +198,42 @@ u32 arm9_fetch32(Arm946E* cpu, u32 addr) {
         data = *(u32*) &cpu->itcm[(addr & ~3) % ITCMSIZE];
     else {
         data = bus9_read32(cpu->master, addr & ~3);
+        cpu->c.cycles += arm9_code_waitstates(cpu, addr, 4);
         if (cpu->master->memerr && !cpu->master->cpuerr) {
-            printf("Invalid CPU9 instruction fetch at 0x%08x\n", addr);
+            eprintf("Invalid CPU9 instruction fetch at 0x%08x\n", addr);
             cpu->master->cpuerr = true;
+            cpu->master->cpuerr_cpu = CPU9;
+            cpu->master->cpuerr_addr = addr;
         }
     }
     return data;
 }
 
+static void set_page_bit(u64* map, u32 page, bool b) {
+    if (b) map[page >> 6] |= 1ull << (page & 63);
+    else map[page >> 6] &= ~(1ull << (page & 63));
+}
+
+static void update_cacheable(Arm946E* cpu) {
+    memset(cpu->dcacheable, 0, sizeof cpu->dcacheable);
+    memset(cpu->icacheable, 0, sizeof cpu->icacheable);
+    if (!cpu->cp15_control.pu_on) return;
+    for (int r = 0; r < 8; r++) {
+        u32 region = cpu->pu_regions[r];
+        if (!(region & 1)) continue;
+        int sizebits = ((region >> 1) & 0x1f) + 1;
+        if (sizebits < 12) sizebits = 12;
+        u32 pages = 1 << (sizebits - 12);
+        u32 start = (region >> 12) & ~(pages - 1);
+        bool d = cpu->dcache_regions & (1 << r);
+        bool i = cpu->icache_regions & (1 << r);
+        for (u32 p = 0; p < pages; p++) {
+            set_page_bit(cpu->dcacheable, (start + p) & 0xfffff, d);
+            set_page_bit(cpu->icacheable, (start + p) & 0xfffff, i);
+        }
+    }
+}
+
 u32 cp15_read(Arm946E* cpu, u32 cn, u32 cm, u32 cp) {
     switch (cn) {
         case 0:
@@ -158,6 +257,13 @@ u32 cp15_read(Arm946E* cpu, u32 cn, u32 cm, u32 cp) {
                 return cpu->cp15_control.w;
             }
             break;
+        case 2:
+            if (cm == 0 && cp == 0) return cpu->dcache_regions;
+            if (cm == 0 && cp == 1) return cpu->icache_regions;
+            break;
+        case 6:
+            if (cp == 0) return cpu->pu_regions[cm & 7];
+            break;
         case 9:
             switch (cm) {
                 case 1: {
@@ -195,6 +301,26 @@ void cp15_write(Arm946E* cpu, u32 cn, u32 cm, u32 cp, u32 data) {
                     cpu->c.vector_base = 0x00000000;
                 }
                 cpu->c.v5 = !cpu->cp15_control.v4mode;
+                update_cacheable(cpu);
+                return;
+            }
+            break;
+        case 2:
+            if (cm == 0 && cp == 0) {
+                cpu->dcache_regions = data;
+                update_cacheable(cpu);
+                return;
+            }
+            if (cm == 0 && cp == 1) {
+                cpu->icache_regions = data;
+                update_cacheable(cpu);
+                return;
+            }
+            break;
+        case 6:
+            if (cp == 0) {
+                cpu->pu_regions[cm & 7] = data;
+                update_cacheable(cpu);
                 return;
             }
             break;
@@ -203,6 +329,24 @@ void cp15_write(Arm946E* cpu, u32 cn, u32 cm, u32 cp, u32 data) {
                 cpu->halt = true;
                 return;
             }
+            if (cm == 5 && cp == 0) {
+                memset(cpu->icache, 0, sizeof cpu->icache);
+                return;
+            }
+            if (cm == 5 && cp == 1) {
+                cache_invalidate(cpu->icache[(data / CACHE_LINE) % ICACHE_SETS],
+                                 data);
+                return;
+            }
+            if (cm == 6 && cp == 0) {
+                memset(cpu->dcache, 0, sizeof cpu->dcache);
+                return;
+            }
+            if ((cm == 6 || cm == 14) && cp == 1) {
+                cache_invalidate(cpu->dcache[(data / CACHE_LINE) % DCACHE_SETS],
+                                 data);
+                return;
+            }
             break;
         case 9:
             if (cn == 9 && cm == 1) {
@@ -3,11 +3,17 @@
 
 #include "arm/arm.h"
 #include "arm/arm_core.h"
+#include "memtiming.h"
 #include "types.h"
 
 #define ITCMSIZE (1 << 15)
 #define DTCMSIZE (1 << 14)
 
+#define CACHE_LINE 32
+#define CACHE_WAYS 4
+#define ICACHE_SETS (8192 / CACHE_LINE / CACHE_WAYS)
+#define DCACHE_SETS (4096 / CACHE_LINE / CACHE_WAYS)
+
 typedef struct _NDS NDS;
 
 typedef struct _Arm946E {
@@ -20,7 +26,11 @@ typedef struct _Arm946E {
     union {
         u32 w;
         struct {
-            u32 whatever1 : 13;
+            u32 pu_on : 1;
+            u32 whatever0 : 1;
+            u32 dcache_on : 1;
+            u32 whatever1 : 9;
+            u32 icache_on : 1;
             u32 vector_base : 1;
             u32 whatever2 : 1;
             u32 v4mode : 1;
@@ -39,6 +49,23 @@ typedef struct _Arm946E {
     u32 dtcm_base;
     u32 dtcm_virtsize;
 
+    u32 pu_regions[8];
+    u8 dcache_regions;
+    u8 icache_regions;
+
+    u64 dcacheable[1 << 14];
+    u64 icacheable[1 << 14];
+
+    u8 waitstates[1 << 8][WS_MAX];
+    u32 next_seq_code;
+    u32 next_seq_data;
+
+    bool cache_model;
+    u32 icache[ICACHE_SETS][CACHE_WAYS];
+    u32 dcache[DCACHE_SETS][CACHE_WAYS];
+    u8 icache_next[ICACHE_SETS];
+    u8 dcache_next[DCACHE_SETS];
+
 } Arm946E;
 
 void arm9_init(Arm946E* cpu);
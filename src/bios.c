@@ -0,0 +1,466 @@
+#include "bios.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arm/arm.h"
+#include "nds.h"
+
+#define CALLBACK_MAX_INSTRS (1 << 20)
+
+typedef struct {
+    u32 regs;
+    u32 r[4];
+    u32 dst;
+    u32 len;
+    u8* buf;
+    int width;
+} SwiResult;
+
+typedef struct {
+    ArmCore* cpu;
+    u32 src;
+    u32 cb;
+} SrcReader;
+
+// runs a guest function until it returns to the swi instruction
+static u32 call_guest(ArmCore* cpu, u32 addr, u32 r0, u32 r1, u32 r2) {
+    u32 r[4], r12 = cpu->r[12], lr = cpu->lr, pc = cpu->pc, cpsr = cpu->cpsr.w;
+    memcpy(r, cpu->r, sizeof r);
+    ArmInstr cur = cpu->cur_instr, next = cpu->next_instr;
+    u32 cur_addr = cpu->cur_instr_addr, next_addr = cpu->next_instr_addr;
+    u32 t = cpu->cpsr.t;
+
+    cpu->r[0] = r0;
+    cpu->r[1] = r1;
+    cpu->r[2] = r2;
+    // bx lr must come back in the state the swi was issued from
+    cpu->lr = cur_addr | t;
+    cpu->cpsr.t = addr & 1;
+    cpu->pc = addr;
+    cpu_flush(cpu);
+    for (int i = 0; cpu->cur_instr_addr != cur_addr || cpu->cpsr.t != t;
+         i++) {
+        if (i == CALLBACK_MAX_INSTRS) {
+            eprintf("HLE bios callback at 0x%08x did not return\n", addr);
+            break;
+        }
+        arm_exec_instr(cpu);
+    }
+    u32 res = cpu->r[0];
+
+    memcpy(cpu->r, r, sizeof r);
+    cpu->r[12] = r12;
+    cpu->lr = lr;
+    cpu->pc = pc;
+    cpu->cpsr.w = cpsr;
+    cpu->cur_instr = cur;
+    cpu->next_instr = next;
+    cpu->cur_instr_addr = cur_addr;
+    cpu->next_instr_addr = next_addr;
+    return res;
+}
+
+static u32 src_open(SrcReader* rd, u32 dst, u32 param) {
+    u32 header;
+    if (rd->cb) {
+        header = call_guest(rd->cpu, rd->cpu->read32(rd->cpu, rd->cb), rd->src,
+                            dst, param);
+    } else header = rd->cpu->read32(rd->cpu, rd->src);
+    rd->src += 4;
+    return header;
+}
+
+static u8 src_get8(SrcReader* rd) {
+    u8 b;
+    if (rd->cb) {
+        b = call_guest(rd->cpu, rd->cpu->read32(rd->cpu, rd->cb + 8), rd->src,
+                       0, 0);
+    } else b = rd->cpu->read8(rd->cpu, rd->src, false);
+    rd->src++;
+    return b;
+}
+
+static u32 src_get32(SrcReader* rd) {
+    u32 w;
+    if (rd->cb) {
+        w = call_guest(rd->cpu, rd->cpu->read32(rd->cpu, rd->cb + 16), rd->src,
+                       0, 0);
+    } else w = rd->cpu->read32(rd->cpu, rd->src);
+    rd->src += 4;
+    return w;
+}
+
+static void src_close(SrcReader* rd) {
+    if (!rd->cb) return;
+    u32 close = rd->cpu->read32(rd->cpu, rd->cb + 4);
+    if (close) call_guest(rd->cpu, close, rd->src, 0, 0);
+}
+
+static u8* alloc_output(u32 len) {
+    return calloc(len + 4, 1);
+}
+
+static void lz77_uncomp(SrcReader* rd, u32 header, SwiResult* res) {
+    u32 len = header >> 8;
+    u8* out = alloc_output(len);
+    u32 o = 0;
+    while (o < len) {
+        u8 flags = src_get8(rd);
+        for (int i = 0; i < 8 && o < len; i++, flags <<= 1) {
+            if (flags & 0x80) {
+                u8 b1 = src_get8(rd);
+                u8 b2 = src_get8(rd);
+                u32 disp = (((b1 & 0xf) << 8) | b2) + 1;
+                int n = (b1 >> 4) + 3;
+                for (int j = 0; j < n && o < len; j++, o++) {
+                    out[o] = disp <= o ? out[o - disp] : 0;
+                }
+            } else out[o++] = src_get8(rd);
+        }
+    }
+    res->buf = out;
+    res->len = len;
+}
+
+static void rl_uncomp(SrcReader* rd, u32 header, SwiResult* res) {
+    u32 len = header >> 8;
+    u8* out = alloc_output(len);
+    u32 o = 0;
+    while (o < len) {
+        u8 flag = src_get8(rd);
+        if (flag & 0x80) {
+            int n = (flag & 0x7f) + 3;
+            u8 b = src_get8(rd);
+            for (int j = 0; j < n && o < len; j++) out[o++] = b;
+        } else {
+            int n = (flag & 0x7f) + 1;
+            for (int j = 0; j < n && o < len; j++) out[o++] = src_get8(rd);
+        }
+    }
+    res->buf = out;
+    res->len = len;
+}
+
+static void huff_uncomp(SrcReader* rd, u32 header, SwiResult* res) {
+    u32 len = header >> 8;
+    int bits = header & 0xf;
+    if (bits != 4 && bits != 8) bits = 8;
+    u8* out = alloc_output(len);
+
+    u8 tree[0x200];
+    tree[0] = src_get8(rd);
+    int treesize = (tree[0] + 1) * 2;
+    for (int i = 1; i < treesize; i++) tree[i] = src_get8(rd);
+
+    u32 o = 0, word = 0;
+    int wordbits = 0;
+    int node = 1;
+    while (o < len) {
+        u32 stream = src_get32(rd);
+        for (int i = 0; i < 32 && o < len; i++, stream <<= 1) {
+            int bit = stream >> 31;
+            int child = (node & ~1) + (tree[node] & 0x3f) * 2 + 2 + bit;
+            bool end = tree[node] & (0x80 >> bit);
+            if (child >= treesize) child = treesize - 1;
+            if (!end) {
+                node = child;
+                continue;
+            }
+            word |= (tree[child] & ((1 << bits) - 1)) << wordbits;
+            wordbits += bits;
+            node = 1;
+            if (wordbits == 32) {
+                for (int j = 0; j < 4 && o < len; j++) out[o++] = word >> 8 * j;
+                word = 0;
+                wordbits = 0;
+            }
+        }
+    }
+    res->buf = out;
+    res->len = len;
+}
+
+static void cpu_set(ArmCore* cpu, u32 src, u32 dst, u32 cnt, bool fast,
+                    SwiResult* res) {
+    u32 n = cnt & 0x1fffff;
+    bool fill = cnt & (1 << 24);
+    int size = fast || (cnt & (1 << 26)) ? 4 : 2;
+    if (fast) n = (n + 7) & ~7;
+    src &= ~(size - 1);
+    dst &= ~(size - 1);
+
+    u8* out = alloc_output(n * size);
+    u32 fillval =
+        size == 4 ? cpu->read32(cpu, src) : cpu->read16(cpu, src, false);
+    for (u32 i = 0; i < n * size; i += size) {
+        u32 v = fillval;
+        if (!fill) {
+            u32 addr = src + i;
+            if (addr - dst < i) {
+                v = size == 4 ? *(u32*) &out[addr - dst]
+                              : *(u16*) &out[addr - dst];
+            } else if (size == 4) v = cpu->read32(cpu, addr);
+            else v = cpu->read16(cpu, addr, false);
+        }
+        if (size == 4) *(u32*) &out[i] = v;
+        else *(u16*) &out[i] = v;
+    }
+    res->dst = dst;
+    res->buf = out;
+    res->len = n * size;
+    res->width = size;
+}
+
+static u32 get_crc16(ArmCore* cpu, u32 crc, u32 addr, u32 len, u32* last) {
+    crc &= 0xffff;
+    addr &= ~1;
+    u16 h = 0;
+    for (u32 i = 0; i < (len & ~1); i += 2) {
+        h = cpu->read16(cpu, addr + i, false);
+        for (int j = 0; j < 16; j++) {
+            if (j % 8 == 0) crc ^= (h >> j) & 0xff;
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+        }
+    }
+    *last = h;
+    return crc;
+}
+
+static u32 isqrt(u32 x) {
+    u32 res = 0;
+    for (u32 bit = 1 << 30; bit; bit >>= 2) {
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        } else res >>= 1;
+    }
+    return res;
+}
+
+static bool intr_wait(NDS* nds, ArmCore* cpu, BiosHLE* hle, bool arm9,
+                      bool discard, u32 mask) {
+    IO* io = arm9 ? &nds->io9 : &nds->io7;
+    u32 flagsaddr = arm9 ? nds->cpu9.dtcm_base + 0x3ff8 : 0x0380fff8;
+    if (!hle->intrwait) {
+        io->ime = 1;
+        cpu->irq = io->ie.w & io->ifl.w;
+        if (discard) {
+            cpu->write32(cpu, flagsaddr, cpu->read32(cpu, flagsaddr) & ~mask);
+        }
+    }
+    u32 flags = cpu->read32(cpu, flagsaddr);
+    if (flags & mask) {
+        cpu->write32(cpu, flagsaddr, flags & ~mask);
+        hle->intrwait = false;
+        cpu_fetch_instr(cpu);
+    } else {
+        // the swi is executed again when the irq handler returns
+        hle->intrwait = true;
+        if (arm9) nds->cpu9.halt = true;
+        else nds->halt7 = true;
+    }
+    return true;
+}
+
+static bool bios_swi(NDS* nds, ArmCore* cpu, BiosHLE* hle, bool arm9, u32 num) {
+    BiosMode mode = nds->bios_mode;
+    u32* r = cpu->r;
+
+    if (mode == BIOS_HLE) {
+        switch (num) {
+            case 0x03:
+                cpu->cycles += 4 * (r[0] < (1 << 20) ? r[0] : (1 << 20));
+                r[0] = 0;
+                cpu_fetch_instr(cpu);
+                return true;
+            case 0x04:
+                return intr_wait(nds, cpu, hle, arm9, r[0], r[1]);
+            case 0x05:
+                r[0] = 1;
+                r[1] = 1;
+                return intr_wait(nds, cpu, hle, arm9, true, 1);
+            case 0x06:
+                if (arm9) nds->cpu9.halt = true;
+                else nds->halt7 = true;
+                cpu_fetch_instr(cpu);
+                return true;
+            case 0x08:
+                if (arm9) break;
+                cpu->write16(cpu, 0x04000504, r[0] ? 0x200 : 0);
+                cpu_fetch_instr(cpu);
+                return true;
+            case 0x0f:
+                r[0] = 0;
+                cpu_fetch_instr(cpu);
+                return true;
+        }
+    }
+
+    SwiResult res = {.width = 1};
+    SrcReader rd = {.cpu = cpu, .src = r[0]};
+    switch (num) {
+        case 0x09: {
+            s32 n = r[0], d = r[1];
+            res.regs = 0b1011;
+            if (d == 0) {
+                res.r[0] = n < 0 ? 1 : -1;
+                res.r[1] = n;
+                res.r[3] = 1;
+            } else {
+                s64 q = (s64) n / d;
+                res.r[0] = q;
+                res.r[1] = (s64) n % d;
+                res.r[3] = q < 0 ? -q : q;
+            }
+            cpu->cycles += 32;
+            break;
+        }
+        case 0x0b:
+        case 0x0c:
+            cpu_set(cpu, r[0], r[1], r[2], num == 0x0c, &res);
+            break;
+        case 0x0d:
+            res.regs = 0b0001;
+            res.r[0] = isqrt(r[0]);
+            cpu->cycles += 32;
+            break;
+        case 0x0e:
+            res.regs = 0b1001;
+            res.r[0] = get_crc16(cpu, r[0], r[1], r[2], &res.r[3]);
+            break;
+        case 0x12:
+        case 0x15:
+            // the callbacks may have state so they can't be run again by the
+            // real bios after the hle result is computed
+            if (mode == BIOS_VERIFY) return false;
+            res.width = 2;
+            rd.cb = r[3];
+            // fallthrough
+        case 0x11:
+        case 0x14: {
+            res.dst = r[1];
+            u32 header = src_open(&rd, r[1], r[2]);
+            if (num == 0x11 || num == 0x12) lz77_uncomp(&rd, header, &res);
+            else rl_uncomp(&rd, header, &res);
+            src_close(&rd);
+            break;
+        }
+        case 0x13: {
+            if (mode == BIOS_VERIFY) return false;
+            res.dst = r[1];
+            res.width = 4;
+            rd.cb = r[3];
+            u32 header = src_open(&rd, r[1], r[2]);
+            huff_uncomp(&rd, header, &res);
+            src_close(&rd);
+            break;
+        }
+        default:
+            if (mode == BIOS_HLE && !(hle->warned & (1 << num))) {
+                hle->warned |= 1 << num;
+                eprintf("HLE bios: unhandled CPU%d swi 0x%02x\n", arm9 ? 9 : 7,
+                        num);
+            }
+            return false;
+    }
+
+    if (mode == BIOS_VERIFY) {
+        free(hle->check_buf);
+        hle->check = true;
+        hle->check_swi = num;
+        hle->check_ret = cpu->cur_instr_addr + (cpu->cpsr.t ? 2 : 4);
+        hle->check_mode = cpu->cpsr.m;
+        hle->check_regs = res.regs;
+        memcpy(hle->check_r, res.r, sizeof res.r);
+        hle->check_dst = res.dst;
+        hle->check_len = res.len;
+        hle->check_buf = res.buf;
+        return false;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        if (res.regs & (1 << i)) r[i] = res.r[i];
+    }
+    for (u32 i = 0; i < res.len; i += res.width) {
+        switch (res.width) {
+            case 1:
+                cpu->write8(cpu, res.dst + i, res.buf[i]);
+                break;
+            case 2:
+                cpu->write16(cpu, res.dst + i, *(u16*) &res.buf[i]);
+                break;
+            case 4:
+                cpu->write32(cpu, res.dst + i, *(u32*) &res.buf[i]);
+                break;
+        }
+    }
+    free(res.buf);
+    cpu_fetch_instr(cpu);
+    return true;
+}
+
+static bool bios7_swi(Arm7TDMI* cpu, u32 num) {
+    return bios_swi(cpu->master, &cpu->c, &cpu->master->hle7, false, num);
+}
+
+static bool bios9_swi(Arm946E* cpu, u32 num) {
+    return bios_swi(cpu->master, &cpu->c, &cpu->master->hle9, true, num);
+}
+
+void bios_check_result(ArmCore* cpu, BiosHLE* hle) {
+    if (cpu->cur_instr_addr != hle->check_ret || cpu->cpsr.m != hle->check_mode)
+        return;
+    hle->check = false;
+    int cycles = cpu->cycles;
+    for (int i = 0; i < 4; i++) {
+        if ((hle->check_regs & (1 << i)) && cpu->r[i] != hle->check_r[i]) {
+            eprintf("HLE bios mismatch in swi 0x%02x: r%d = 0x%08x, hle "
+                    "0x%08x\n",
+                    hle->check_swi, i, cpu->r[i], hle->check_r[i]);
+        }
+    }
+    for (u32 i = 0; i < hle->check_len; i++) {
+        u8 b = cpu->read8(cpu, hle->check_dst + i, false);
+        if (b != hle->check_buf[i]) {
+            eprintf("HLE bios mismatch in swi 0x%02x: [0x%08x] = 0x%02x, hle "
+                    "0x%02x\n",
+                    hle->check_swi, hle->check_dst + i, b, hle->check_buf[i]);
+            break;
+        }
+    }
+    cpu->cycles = cycles;
+    free(hle->check_buf);
+    hle->check_buf = NULL;
+}
+
+void bios_hle_init(NDS* nds, BiosMode mode) {
+    nds->bios_mode = mode;
+    if (mode == BIOS_LLE) return;
+    nds->cpu7.c.swi_hle = (void*) bios7_swi;
+    nds->cpu9.c.swi_hle = (void*) bios9_swi;
+}
+
+void bios_hle_free(NDS* nds) {
+    free(nds->hle7.check_buf);
+    free(nds->hle9.check_buf);
+    nds->hle7.check_buf = NULL;
+    nds->hle9.check_buf = NULL;
+}
+
+// vectors and irq dispatch of the real bios, swis not handled by hle just
+// return
+void bios_make_stub(u8* bios7, u8* bios9) {
+    static const u32 vectors[8] = {0xeafffffe, 0xeafffffe, 0xe1b0f00e,
+                                   0xeafffffe, 0xeafffffe, 0xeafffffe,
+                                   0xea000000, 0xeafffffe};
+    static const u32 irq7[] = {0xe92d500f, 0xe3a00301, 0xe28fe000,
+                               0xe510f004, 0xe8bd500f, 0xe25ef004};
+    static const u32 irq9[] = {0xe92d500f, 0xee190f11, 0xe1a00620,
+                               0xe1a00600, 0xe2800901, 0xe28fe000,
+                               0xe510f004, 0xe8bd500f, 0xe25ef004};
+    memcpy(bios7, vectors, sizeof vectors);
+    memcpy(bios7 + sizeof vectors, irq7, sizeof irq7);
+    memcpy(bios9, vectors, sizeof vectors);
+    memcpy(bios9 + sizeof vectors, irq9, sizeof irq9);
+}
@@ -0,0 +1,32 @@
+#ifndef BIOS_H
+#define BIOS_H
+
+#include "arm/arm_core.h"
+#include "types.h"
+
+typedef enum { BIOS_LLE, BIOS_HLE, BIOS_VERIFY } BiosMode;
+
+typedef struct {
+    bool intrwait;
+    u32 warned;
+
+    bool check;
+    u32 check_swi;
+    u32 check_ret;
+    u32 check_mode;
+    u32 check_regs;
+    u32 check_r[4];
+    u32 check_dst;
+    u32 check_len;
+    u8* check_buf;
+} BiosHLE;
+
+typedef struct _NDS NDS;
+
+void bios_hle_init(NDS* nds, BiosMode mode);
+void bios_hle_free(NDS* nds);
+void bios_make_stub(u8* bios7, u8* bios9);
+
+void bios_check_result(ArmCore* cpu, BiosHLE* hle);
+
+#endif
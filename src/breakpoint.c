@@ -0,0 +1,265 @@
+#include "breakpoint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bus7.h"
+#include "bus9.h"
+#include "nds.h"
+
+static u32 hash(u32 addr) {
+    return (addr >> 1) * 0x9e3779b1 >> (32 - BKPT_HASH_BITS);
+}
+
+static int lookup(Breakpoints* b, int cpu, u32 addr) {
+    for (u32 h = hash(addr);; h = (h + 1) & ((1 << BKPT_HASH_BITS) - 1)) {
+        int i = b->table[cpu][h];
+        if (i < 0 || b->bp[i].addr == addr) return i;
+    }
+}
+
+static void rebuild(Breakpoints* b) {
+    memset(b->pages, 0, sizeof b->pages);
+    memset(b->table, 0xff, sizeof b->table);
+    for (int i = 0; i < b->n; i++) {
+        Breakpoint* bp = &b->bp[i];
+        b->pages[bp->cpu][bp->addr >> 18] |= 1ull << (bp->addr >> 12 & 63);
+        u32 h = hash(bp->addr);
+        while (b->table[bp->cpu][h] >= 0)
+            h = (h + 1) & ((1 << BKPT_HASH_BITS) - 1);
+        b->table[bp->cpu][h] = i;
+    }
+}
+
+static char* skip_space(char* s) {
+    while (*s == ' ') s++;
+    return s;
+}
+
+static bool parse_num(char** s, u32* val) {
+    char* end;
+    *val = strtoll(*s, &end, 0);
+    if (end == *s) return false;
+    *s = end;
+    return true;
+}
+
+static bool parse_reg(char** s, u8* r) {
+    char* p = *s;
+    if (!strncmp(p, "sp", 2)) *r = 13;
+    else if (!strncmp(p, "lr", 2)) *r = 14;
+    else if (!strncmp(p, "pc", 2)) *r = 15;
+    else if (p[0] == 'r' && p[1] >= '0' && p[1] <= '9') {
+        char* end;
+        long n = strtol(p + 1, &end, 10);
+        if (n > 15) return false;
+        *r = n;
+        *s = end;
+        return true;
+    } else return false;
+    *s = p + 2;
+    return true;
+}
+
+// r0-r15, sp, lr, pc, cpsr, a number, or [x], h[x] or b[x] for the word,
+// halfword or byte at x, which is a register, a number or a register +/- a
+// number
+static bool parse_operand(char** s, BkptOperand* o) {
+    char* p = skip_space(*s);
+    u8 mem = 0;
+    if (p[0] == '[') mem = OPND_MEM32, p++;
+    else if (p[0] == 'h' && p[1] == '[') mem = OPND_MEM16, p += 2;
+    else if (p[0] == 'b' && p[1] == '[') mem = OPND_MEM8, p += 2;
+
+    o->reg = false;
+    o->val = 0;
+    if (mem) {
+        p = skip_space(p);
+        o->reg = parse_reg(&p, &o->r);
+        p = skip_space(p);
+        if ((!o->reg || *p == '+' || *p == '-') && !parse_num(&p, &o->val))
+            return false;
+        p = skip_space(p);
+        if (*p++ != ']') return false;
+        o->type = mem;
+    } else if (!strncmp(p, "cpsr", 4)) {
+        o->type = OPND_CPSR;
+        p += 4;
+    } else if (parse_reg(&p, &o->r)) {
+        o->type = OPND_REG;
+    } else if (parse_num(&p, &o->val)) {
+        o->type = OPND_IMM;
+    } else return false;
+    *s = p;
+    return true;
+}
+
+static const char* cond_ops[] = {"==", "!=", "<=", ">=", "<", ">", "&"};
+static const u8 cond_op_types[] = {COND_EQ, COND_NE, COND_LE, COND_GE,
+                                   COND_LT, COND_GT, COND_AND};
+
+static bool parse_cond(Breakpoint* bp, char* cond) {
+    char* p = cond;
+    if (!parse_operand(&p, &bp->lhs)) return false;
+    p = skip_space(p);
+    int i;
+    for (i = 0; i < 7; i++) {
+        if (!strncmp(p, cond_ops[i], strlen(cond_ops[i]))) break;
+    }
+    if (i == 7) return false;
+    bp->op = cond_op_types[i];
+    p += strlen(cond_ops[i]);
+    if (!parse_operand(&p, &bp->rhs)) return false;
+    return !*skip_space(p);
+}
+
+static u8* tcm_ptr(Arm946E* c9, u32 addr) {
+    if (c9->cp15_control.itcm_on && addr < c9->itcm_virtsize)
+        return &c9->itcm[addr % ITCMSIZE];
+    if (c9->cp15_control.dtcm_on && addr - c9->dtcm_base < c9->dtcm_virtsize)
+        return &c9->dtcm[addr % DTCMSIZE];
+    return NULL;
+}
+
+u32 bkpt_read(NDS* nds, int cpu, u32 addr, u8 type) {
+    u8* tcm = cpu == CPU9 ? tcm_ptr(&nds->cpu9, addr) : NULL;
+    if (tcm) {
+        if (type == OPND_MEM8) return *tcm;
+        if (type == OPND_MEM16) return *(u16*) ((uintptr_t) tcm & ~1);
+        return *(u32*) ((uintptr_t) tcm & ~3);
+    }
+    // io reads can have side effects so registers are peeked
+    if (addr >> 24 == R_IO) {
+        u32 w = cpu == CPU9 ? io9_peek32(&nds->io9, addr & 0xfffffc)
+                            : io7_peek32(&nds->io7, addr & 0xfffffc);
+        if (type == OPND_MEM8) return (u8) (w >> 8 * (addr & 3));
+        if (type == OPND_MEM16) return (u16) (w >> 8 * (addr & 2));
+        return w;
+    }
+    bool memerr = nds->memerr;
+    u32 v;
+    if (cpu == CPU9) {
+        if (type == OPND_MEM8) v = bus9_read8(nds, addr);
+        else if (type == OPND_MEM16) v = bus9_read16(nds, addr & ~1);
+        else v = bus9_read32(nds, addr & ~3);
+    } else {
+        if (type == OPND_MEM8) v = bus7_read8(nds, addr);
+        else if (type == OPND_MEM16) v = bus7_read16(nds, addr & ~1);
+        else v = bus7_read32(nds, addr & ~3);
+    }
+    nds->memerr = memerr;
+    return v;
+}
+
+void bkpt_write(NDS* nds, int cpu, u32 addr, u32 data, u8 type) {
+    u8* tcm = cpu == CPU9 ? tcm_ptr(&nds->cpu9, addr) : NULL;
+    if (tcm) {
+        if (type == OPND_MEM8) *tcm = data;
+        else if (type == OPND_MEM16) *(u16*) ((uintptr_t) tcm & ~1) = data;
+        else *(u32*) ((uintptr_t) tcm & ~3) = data;
+        return;
+    }
+    bool memerr = nds->memerr;
+    if (cpu == CPU9) {
+        if (type == OPND_MEM8) bus9_write8(nds, addr, data);
+        else if (type == OPND_MEM16) bus9_write16(nds, addr & ~1, data);
+        else bus9_write32(nds, addr & ~3, data);
+    } else {
+        if (type == OPND_MEM8) bus7_write8(nds, addr, data);
+        else if (type == OPND_MEM16) bus7_write16(nds, addr & ~1, data);
+        else bus7_write32(nds, addr & ~3, data);
+    }
+    nds->memerr = memerr;
+}
+
+static u32 reg_value(ArmCore* c, u8 r) {
+    return r == 15 ? c->cur_instr_addr : c->r[r];
+}
+
+static u32 operand_value(NDS* nds, int cpu, BkptOperand* o) {
+    ArmCore* c = cpu == CPU9 ? &nds->cpu9.c : &nds->cpu7.c;
+    switch (o->type) {
+        case OPND_REG:
+            return reg_value(c, o->r);
+        case OPND_CPSR:
+            return c->cpsr.w;
+        case OPND_IMM:
+            return o->val;
+        default:
+            return bkpt_read(nds, cpu,
+                             (o->reg ? reg_value(c, o->r) : 0) + o->val,
+                             o->type);
+    }
+}
+
+static bool eval_cond(NDS* nds, Breakpoint* bp) {
+    u32 a = operand_value(nds, bp->cpu, &bp->lhs);
+    u32 b = operand_value(nds, bp->cpu, &bp->rhs);
+    switch (bp->op) {
+        case COND_EQ:
+            return a == b;
+        case COND_NE:
+            return a != b;
+        case COND_LT:
+            return a < b;
+        case COND_LE:
+            return a <= b;
+        case COND_GT:
+            return a > b;
+        case COND_GE:
+            return a >= b;
+        default:
+            return a & b;
+    }
+}
+
+// a breakpoint at the same address is replaced
+int bkpt_add(Breakpoints* b, int cpu, u32 addr, char* cond) {
+    Breakpoint bp = {.cpu = cpu, .addr = addr & ~1};
+    if (cond) {
+        if (strlen(cond) >= BKPT_COND_LEN || !parse_cond(&bp, cond)) return -1;
+        bp.has_cond = true;
+        strcpy(bp.cond, cond);
+    }
+    int i;
+    for (i = 0; i < b->n; i++) {
+        if (b->bp[i].cpu == cpu && b->bp[i].addr == bp.addr) break;
+    }
+    if (i == BKPT_MAX) return -1;
+    if (i == b->n) b->n++;
+    b->bp[i] = bp;
+    rebuild(b);
+    return i;
+}
+
+void bkpt_remove(Breakpoints* b, int i) {
+    if (i < 0 || i >= b->n) return;
+    memmove(&b->bp[i], &b->bp[i + 1], (b->n - i - 1) * sizeof *b->bp);
+    b->n--;
+    rebuild(b);
+}
+
+void bkpt_clear(Breakpoints* b) {
+    b->n = 0;
+    b->hit = false;
+    rebuild(b);
+}
+
+bool bkpt_check(NDS* nds, int cpu, u32 addr) {
+    Breakpoints* b = nds->bkpt;
+    int i = lookup(b, cpu, addr);
+    if (i < 0) return false;
+    Breakpoint* bp = &b->bp[i];
+    if (bp->has_cond && !eval_cond(nds, bp)) return false;
+    if (++bp->hits <= bp->ignore) return false;
+    b->hit = true;
+    b->hit_bp = i;
+    nds->debug_stop = true;
+    return true;
+}
+
+bool bkpt_stop(NDS* nds) {
+    nds->bkpt->stop = false;
+    nds->debug_stop = true;
+    return true;
+}
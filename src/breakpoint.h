@@ -0,0 +1,88 @@
+#ifndef BREAKPOINT_H
+#define BREAKPOINT_H
+
+#include "types.h"
+
+#define BKPT_MAX 256
+#define BKPT_HASH_BITS 10
+#define BKPT_COND_LEN 64
+
+enum { OPND_REG, OPND_CPSR, OPND_IMM, OPND_MEM8, OPND_MEM16, OPND_MEM32 };
+enum { COND_EQ, COND_NE, COND_LT, COND_LE, COND_GT, COND_GE, COND_AND };
+
+// a register, cpsr or number, or memory at a register or number plus offset
+typedef struct {
+    u8 type;
+    bool reg;
+    u8 r;
+    u32 val;
+} BkptOperand;
+
+typedef struct {
+    int cpu;
+    u32 addr;
+
+    bool has_cond;
+    BkptOperand lhs;
+    BkptOperand rhs;
+    u8 op;
+    char cond[BKPT_COND_LEN];
+
+    // hits counts every time the condition was true, it only stops once the
+    // first ignore hits are skipped
+    u32 hits;
+    u32 ignore;
+} Breakpoint;
+
+// code pages with breakpoints are marked in a bitmap per cpu like the
+// watchpoints, instructions in those pages are looked up in a hash table of
+// indices into bp. nds_run checks before each instruction and returns
+// without executing it when one is hit
+typedef struct {
+    Breakpoint bp[BKPT_MAX];
+    int n;
+
+    u64 pages[2][1 << 14];
+    s16 table[2][1 << BKPT_HASH_BITS];
+
+    bool hit;
+    int hit_bp;
+
+    // nds_run also stops before the stop_cpu executes an instruction once it
+    // has executed stop_steps, this is how reverse execution replays to a
+    // position
+    bool stop;
+    int stop_cpu;
+    u64 stop_steps;
+} Breakpoints;
+
+typedef struct _NDS NDS;
+
+#define BKPT_PAGE(b, cpu, addr)                                                \
+    ((b)->pages[cpu][(addr) >> 18] >> ((addr) >> 12 & 63) & 1)
+
+#define BKPT(nds, cpu, addr)                                                   \
+    ((nds)->bkpt && BKPT_PAGE((nds)->bkpt, cpu, addr) &&                       \
+     bkpt_check(nds, cpu, addr))
+
+#define BKPT_STEPS(nds, cpu)                                                   \
+    ((nds)->bkpt && (nds)->bkpt->stop && (nds)->bkpt->stop_cpu == cpu &&       \
+     (nds)->steps[cpu] == (nds)->bkpt->stop_steps && bkpt_stop(nds))
+
+// returns the index or -1, cond may be NULL
+int bkpt_add(Breakpoints* b, int cpu, u32 addr, char* cond);
+void bkpt_remove(Breakpoints* b, int i);
+void bkpt_clear(Breakpoints* b);
+
+// reads without side effects on the emulated state, cpu timing or the
+// watchpoints, io registers are peeked. type is one of OPND_MEM8, OPND_MEM16
+// or OPND_MEM32
+u32 bkpt_read(NDS* nds, int cpu, u32 addr, u8 type);
+// writes without side effects on the cpu timing or the watchpoints, io
+// writes still take effect
+void bkpt_write(NDS* nds, int cpu, u32 addr, u32 data, u8 type);
+
+bool bkpt_check(NDS* nds, int cpu, u32 addr);
+bool bkpt_stop(NDS* nds);
+
+#endif
@@ -0,0 +1,182 @@
+#include "capture.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nds.h"
+#include "pacer.h"
+
+#define VIDEO_W NDS_SCREEN_W
+#define VIDEO_H (2 * NDS_SCREEN_H)
+
+static void put16(FILE* fp, u16 v) {
+    fwrite(&v, 2, 1, fp);
+}
+
+static void put32(FILE* fp, u32 v) {
+    fwrite(&v, 4, 1, fp);
+}
+
+// 32 bit float stereo, the sizes are patched in on close
+static void write_wav_header(FILE* fp, u32 data_len) {
+    fwrite("RIFF", 1, 4, fp);
+    put32(fp, 36 + data_len);
+    fwrite("WAVEfmt ", 1, 8, fp);
+    put32(fp, 16);
+    put16(fp, 3);
+    put16(fp, 2);
+    put32(fp, SAMPLE_FREQ);
+    put32(fp, SAMPLE_FREQ * 2 * sizeof(float));
+    put16(fp, 2 * sizeof(float));
+    put16(fp, 8 * sizeof(float));
+    fwrite("data", 1, 4, fp);
+    put32(fp, data_len);
+}
+
+static u8 clamp_u8(double v) {
+    v = round(v);
+    return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+// full range bt.601, the 5 bit channels are far enough apart that the
+// rounding never maps two colors to the same triple
+static void init_yuv_table(Capture* c) {
+    for (int i = 0; i < 1 << 15; i++) {
+        int r5 = i & 0x1f, g5 = (i >> 5) & 0x1f, b5 = (i >> 10) & 0x1f;
+        double r = r5 << 3 | r5 >> 2;
+        double g = g5 << 3 | g5 >> 2;
+        double b = b5 << 3 | b5 >> 2;
+        c->yuv[i][0] = clamp_u8(0.299 * r + 0.587 * g + 0.114 * b);
+        c->yuv[i][1] =
+            clamp_u8(128 - 0.168736 * r - 0.331264 * g + 0.5 * b);
+        c->yuv[i][2] =
+            clamp_u8(128 + 0.5 * r - 0.418688 * g - 0.081312 * b);
+    }
+}
+
+static void write_frame(Capture* c, CaptureFrame* f) {
+    u16* px = &f->screens[0][0];
+    for (int i = 0; i < VIDEO_W * VIDEO_H; i++) {
+        u8* yuv = c->yuv[px[i] & 0x7fff];
+        c->planes[0][i] = yuv[0];
+        c->planes[1][i] = yuv[1];
+        c->planes[2][i] = yuv[2];
+    }
+    fwrite("FRAME\n", 1, 6, c->video);
+    fwrite(c->planes, 1, sizeof c->planes, c->video);
+
+    fwrite(f->audio, sizeof(float), f->audio_len, c->audio);
+    c->audio_bytes += f->audio_len * sizeof(float);
+}
+
+static void* writer_thread(void* arg) {
+    Capture* c = arg;
+    pthread_mutex_lock(&c->lock);
+    while (true) {
+        while (!c->count && !c->quit) pthread_cond_wait(&c->filled, &c->lock);
+        if (!c->count) break;
+        CaptureFrame* f = &c->slots[c->head];
+        pthread_mutex_unlock(&c->lock);
+
+        write_frame(c, f);
+
+        pthread_mutex_lock(&c->lock);
+        c->head = (c->head + 1) % CAPTURE_QUEUE;
+        c->count--;
+        pthread_cond_signal(&c->emptied);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+Capture* capture_open(char* prefix) {
+    char* path = malloc(strlen(prefix) + 5);
+    sprintf(path, "%s.y4m", prefix);
+    FILE* video = fopen(path, "wb");
+    sprintf(path, "%s.wav", prefix);
+    FILE* audio = fopen(path, "wb");
+    free(path);
+    if (!video || !audio) {
+        if (video) fclose(video);
+        if (audio) fclose(audio);
+        return NULL;
+    }
+
+    Capture* c = calloc(1, sizeof *c);
+    c->video = video;
+    c->audio = audio;
+    c->slots = malloc(CAPTURE_QUEUE * sizeof *c->slots);
+    init_yuv_table(c);
+
+    fprintf(video, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444 XCOLORRANGE=FULL\n",
+            VIDEO_W, VIDEO_H, NDS_CLOCK, FRAME_CYCLES);
+    write_wav_header(audio, 0);
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->filled, NULL);
+    pthread_cond_init(&c->emptied, NULL);
+    pthread_create(&c->thread, NULL, writer_thread, c);
+    return c;
+}
+
+void capture_close(Capture* c) {
+    if (!c) return;
+    pthread_mutex_lock(&c->lock);
+    c->quit = true;
+    pthread_cond_signal(&c->filled);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+
+    rewind(c->audio);
+    write_wav_header(c->audio, c->audio_bytes);
+    fclose(c->audio);
+    fclose(c->video);
+
+    if (c->stalls)
+        eprintf("Capture: %llu frames, waited for the writer %llu times\n",
+                (unsigned long long) c->frames,
+                (unsigned long long) c->stalls);
+
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->filled);
+    pthread_cond_destroy(&c->emptied);
+    free(c->slots);
+    free(c);
+}
+
+// the slot at the tail is not visible to the writer until it is published
+static CaptureFrame* get_slot(Capture* c) {
+    if (c->cur) return c->cur;
+    pthread_mutex_lock(&c->lock);
+    if (c->count == CAPTURE_QUEUE) {
+        c->stalls++;
+        while (c->count == CAPTURE_QUEUE)
+            pthread_cond_wait(&c->emptied, &c->lock);
+    }
+    c->cur = &c->slots[c->tail];
+    pthread_mutex_unlock(&c->lock);
+    c->cur->audio_len = 0;
+    return c->cur;
+}
+
+void capture_audio(Capture* c, float* samples, int len) {
+    CaptureFrame* f = get_slot(c);
+    if (f->audio_len + len > CAPTURE_AUDIO_LEN) return;
+    memcpy(&f->audio[f->audio_len], samples, len * sizeof *samples);
+    f->audio_len += len;
+}
+
+void capture_frame(Capture* c, u16* top, u16* bottom) {
+    CaptureFrame* f = get_slot(c);
+    memcpy(f->screens[0], top, NDS_SCREEN_H * NDS_SCREEN_W * 2);
+    memcpy(f->screens[NDS_SCREEN_H], bottom, NDS_SCREEN_H * NDS_SCREEN_W * 2);
+
+    pthread_mutex_lock(&c->lock);
+    c->tail = (c->tail + 1) % CAPTURE_QUEUE;
+    c->count++;
+    pthread_cond_signal(&c->filled);
+    pthread_mutex_unlock(&c->lock);
+    c->cur = NULL;
+    c->frames++;
+}
@@ -0,0 +1,56 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "ppu.h"
+#include "spu.h"
+#include "types.h"
+
+#define CAPTURE_QUEUE 64
+// a frame produces one or two sample buffers
+#define CAPTURE_AUDIO_LEN (4 * SAMPLE_BUF_LEN)
+
+typedef struct {
+    u16 screens[2 * NDS_SCREEN_H][NDS_SCREEN_W];
+    float audio[CAPTURE_AUDIO_LEN];
+    int audio_len;
+} CaptureFrame;
+
+// every frame is written to <prefix>.y4m with both screens stacked and the
+// samples to <prefix>.wav. the emulation thread copies each frame and its
+// samples into a queue slot and a writer thread does the conversion and the
+// disk writes, it only waits for the writer if the queue is full. the video
+// is full range 4:4:4 and each 15 bit color maps to a distinct yuv triple so
+// the original frames can be recovered exactly, the samples are stored as is
+typedef struct {
+    FILE* video;
+    FILE* audio;
+    u64 audio_bytes;
+
+    CaptureFrame* slots;
+    CaptureFrame* cur;
+    int head;
+    int tail;
+    int count;
+    bool quit;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t emptied;
+    pthread_t thread;
+
+    u64 frames;
+    u64 stalls;
+
+    u8 yuv[1 << 15][3];
+    u8 planes[3][2 * NDS_SCREEN_H * NDS_SCREEN_W];
+} Capture;
+
+Capture* capture_open(char* prefix);
+void capture_close(Capture* c);
+
+void capture_audio(Capture* c, float* samples, int len);
+void capture_frame(Capture* c, u16* top, u16* bottom);
+
+#endif
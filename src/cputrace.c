@@ -0,0 +1,194 @@
+#include "cputrace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nds.h"
+
+#define CACHE_MASK ((1 << CPUTRACE_CACHE_BITS) - 1)
+
+static void put32(FILE* fp, u32 v) {
+    fwrite(&v, 4, 1, fp);
+}
+
+static void write_chunk(CpuTrace* t, CpuTraceChunk* c) {
+    u32 len = lz_compress(c->data, c->len, t->comp, t->lz_table);
+    u8* data = t->comp;
+    if (len >= c->len) {
+        len = c->len;
+        data = c->data;
+    }
+    put32(t->fp, c->len);
+    put32(t->fp, len);
+    fwrite(data, 1, len, t->fp);
+    t->raw_bytes += c->len;
+    t->file_bytes += 8 + len;
+}
+
+static void* writer_thread(void* arg) {
+    CpuTrace* t = arg;
+    pthread_mutex_lock(&t->lock);
+    while (true) {
+        while (!t->count && !t->quit) pthread_cond_wait(&t->filled, &t->lock);
+        if (!t->count) break;
+        CpuTraceChunk* c = &t->slots[t->head];
+        pthread_mutex_unlock(&t->lock);
+
+        write_chunk(t, c);
+
+        pthread_mutex_lock(&t->lock);
+        t->head = (t->head + 1) % CPUTRACE_QUEUE;
+        t->count--;
+        pthread_cond_signal(&t->emptied);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+CpuTrace* cputrace_open(char* filename, int cpu, u32 start, u32 last,
+                        int flags) {
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) return NULL;
+
+    CpuTrace* t = calloc(1, sizeof *t);
+    t->fp = fp;
+    t->cpu = cpu;
+    t->start = start;
+    t->last = last;
+    t->regs = flags & CPUTRACE_REGS;
+    t->slots = malloc(CPUTRACE_QUEUE * sizeof *t->slots);
+    t->comp = malloc(LZ_BOUND(CPUTRACE_CHUNK));
+
+    put32(fp, CPUTRACE_MAGIC);
+    put32(fp, CPUTRACE_VERSION);
+    put32(fp, cpu);
+    put32(fp, start);
+    put32(fp, last);
+    put32(fp, flags);
+
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->filled, NULL);
+    pthread_cond_init(&t->emptied, NULL);
+    pthread_create(&t->thread, NULL, writer_thread, t);
+    return t;
+}
+
+static void publish(CpuTrace* t) {
+    pthread_mutex_lock(&t->lock);
+    t->tail = (t->tail + 1) % CPUTRACE_QUEUE;
+    t->count++;
+    pthread_cond_signal(&t->filled);
+    pthread_mutex_unlock(&t->lock);
+    t->cur = NULL;
+}
+
+void cputrace_close(CpuTrace* t) {
+    if (!t) return;
+    if (t->cur && t->cur->len) publish(t);
+    pthread_mutex_lock(&t->lock);
+    t->quit = true;
+    pthread_cond_signal(&t->filled);
+    pthread_mutex_unlock(&t->lock);
+    pthread_join(t->thread, NULL);
+    fclose(t->fp);
+
+    if (t->stalls)
+        eprintf("Trace: %llu instructions, waited for the writer %llu times\n",
+                (unsigned long long) t->instrs,
+                (unsigned long long) t->stalls);
+
+    pthread_mutex_destroy(&t->lock);
+    pthread_cond_destroy(&t->filled);
+    pthread_cond_destroy(&t->emptied);
+    free(t->slots);
+    free(t->comp);
+    free(t);
+}
+
+// the chunk at the tail is not visible to the writer until it is published
+static CpuTraceChunk* get_chunk(CpuTrace* t) {
+    pthread_mutex_lock(&t->lock);
+    if (t->count == CPUTRACE_QUEUE) {
+        t->stalls++;
+        while (t->count == CPUTRACE_QUEUE)
+            pthread_cond_wait(&t->emptied, &t->lock);
+    }
+    t->cur = &t->slots[t->tail];
+    pthread_mutex_unlock(&t->lock);
+    t->cur->len = 0;
+    return t->cur;
+}
+
+static inline u8* put_varint(u8* p, u32 v) {
+    while (v >= 0x80) {
+        *p++ = v | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static inline u32 zigzag(u32 d) {
+    return d << 1 ^ (u32) ((s32) d >> 31);
+}
+
+static inline void record(CpuTrace* t, ArmCore* cpu) {
+    u32 addr = cpu->cur_instr_addr;
+    if (addr - t->start > t->last - t->start) return;
+
+    CpuTraceChunk* c = t->cur ? t->cur : get_chunk(t);
+    u8* p = &c->data[c->len];
+    u8* tag = p++;
+    bool thumb = cpu->cpsr.t;
+    *tag = thumb ? CPUTRACE_THUMB : 0;
+    if (addr != t->next_pc) {
+        *tag |= CPUTRACE_PC;
+        p = put_varint(p, zigzag(addr - t->next_pc));
+    }
+    t->next_pc = addr + (thumb ? 2 : 4);
+
+    u32 instr = cpu->cur_instr.w;
+    u32* slot = &t->cache[addr >> 1 & CACHE_MASK];
+    if (*slot != instr) {
+        *tag |= CPUTRACE_INSTR;
+        *slot = instr;
+        memcpy(p, &instr, 4);
+        p += 4;
+    }
+
+    if (t->regs) {
+        u32 regs[16];
+        memcpy(regs, cpu->r, 15 * 4);
+        regs[15] = cpu->cpsr.w;
+        u32 mask = 0;
+        for (int i = 0; i < 16; i++) mask |= (regs[i] != t->prev_regs[i]) << i;
+        if (mask) {
+            *tag |= CPUTRACE_REGS_CHANGED;
+            *p++ = mask;
+            *p++ = mask >> 8;
+            for (u32 m = mask; m; m &= m - 1) {
+                int i = __builtin_ctz(m);
+                p = put_varint(p, zigzag(regs[i] - t->prev_regs[i]));
+                t->prev_regs[i] = regs[i];
+            }
+        }
+    }
+
+    c->len = p - c->data;
+    t->instrs++;
+    if (c->len > CPUTRACE_CHUNK - CPUTRACE_MAX_RECORD) publish(t);
+}
+
+static void exec_hook7(ArmCore* cpu) {
+    record(((Arm7TDMI*) cpu)->master->cputrace, cpu);
+}
+
+static void exec_hook9(ArmCore* cpu) {
+    record(((Arm946E*) cpu)->master->cputrace, cpu);
+}
+
+void cputrace_attach(CpuTrace* t, NDS* nds) {
+    nds->cputrace = t;
+    if (t->cpu == CPU9) nds->cpu9.c.exec_hook = exec_hook9;
+    else nds->cpu7.c.exec_hook = exec_hook7;
+}
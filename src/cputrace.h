@@ -0,0 +1,89 @@
+#ifndef CPUTRACE_H
+#define CPUTRACE_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "lz.h"
+#include "types.h"
+
+#define CPUTRACE_MAGIC 0x54435452
+#define CPUTRACE_VERSION 1
+
+#define CPUTRACE_CHUNK (1 << 20)
+#define CPUTRACE_QUEUE 16
+// a tag, pc, instruction, register mask and 16 registers
+#define CPUTRACE_MAX_RECORD (1 + 5 + 4 + 2 + 16 * 5)
+#define CPUTRACE_CACHE_BITS 12
+
+#define CPUTRACE_REGS 1
+
+// each record has a tag byte with these flags:
+// - THUMB: the cpu was in thumb state
+// - PC: the address is not the one after the previous record, a zigzag
+//   leb128 varint of the difference follows
+// - INSTR: the instruction isn't the last one seen in its slot of a cache
+//   indexed by the address bits above bit 0, the 32 bit decoded instruction
+//   follows. for thumb it is the entry of thumb_lookup
+// - REGS: registers changed since the previous record, a 16 bit mask with r0
+//   to r14 and cpsr in bit 15 follows, then a zigzag varint of the change of
+//   each. registers are the values before the instruction executes
+enum {
+    CPUTRACE_THUMB = 1,
+    CPUTRACE_PC = 2,
+    CPUTRACE_INSTR = 4,
+    CPUTRACE_REGS_CHANGED = 8
+};
+
+typedef struct {
+    u8 data[CPUTRACE_CHUNK];
+    u32 len;
+} CpuTraceChunk;
+
+// records every executed instruction of one cpu inside an address window.
+// the file starts with the magic, version, cpu, first and last address of
+// the window and flags as u32, followed by blocks each with the raw and
+// compressed length as u32 and the data compressed with lz_compress, or
+// stored as is if both lengths are equal. the records form a single stream,
+// none are split between blocks. the emulation thread only encodes records
+// into chunks and a writer thread compresses and writes them
+typedef struct {
+    FILE* fp;
+    int cpu;
+    u32 start;
+    u32 last;
+    bool regs;
+
+    u32 next_pc;
+    u32 cache[1 << CPUTRACE_CACHE_BITS];
+    u32 prev_regs[16];
+
+    CpuTraceChunk* slots;
+    CpuTraceChunk* cur;
+    int head;
+    int tail;
+    int count;
+    bool quit;
+    pthread_mutex_t lock;
+    pthread_cond_t filled;
+    pthread_cond_t emptied;
+    pthread_t thread;
+
+    u64 instrs;
+    u64 raw_bytes;
+    u64 file_bytes;
+    u64 stalls;
+
+    u8* comp;
+    u32 lz_table[1 << LZ_HASH_BITS];
+} CpuTrace;
+
+typedef struct _NDS NDS;
+
+CpuTrace* cputrace_open(char* filename, int cpu, u32 start, u32 last,
+                        int flags);
+void cputrace_close(CpuTrace* t);
+
+void cputrace_attach(CpuTrace* t, NDS* nds);
+
+#endif
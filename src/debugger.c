@@ -20,12 +20,26 @@ const char* help = "Debugger commands:\n"
                    "a -- advance single frame\n"
                    "n -- next instruction\n"
                    "f -- fast forward to next event and switch CPU\n"
-                   "b [addr] -- set or check breakpoint\n"
+                   "b[7/9] <addr> [if <cond>] -- set a breakpoint on a cpu\n"
+                   "b -- list breakpoints\n"
+                   "bd [n] -- delete breakpoint n or all\n"
+                   "bi <n> <count> -- ignore the next count hits of n\n"
+                   "W<r/w/a>[7/9] <addr> [len] -- watch reads, writes or "
+                   "both on a cpu's bus\n"
+                   "W -- list watchpoints\n"
+                   "Wd [n] -- delete watchpoint n or all\n"
                    "i -- cpu state info\n"
                    "e -- scheduler events info\n"
                    "r<b/h/w> <addr> -- read from memory\n"
                    "w<b/h/w> <addr> <data> -- write to memory\n"
                    "l -- show code\n"
+                   "rs -- step back one instruction\n"
+                   "rc -- run back to the previous breakpoint or watchpoint "
+                   "hit\n"
+                   "ri [instrs] [mb] -- show the history, or set the "
+                   "instructions between checkpoints and their memory\n"
+                   "p [n] -- show the top n entries of the profile\n"
+                   "o [commit/discard] -- show or apply the -o write overlay\n"
                    "r -- reset\n"
                    "q -- quit debugger\n"
                    "h -- help\n";
@@ -39,6 +53,206 @@ int read_num(char* str, u32* res) {
     return 0;
 }
 
+void print_bkpt_hit(Breakpoints* b) {
+    Breakpoint* bp = &b->bp[b->hit_bp];
+    printf("Breakpoint %d hit: CPU%d %08x (%u hits)\n", b->hit_bp,
+           bp->cpu == CPU9 ? 9 : 7, bp->addr, bp->hits);
+}
+
+// conditions compare two of registers, cpsr, numbers and memory, e.g.
+// "b 0x2001234 if r0 == 3" or "b7 0x37f8000 if [sp+4] & 0x80"
+void bkpt_command(char* com) {
+    Breakpoints* b = &ntremu.bkpt;
+    if (com[1] == 'd') {
+        u32 i;
+        if (read_num(strtok(NULL, " "), &i) < 0) {
+            bkpt_clear(b);
+            printf("Breakpoints deleted\n");
+        } else if (i < b->n) {
+            bkpt_remove(b, i);
+            printf("Breakpoint %d deleted\n", i);
+        } else {
+            printf("Invalid breakpoint\n");
+        }
+        return;
+    }
+    if (com[1] == 'i') {
+        u32 i, count;
+        if (read_num(strtok(NULL, " "), &i) < 0 || i >= b->n ||
+            read_num(strtok(NULL, " "), &count) < 0) {
+            printf("Invalid breakpoint\n");
+            return;
+        }
+        b->bp[i].ignore = b->bp[i].hits + count;
+        printf("Breakpoint %d will ignore the next %d hits\n", i, count);
+        return;
+    }
+
+    u32 addr;
+    if (read_num(strtok(NULL, " "), &addr) < 0) {
+        for (int i = 0; i < b->n; i++) {
+            Breakpoint* bp = &b->bp[i];
+            printf("%d: CPU%d %08x", i, bp->cpu == CPU9 ? 9 : 7, bp->addr);
+            if (bp->has_cond) printf(" if %s", bp->cond);
+            printf(" (%u hits", bp->hits);
+            if (bp->ignore > bp->hits)
+                printf(", ignoring %u", bp->ignore - bp->hits);
+            printf(")\n");
+        }
+        if (!b->n) printf("No breakpoints\n");
+        return;
+    }
+    int cpu = ntremu.nds->cur_cpu_type;
+    if (com[1] == '7') cpu = CPU7;
+    else if (com[1] == '9') cpu = CPU9;
+    char* cond = strtok(NULL, "");
+    if (cond) {
+        while (*cond == ' ') cond++;
+        if (strncmp(cond, "if ", 3)) {
+            printf("Invalid breakpoint\n");
+            return;
+        }
+        cond += 3;
+    }
+    int i = bkpt_add(b, cpu, addr, cond);
+    if (i < 0) {
+        printf("Invalid breakpoint\n");
+        return;
+    }
+    printf("Breakpoint %d set: CPU%d %08x", i, cpu == CPU9 ? 9 : 7,
+           b->bp[i].addr);
+    if (cond) printf(" if %s", cond);
+    printf("\n");
+}
+
+static const char* watch_kinds[] = {"", "read", "write", "access"};
+
+void print_watch_hit(Watchpoints* w) {
+    printf("Watchpoint %d hit: CPU%d %s of %d bytes at %08x", w->hit_wp,
+           w->hit_cpu == CPU9 ? 9 : 7, watch_kinds[w->hit_kind], w->hit_size,
+           w->hit_addr);
+    if (w->hit_kind == WATCH_WRITE) printf(" = 0x%x", w->hit_data);
+    printf(" by %08x\n", w->hit_pc);
+}
+
+void watch_command(char* com) {
+    Watchpoints* w = &ntremu.watch;
+    if (!com[1]) {
+        for (int i = 0; i < w->n; i++) {
+            printf("%d: CPU%d %s %08x-%08x\n", i,
+                   w->wp[i].cpu == CPU9 ? 9 : 7, watch_kinds[w->wp[i].kind],
+                   w->wp[i].start, w->wp[i].last);
+        }
+        if (!w->n) printf("No watchpoints\n");
+        return;
+    }
+    if (com[1] == 'd') {
+        u32 i;
+        if (read_num(strtok(NULL, " "), &i) < 0) {
+            watch_clear(w);
+            printf("Watchpoints deleted\n");
+        } else if (i < w->n) {
+            watch_remove(w, i);
+            printf("Watchpoint %d deleted\n", i);
+        } else {
+            printf("Invalid watchpoint\n");
+        }
+        return;
+    }
+
+    WatchKind kind;
+    switch (com[1]) {
+        case 'r':
+            kind = WATCH_READ;
+            break;
+        case 'w':
+            kind = WATCH_WRITE;
+            break;
+        case 'a':
+            kind = WATCH_ACCESS;
+            break;
+        default:
+            printf("Invalid watch command.\n");
+            return;
+    }
+    int cpu = ntremu.nds->cur_cpu_type;
+    if (com[2] == '7') cpu = CPU7;
+    else if (com[2] == '9') cpu = CPU9;
+    u32 addr, len;
+    if (read_num(strtok(NULL, " "), &addr) < 0) {
+        printf("Invalid address\n");
+        return;
+    }
+    if (read_num(strtok(NULL, " "), &len) < 0) len = 1;
+    if (watch_add(w, cpu, addr, len, kind)) {
+        printf("Watchpoint %d set: CPU%d %s %08x-%08x\n", w->n - 1,
+               cpu == CPU9 ? 9 : 7, watch_kinds[kind], addr, addr + len - 1);
+    } else {
+        printf("Invalid watchpoint\n");
+    }
+}
+
+// reads made by the debugger don't change the emulation so the history can
+// still be replayed
+u32 read_mem(u32 addr, u8 type) {
+    return bkpt_read(ntremu.nds, ntremu.nds->cur_cpu_type, addr, type);
+}
+
+// going back replays from the last checkpoint before the position
+void rewind_command(char* com) {
+    Rewind* r = &ntremu.rewind;
+    NDS* nds = ntremu.nds;
+    switch (com[1]) {
+        case 's':
+            if (!rewind_step(r, nds)) {
+                printf("Not in the history\n");
+                return;
+            }
+            cpu_print_cur_instr(nds->cur_cpu);
+            break;
+        case 'c':
+            switch (rewind_continue(r, nds, &ntremu.bkpt, &ntremu.watch)) {
+                case REWIND_BKPT:
+                    print_bkpt_hit(&ntremu.bkpt);
+                    break;
+                case REWIND_WATCH:
+                    print_watch_hit(&ntremu.watch);
+                    break;
+                default:
+                    printf("No earlier hits, at the start of the history\n");
+                    break;
+            }
+            ntremu.bkpt.hit = false;
+            ntremu.watch.hit = false;
+            cpu_print_state(nds->cur_cpu);
+            cpu_print_cur_instr(nds->cur_cpu);
+            break;
+        default: {
+            u32 interval, mb;
+            if (read_num(strtok(NULL, " "), &interval) == 0) {
+                if (read_num(strtok(NULL, " "), &mb) < 0) mb = r->budget >> 20;
+                if (!interval || !mb) {
+                    printf("Invalid history limits\n");
+                    return;
+                }
+                rewind_set_limits(r, interval, (size_t) mb << 20);
+            }
+            Checkpoint* first = &r->cp[0];
+            printf("%d checkpoints in %.1f of %zu MB, one every %llu "
+                   "instructions\n",
+                   r->n, (double) r->bytes / (1 << 20), r->budget >> 20,
+                   (unsigned long long) r->interval);
+            printf("CPU9 from %llu to %llu instructions, CPU7 from %llu to "
+                   "%llu\n",
+                   (unsigned long long) first->steps[CPU9],
+                   (unsigned long long) nds->steps[CPU9],
+                   (unsigned long long) first->steps[CPU7],
+                   (unsigned long long) nds->steps[CPU7]);
+            break;
+        }
+    }
+}
+
 bool interrupted;
 void ctrlchandler() {
     interrupted = true;
@@ -74,6 +288,7 @@ void debugger_run() {
         switch (com[0]) {
             case 'q':
                 ntremu.debugger = false;
+                ntremu.nds->watch = NULL;
                 free(buf);
                 return;
             case 'c':
@@ -103,9 +318,14 @@ void debugger_run() {
                 sa.sa_flags = SA_RESTART;
                 sigaction(SIGINT, &sa, &old);
                 interrupted = false;
+                ntremu.watch.hit = false;
+                ntremu.nds->debug_stop = false;
                 while (ntremu.nds->cur_cpu->cur_instr_addr != next_instr_addr &&
-                       !interrupted)
+                       !interrupted && !ntremu.nds->debug_stop)
                     nds_step(ntremu.nds);
+                if (ntremu.watch.hit) print_watch_hit(&ntremu.watch);
+                ntremu.watch.hit = false;
+                ntremu.nds->debug_stop = false;
                 sigaction(SIGINT, &old, NULL);
                 cpu_print_cur_instr(ntremu.nds->cur_cpu);
                 break;
@@ -135,6 +355,10 @@ void debugger_run() {
                 }
                 break;
             case 'r': {
+                if (com[1] == 's' || com[1] == 'c' || com[1] == 'i') {
+                    rewind_command(com);
+                    break;
+                }
                 if (com[1] == 'e' || com[1] == '\0') {
                     printf("Reset emulation? ");
                     char ans = getchar();
@@ -155,20 +379,17 @@ void debugger_run() {
                     case 'b':
                     case '8':
                         printf("[%08x] = 0x%02x\n", addr,
-                               ntremu.nds->cur_cpu->read8(ntremu.nds->cur_cpu,
-                                                          addr, false));
+                               read_mem(addr, OPND_MEM8));
                         break;
                     case 'h':
                     case '1':
                         printf("[%08x] = 0x%04x\n", addr,
-                               ntremu.nds->cur_cpu->read16(ntremu.nds->cur_cpu,
-                                                           addr, false));
+                               read_mem(addr, OPND_MEM16));
                         break;
                     case 'w':
                     case '3':
                         printf("[%08x] = 0x%08x\n", addr,
-                               ntremu.nds->cur_cpu->read32(ntremu.nds->cur_cpu,
-                                                           addr));
+                               read_mem(addr, OPND_MEM32));
                         break;
                     case 'm': {
                         u32 n;
@@ -177,8 +398,7 @@ void debugger_run() {
                         for (int i = 0; i < n; i++) {
                             if (i > 0 && !(i & 7)) printf("             ");
                             printf("0x%08x ",
-                                   ntremu.nds->cur_cpu->read32(
-                                       ntremu.nds->cur_cpu, addr + (i << 2)));
+                                   read_mem(addr + (i << 2), OPND_MEM32));
                             if ((i & 7) == 7) printf("\n");
                         }
                         if (n & 7) printf("\n");
@@ -207,40 +427,40 @@ void debugger_run() {
                         ntremu.nds->cur_cpu->write8(ntremu.nds->cur_cpu, addr,
                                                     data);
                         printf("[%08x] = 0x%02x\n", addr,
-                               ntremu.nds->cur_cpu->read8(ntremu.nds->cur_cpu,
-                                                          addr, false));
+                               read_mem(addr, OPND_MEM8));
                         break;
                     case 'h':
                     case '1':
                         ntremu.nds->cur_cpu->write16(ntremu.nds->cur_cpu, addr,
                                                      data);
                         printf("[%08x] = 0x%4x\n", addr,
-                               ntremu.nds->cur_cpu->read16(ntremu.nds->cur_cpu,
-                                                           addr, false));
+                               read_mem(addr, OPND_MEM16));
                         break;
                     case 'w':
                     case '3':
                         ntremu.nds->cur_cpu->write32(ntremu.nds->cur_cpu, addr,
                                                      data);
                         printf("[%08x] = 0x%08x\n", addr,
-                               ntremu.nds->cur_cpu->read32(ntremu.nds->cur_cpu,
-                                                           addr));
+                               read_mem(addr, OPND_MEM32));
                         break;
                     default:
                         printf("Invalid write command.\n");
-                        break;
+                        continue;
                 }
+                rewind_reset(&ntremu.rewind, ntremu.nds);
                 break;
             }
+            case 'W':
+                watch_command(com);
+                break;
             case 'e':
                 print_scheduled_events(&ntremu.nds->sched);
                 break;
             case 'b':
-                if (read_num(strtok(NULL, " "), &ntremu.breakpoint) < 0)
-                    printf("Current breakpoint: 0x%08x\n", ntremu.breakpoint);
-                else printf("Breakpoint set: 0x%08x\n", ntremu.breakpoint);
+                bkpt_command(com);
                 break;
             case 'a':
+                nds_step(ntremu.nds);
                 ntremu.running = true;
                 ntremu.frame_adv = true;
                 free(buf);
@@ -256,22 +476,51 @@ void debugger_run() {
                                    ((i - lines) << 1);
                         printf("%03x: ", addr & 0xfff);
                         thumb_disassemble(
-                            (ThumbInstr){ntremu.nds->cur_cpu->fetch16(
-                                ntremu.nds->cur_cpu, addr)},
-                            addr, stdout);
+                            (ThumbInstr){read_mem(addr, OPND_MEM16)}, addr,
+                            stdout);
                         printf("\n");
                     } else {
                         u32 addr = ntremu.nds->cur_cpu->cur_instr_addr +
                                    ((i - lines) << 2);
                         printf("%03x: ", addr & 0xfff);
-                        arm_disassemble((ArmInstr){ntremu.nds->cur_cpu->fetch32(
-                                            ntremu.nds->cur_cpu, addr)},
-                                        addr, stdout);
+                        arm_disassemble(
+                            (ArmInstr){read_mem(addr, OPND_MEM32)}, addr,
+                            stdout);
                         printf("\n");
                     }
                 }
                 break;
             }
+            case 'p': {
+                u32 top;
+                if (!ntremu.prof) {
+                    printf("Profiler is not enabled, run with -P.\n");
+                    break;
+                }
+                if (read_num(strtok(NULL, " "), &top) < 0) top = 10;
+                profiler_report(ntremu.prof, stdout, top);
+                break;
+            }
+            case 'o': {
+                if (!ntremu.overlay) {
+                    printf("Overlay is not enabled, run with -o.\n");
+                    break;
+                }
+                char* arg = strtok(NULL, " ");
+                if (!arg) {
+                    printf("%u sd card sectors written\n",
+                           ntremu.sd_overlay.size);
+                } else if (!strcmp(arg, "commit")) {
+                    if (emulator_commit()) printf("Overlay committed\n");
+                    else printf("Could not commit overlay\n");
+                } else if (!strcmp(arg, "discard")) {
+                    emulator_discard();
+                    printf("Overlay discarded\n");
+                } else {
+                    printf("Invalid overlay command.\n");
+                }
+                break;
+            }
             case 't':
                 printf("ITCM: base=%08x, size=%08x\n", 0,
                        ntremu.nds->cpu9.itcm_virtsize);
@@ -1,6 +1,12 @@
 #ifndef DEBUGGER_H
 #define DEBUGGER_H
 
+#include "breakpoint.h"
+#include "watch.h"
+
 void debugger_run();
 
+void print_bkpt_hit(Breakpoints* b);
+void print_watch_hit(Watchpoints* w);
+
 #endif
\ No newline at end of file
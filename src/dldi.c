@@ -1,10 +1,12 @@
 #include "dldi.h"
 
 #include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-#include "emulator_state.h"
+#include "nds.h"
 
 const u8 driver[] = {
     0xed, 0xa5, 0x8d, 0xbf, 0x20, 0x43, 0x68, 0x69, 0x73, 0x68, 0x6d, 0x00,
@@ -12,42 +14,111 @@ const u8 driver[] = {
     0x72, 0x69, 0x76, 0x65, 0x72, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa0, 0xe1,
     0x00, 0x00, 0xa0, 0xe1, 0x00, 0x00, 0xa0, 0xe1, 0x00, 0x00, 0xa0, 0xe1,
     0x00, 0x00, 0xa0, 0xe1, 0x00, 0x00, 0xa0, 0xe1, 0x00, 0x00, 0xa0, 0xe1,
-    0x00, 0x00, 0xa0, 0xe1, 0x00, 0x00, 0x80, 0xbf, 0x7c, 0x01, 0x80, 0xbf,
-    0x80, 0x00, 0x80, 0xbf, 0x80, 0x00, 0x80, 0xbf, 0x7c, 0x01, 0x80, 0xbf,
-    0x7c, 0x01, 0x80, 0xbf, 0x7c, 0x01, 0x80, 0xbf, 0x7c, 0x01, 0x80, 0xbf,
+    0x00, 0x00, 0xa0, 0xe1, 0x00, 0x00, 0x80, 0xbf, 0xec, 0x00, 0x80, 0xbf,
+    0x80, 0x00, 0x80, 0xbf, 0x80, 0x00, 0x80, 0xbf, 0xec, 0x00, 0x80, 0xbf,
+    0xec, 0x00, 0x80, 0xbf, 0xec, 0x00, 0x80, 0xbf, 0xec, 0x00, 0x80, 0xbf,
     0x58, 0x58, 0x58, 0x58, 0x23, 0x00, 0x00, 0x00, 0x80, 0x00, 0x80, 0xbf,
-    0x88, 0x00, 0x80, 0xbf, 0xa4, 0x00, 0x80, 0xbf, 0x0c, 0x01, 0x80, 0xbf,
-    0x9c, 0x00, 0x80, 0xbf, 0x74, 0x01, 0x80, 0xbf, 0x01, 0x00, 0xa0, 0xe3,
+    0x88, 0x00, 0x80, 0xbf, 0xa4, 0x00, 0x80, 0xbf, 0xc4, 0x00, 0x80, 0xbf,
+    0x9c, 0x00, 0x80, 0xbf, 0xe4, 0x00, 0x80, 0xbf, 0x01, 0x00, 0xa0, 0xe3,
     0x1e, 0xff, 0x2f, 0xe1, 0xfb, 0x34, 0xe0, 0xe3, 0xbb, 0x0b, 0x13, 0xe5,
     0x00, 0x00, 0x50, 0xe2, 0x01, 0x00, 0xa0, 0x13, 0x1e, 0xff, 0x2f, 0xe1,
-    0x01, 0x00, 0xa0, 0xe3, 0x1e, 0xff, 0x2f, 0xe1, 0x04, 0xe0, 0x2d, 0xe5,
-    0x00, 0xe0, 0x51, 0xe2, 0x10, 0x00, 0x00, 0x0a, 0x00, 0xc0, 0xa0, 0xe1,
-    0xfb, 0x04, 0xe0, 0xe3, 0x02, 0x1c, 0x82, 0xe2, 0x0c, 0xe0, 0x8e, 0xe0,
-    0xbb, 0xcb, 0x00, 0xe5, 0xbb, 0x2b, 0x10, 0xe5, 0x00, 0x00, 0x52, 0xe3,
-    0x02, 0x3c, 0x41, 0xe2, 0x0a, 0x00, 0x00, 0x0a, 0xb7, 0x2b, 0x10, 0xe5,
-    0x04, 0x20, 0x83, 0xe4, 0x01, 0x00, 0x53, 0xe1, 0xfb, 0xff, 0xff, 0x1a,
-    0x01, 0xc0, 0x8c, 0xe2, 0x0c, 0x00, 0x5e, 0xe1, 0x02, 0x1c, 0x81, 0xe2,
-    0xf2, 0xff, 0xff, 0x1a, 0x01, 0x00, 0xa0, 0xe3, 0x04, 0xe0, 0x9d, 0xe4,
-    0x1e, 0xff, 0x2f, 0xe1, 0x02, 0x00, 0xa0, 0xe1, 0x04, 0xe0, 0x9d, 0xe4,
-    0x1e, 0xff, 0x2f, 0xe1, 0x04, 0xe0, 0x2d, 0xe5, 0x00, 0xe0, 0x51, 0xe2,
-    0x10, 0x00, 0x00, 0x0a, 0x00, 0xc0, 0xa0, 0xe1, 0xfb, 0x04, 0xe0, 0xe3,
-    0x02, 0x1c, 0x82, 0xe2, 0x0c, 0xe0, 0x8e, 0xe0, 0xbb, 0xcb, 0x00, 0xe5,
-    0xbb, 0x2b, 0x10, 0xe5, 0x00, 0x00, 0x52, 0xe3, 0x02, 0x3c, 0x41, 0xe2,
-    0x0a, 0x00, 0x00, 0x0a, 0x04, 0x20, 0x93, 0xe4, 0x01, 0x00, 0x53, 0xe1,
-    0xb7, 0x2b, 0x00, 0xe5, 0xfb, 0xff, 0xff, 0x1a, 0x01, 0xc0, 0x8c, 0xe2,
-    0x0c, 0x00, 0x5e, 0xe1, 0x02, 0x1c, 0x81, 0xe2, 0xf2, 0xff, 0xff, 0x1a,
-    0x01, 0x00, 0xa0, 0xe3, 0x04, 0xe0, 0x9d, 0xe4, 0x1e, 0xff, 0x2f, 0xe1,
-    0x02, 0x00, 0xa0, 0xe1, 0x04, 0xe0, 0x9d, 0xe4, 0x1e, 0xff, 0x2f, 0xe1,
+    0x01, 0x00, 0xa0, 0xe3, 0x1e, 0xff, 0x2f, 0xe1, 0xfb, 0x34, 0xe0, 0xe3,
+    0xbb, 0x0b, 0x03, 0xe5, 0xb3, 0x2b, 0x03, 0xe5, 0xaf, 0x1b, 0x03, 0xe5,
+    0x01, 0x00, 0xa0, 0xe3, 0xab, 0x0b, 0x03, 0xe5, 0xab, 0x0b, 0x13, 0xe5,
+    0x1e, 0xff, 0x2f, 0xe1, 0xfb, 0x34, 0xe0, 0xe3, 0xbb, 0x0b, 0x03, 0xe5,
+    0xb3, 0x2b, 0x03, 0xe5, 0xaf, 0x1b, 0x03, 0xe5, 0x02, 0x00, 0xa0, 0xe3,
+    0xab, 0x0b, 0x03, 0xe5, 0xab, 0x0b, 0x13, 0xe5, 0x1e, 0xff, 0x2f, 0xe1,
     0x01, 0x00, 0xa0, 0xe3, 0x1e, 0xff, 0x2f, 0xe1};
 
-struct {
-    u32 secnum;
-    u32 secbuf[SECTOR_SIZE >> 2];
-    int i;
-} dldi;
+static bool sd_present(DLDI* dldi) {
+    return dldi->sd_fd >= 0 || dldi->vfat;
+}
+
+static bool image_read(DLDI* dldi, u8* buf, u32 sector, u32 count) {
+    if (dldi->vfat) return vfat_read(dldi->vfat, sector, count, buf);
+    u64 len = (u64) count * SECTOR_SIZE;
+    u64 ofs = (u64) sector * SECTOR_SIZE;
+    while (len) {
+        ssize_t n = pread(dldi->sd_fd, buf, len, ofs);
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+        ofs += n;
+    }
+    return true;
+}
+
+static bool image_write(DLDI* dldi, const u8* buf, u32 sector, u32 count) {
+    if (dldi->vfat) return vfat_write(dldi->vfat, sector, count, buf);
+    u64 len = (u64) count * SECTOR_SIZE;
+    u64 ofs = (u64) sector * SECTOR_SIZE;
+    while (len) {
+        ssize_t n = pwrite(dldi->sd_fd, buf, len, ofs);
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+        ofs += n;
+    }
+    return true;
+}
+
+static bool sd_read(DLDI* dldi, u8* buf, u32 sector, u32 count) {
+    if (!dldi->overlay) return image_read(dldi, buf, sector, count);
+    bool ok = true;
+    while (count) {
+        u8* data = overlay_find(dldi->overlay, sector);
+        if (data) {
+            memcpy(buf, data, SECTOR_SIZE);
+            sector++;
+            count--;
+            buf += SECTOR_SIZE;
+            continue;
+        }
+        u32 run = 1;
+        while (run < count && !overlay_find(dldi->overlay, sector + run)) run++;
+        if (!image_read(dldi, buf, sector, run)) ok = false;
+        sector += run;
+        count -= run;
+        buf += run * SECTOR_SIZE;
+    }
+    return ok;
+}
 
-void dldi_patch_binary(u8* b, u32 len) {
-    if (ntremu.dldi_sd_fd < 0) return;
+static bool sd_write(DLDI* dldi, const u8* buf, u32 sector, u32 count) {
+    if (!dldi->overlay) return image_write(dldi, buf, sector, count);
+    for (u32 i = 0; i < count; i++) {
+        memcpy(overlay_get(dldi->overlay, sector + i), buf + i * SECTOR_SIZE,
+               SECTOR_SIZE);
+    }
+    return true;
+}
+
+void dldi_init(DLDI* dldi, int sd_fd, VFat* vfat) {
+    dldi->sd_fd = sd_fd;
+    dldi->vfat = vfat;
+    dldi->overlay = NULL;
+    dldi->sd_size = 0;
+    if (vfat) {
+        dldi->sd_size = (u64) vfat->total_sectors * SECTOR_SIZE;
+        return;
+    }
+    if (sd_fd < 0) return;
+    struct stat st;
+    fstat(sd_fd, &st);
+    if (S_ISBLK(st.st_mode)) {
+        dldi->sd_size = lseek(sd_fd, 0, SEEK_END);
+    } else {
+        dldi->sd_size = st.st_size;
+    }
+}
+
+void dldi_free(DLDI* dldi) {
+    free(dldi->ra_buf);
+    dldi->ra_buf = NULL;
+}
+
+void dldi_patch_binary(DLDI* dldi, u8* b, u32 len) {
+    if (!sd_present(dldi)) return;
 
     for (int i = 0; i < len; i += 0x40) {
         DLDIHeader* hdr = (DLDIHeader*) &b[i];
@@ -76,39 +147,155 @@ void dldi_patch_binary(u8* b, u32 len) {
     }
 }
 
-u32 dldi_get_status() {
-    if (ntremu.dldi_sd_fd < 0 ||
-        dldi.secnum >= ntremu.dldi_sd_size / SECTOR_SIZE) {
-        dldi.secnum = 0;
+u32 dldi_peek_status(DLDI* dldi) {
+    return sd_present(dldi) && dldi->secnum < dldi->sd_size / SECTOR_SIZE;
+}
+
+u32 dldi_get_status(DLDI* dldi) {
+    if (!dldi_peek_status(dldi)) {
+        dldi->secnum = 0;
         return 0;
     }
     return 1;
 }
 
-void dldi_write_addr(u32 addr) {
-    if (ntremu.dldi_sd_fd < 0) return;
-    dldi.secnum = addr;
-    dldi.i = 0;
-    if (dldi.secnum < ntremu.dldi_sd_size / SECTOR_SIZE) {
-        lseek(ntremu.dldi_sd_fd, dldi.secnum * SECTOR_SIZE, SEEK_SET);
-    }
+void dldi_write_addr(DLDI* dldi, u32 addr) {
+    if (!sd_present(dldi)) return;
+    dldi->secnum = addr;
+    dldi->i = 0;
 }
 
-void dldi_write_data(u32 data) {
-    if (ntremu.dldi_sd_fd < 0) return;
-    dldi.secbuf[dldi.i++] = data;
-    if (dldi.i == SECTOR_SIZE / 4) {
-        dldi.i = 0;
-        (void) !write(ntremu.dldi_sd_fd, dldi.secbuf, SECTOR_SIZE);
+void dldi_write_data(DLDI* dldi, u32 data) {
+    if (!sd_present(dldi)) return;
+    dldi->secbuf[dldi->i++] = data;
+    if (dldi->i == SECTOR_SIZE / 4) {
+        dldi->i = 0;
+        dldi->ra_count = 0;
+        sd_write(dldi, (u8*) dldi->secbuf, dldi->secnum++, 1);
     }
 }
 
-u32 dldi_read_data() {
-    if (ntremu.dldi_sd_fd < 0) return -1;
-    if (dldi.i == 0) {
-        (void) !read(ntremu.dldi_sd_fd, dldi.secbuf, SECTOR_SIZE);
+u32 dldi_read_data(DLDI* dldi) {
+    if (!sd_present(dldi)) return -1;
+    if (dldi->i == 0) sd_read(dldi, (u8*) dldi->secbuf, dldi->secnum, 1);
+    u32 a = dldi->secbuf[dldi->i++];
+    if (dldi->i == SECTOR_SIZE / 4) {
+        dldi->i = 0;
+        dldi->secnum++;
     }
-    u32 a = dldi.secbuf[dldi.i++];
-    if (dldi.i == SECTOR_SIZE / 4) dldi.i = 0;
     return a;
-}
\ No newline at end of file
+}
+
+static bool read_sectors(DLDI* dldi, u32 sector, u32 count, u8* dst) {
+    bool sequential = sector == dldi->next_sector;
+    dldi->next_sector = sector + count;
+    while (count) {
+        if (sector - dldi->ra_sector < dldi->ra_count) {
+            u32 n = dldi->ra_sector + dldi->ra_count - sector;
+            if (n > count) n = count;
+            memcpy(dst, &dldi->ra_buf[(sector - dldi->ra_sector) * SECTOR_SIZE],
+                   n * SECTOR_SIZE);
+            sector += n;
+            count -= n;
+            dst += n * SECTOR_SIZE;
+        } else if (!sequential || count >= DLDI_READAHEAD) {
+            // large or random reads go straight to the destination
+            return sd_read(dldi, dst, sector, count);
+        } else {
+            u32 n = DLDI_READAHEAD;
+            u32 total = dldi->sd_size / SECTOR_SIZE;
+            if (n > total - sector) n = total - sector;
+            dldi->ra_count = 0;
+            if (!dldi->ra_buf)
+                dldi->ra_buf = malloc(DLDI_READAHEAD * SECTOR_SIZE);
+            if (!sd_read(dldi, dldi->ra_buf, sector, n)) return false;
+            dldi->ra_sector = sector;
+            dldi->ra_count = n;
+        }
+    }
+    return true;
+}
+
+static bool write_sectors(DLDI* dldi, u32 sector, u32 count, const u8* src) {
+    if (sector < dldi->ra_sector + dldi->ra_count &&
+        dldi->ra_sector < sector + count)
+        dldi->ra_count = 0;
+    dldi->next_sector = -1;
+    return sd_write(dldi, src, sector, count);
+}
+
+// buffers in main ram are accessed directly, anything else goes through the
+// cpu one byte at a time
+static u8* guest_ram(NDS* nds, ArmCore* cpu, u32 addr, u64 len) {
+    if (addr >> 24 != 2 || (addr % RAMSIZE) + len > RAMSIZE) return NULL;
+    if (cpu == (ArmCore*) &nds->cpu9) {
+        Arm946E* cpu9 = &nds->cpu9;
+        if (cpu9->cp15_control.dtcm_on &&
+            addr < cpu9->dtcm_base + cpu9->dtcm_virtsize &&
+            cpu9->dtcm_base < addr + len)
+            return NULL;
+    }
+    return &nds->ram[addr % RAMSIZE];
+}
+
+void dldi_command(DLDI* dldi, NDS* nds, ArmCore* cpu, u32 cmd) {
+    dldi->result = 0;
+    u64 total = dldi->sd_size / SECTOR_SIZE;
+    if (!sd_present(dldi) || dldi->secnum >= total ||
+        dldi->count > total - dldi->secnum)
+        return;
+
+    u64 len = (u64) dldi->count * SECTOR_SIZE;
+    u8* ram = guest_ram(nds, cpu, dldi->buf_addr, len);
+    bool ok = true;
+    if (cmd == DLDI_CMD_READ) {
+        if (ram) {
+            ok = read_sectors(dldi, dldi->secnum, dldi->count, ram);
+        } else {
+            u8 buf[SECTOR_SIZE];
+            for (u32 s = 0; s < dldi->count && ok; s++) {
+                ok = read_sectors(dldi, dldi->secnum + s, 1, buf);
+                for (int i = 0; i < SECTOR_SIZE; i++) {
+                    cpu->write8(cpu, dldi->buf_addr + s * SECTOR_SIZE + i,
+                                buf[i]);
+                }
+            }
+        }
+    } else if (cmd == DLDI_CMD_WRITE) {
+        if (ram) {
+            ok = write_sectors(dldi, dldi->secnum, dldi->count, ram);
+        } else {
+            u8 buf[SECTOR_SIZE];
+            for (u32 s = 0; s < dldi->count && ok; s++) {
+                for (int i = 0; i < SECTOR_SIZE; i++) {
+                    buf[i] = cpu->read8(
+                        cpu, dldi->buf_addr + s * SECTOR_SIZE + i, false);
+                }
+                ok = write_sectors(dldi, dldi->secnum + s, 1, buf);
+            }
+        }
+    } else return;
+    dldi->result = ok;
+}
+
+bool dldi_commit(DLDI* dldi) {
+    if (!dldi->overlay) return true;
+    u32* blocks;
+    u32 n = overlay_blocks(dldi->overlay, &blocks);
+    bool ok = true;
+    for (u32 i = 0; i < n; i++) {
+        if (!image_write(dldi, overlay_find(dldi->overlay, blocks[i]),
+                         blocks[i], 1))
+            ok = false;
+    }
+    free(blocks);
+    if (dldi->vfat && !vfat_sync(dldi->vfat)) ok = false;
+    if (ok) overlay_clear(dldi->overlay);
+    return ok;
+}
+
+void dldi_discard(DLDI* dldi) {
+    if (!dldi->overlay) return;
+    overlay_clear(dldi->overlay);
+    dldi->ra_count = 0;
+}
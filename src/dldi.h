@@ -1,11 +1,25 @@
 #ifndef DLDI_H
 #define DLDI_H
 
+#include "overlay.h"
 #include "types.h"
+#include "vfat.h"
 
 #define SECTOR_SIZE 0x200
+#define DLDI_READAHEAD 64
 
-enum { DLDI_CTRL = 0xfff444, DLDI_DATA = 0xfff448 };
+// the driver writes the sector, buffer address and sector count and then the
+// command, reading the command register returns whether it succeeded.
+// ctrl and data are the old single word interface
+enum {
+    DLDI_CTRL = 0xfff444,
+    DLDI_DATA = 0xfff448,
+    DLDI_BUF = 0xfff44c,
+    DLDI_COUNT = 0xfff450,
+    DLDI_CMD = 0xfff454
+};
+
+enum { DLDI_CMD_READ = 1, DLDI_CMD_WRITE = 2 };
 
 #define DLDI_ID 0xbf8da5ed
 #define DLDI_MAGIC " Chishm"
@@ -36,11 +50,46 @@ typedef struct {
     u32 shutdown;
 } DLDIHeader;
 
-void dldi_patch_binary(u8* b, u32 len);
+typedef struct {
+    int sd_fd;
+    VFat* vfat;
+    u64 sd_size;
+
+    // when set writes are kept here until committed
+    Overlay* overlay;
+
+    u32 secnum;
+    u32 secbuf[SECTOR_SIZE >> 2];
+    int i;
+
+    u32 buf_addr;
+    u32 count;
+    u32 result;
+
+    // sequential reads are served from a read-ahead window, the buffer is
+    // host memory and not part of save states
+    u32 next_sector;
+    u32 ra_sector;
+    u32 ra_count;
+    u8* ra_buf;
+} DLDI;
+
+typedef struct _NDS NDS;
+typedef struct _ArmCore ArmCore;
+
+void dldi_init(DLDI* dldi, int sd_fd, VFat* vfat);
+void dldi_free(DLDI* dldi);
+void dldi_patch_binary(DLDI* dldi, u8* b, u32 len);
+
+// the status without resetting an out of range sector number
+u32 dldi_peek_status(DLDI* dldi);
+u32 dldi_get_status(DLDI* dldi);
+void dldi_write_addr(DLDI* dldi, u32 addr);
+void dldi_write_data(DLDI* dldi, u32 data);
+u32 dldi_read_data(DLDI* dldi);
+void dldi_command(DLDI* dldi, NDS* nds, ArmCore* cpu, u32 cmd);
 
-u32 dldi_get_status();
-void dldi_write_addr(u32 addr);
-void dldi_write_data(u32 data);
-u32 dldi_read_data();
+bool dldi_commit(DLDI* dldi);
+void dldi_discard(DLDI* dldi);
 
 #endif
@@ -50,6 +50,10 @@ void dma7_activate(DMAController* dmac, int i) {
 }
 
 void dma7_run(DMAController* dmac, int i) {
+    u64 start = dmac->master->sched.now;
+    u64 host_start = dmac->master->trace ? trace_host_time() : 0;
+    u32 len = dmac->dma[i].len;
+
     if (i > 0) dmac->dma[i].sptr %= 1 << 28;
     else dmac->dma[i].sptr %= 1 << 27;
     if (i < 3) dmac->dma[i].dptr %= 1 << 27;
@@ -80,6 +84,13 @@ void dma7_run(DMAController* dmac, int i) {
     }
 
     if (dmac->master->io7.dma[i].cnt.irq) dmac->master->io7.ifl.dma |= (1 << i);
+
+    if (dmac->master->trace) {
+        trace_span(dmac->master->trace, TRACE_DMA7, "DMA7", start,
+                   dmac->master->sched.now, host_start,
+                   "\"channel\":%d,\"len\":%d,\"mode\":%d", i, len,
+                   dmac->master->io7.dma[i].cnt.mode);
+    }
 }
 
 void dma7_trans16(DMAController* dmac, int i, u32 daddr, u32 saddr) {
@@ -119,6 +130,10 @@ void dma9_activate(DMAController* dmac, int i) {
 }
 
 void dma9_run(DMAController* dmac, int i) {
+    u64 start = dmac->master->sched.now;
+    u64 host_start = dmac->master->trace ? trace_host_time() : 0;
+    u32 len = dmac->dma[i].len;
+
     dmac->dma[i].sptr %= 1 << 28;
     dmac->dma[i].dptr %= 1 << 28;
 
@@ -147,6 +162,13 @@ void dma9_run(DMAController* dmac, int i) {
     }
 
     if (dmac->master->io9.dma[i].cnt.irq) dmac->master->io9.ifl.dma |= (1 << i);
+
+    if (dmac->master->trace) {
+        trace_span(dmac->master->trace, TRACE_DMA9, "DMA9", start,
+                   dmac->master->sched.now, host_start,
+                   "\"channel\":%d,\"len\":%d,\"mode\":%d", i, len,
+                   dmac->master->io9.dma[i].cnt.mode);
+    }
 }
 
 void dma9_trans16(DMAController* dmac, int i, u32 daddr, u32 saddr) {
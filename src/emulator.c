@@ -7,24 +7,84 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
-#include "arm/arm.h"
 #include "emulator_state.h"
 #include "nds.h"
-#include "arm/thumb.h"
 
 #define TRANSLATE_SPEED 5.0
 #define ROTATE_SPEED 0.02
 
 EmulatorState ntremu;
 
+// in keyinput bit order
+static const SDL_Scancode keyboard_map[10] = {
+    SDL_SCANCODE_Z,
+    SDL_SCANCODE_X,
+    SDL_SCANCODE_RSHIFT,
+    SDL_SCANCODE_RETURN,
+    SDL_SCANCODE_RIGHT,
+    SDL_SCANCODE_LEFT,
+    SDL_SCANCODE_UP,
+    SDL_SCANCODE_DOWN,
+    SDL_SCANCODE_W,
+    SDL_SCANCODE_Q};
+static const SDL_GameControllerButton controller_map[10] = {
+    SDL_CONTROLLER_BUTTON_B,
+    SDL_CONTROLLER_BUTTON_A,
+    SDL_CONTROLLER_BUTTON_BACK,
+    SDL_CONTROLLER_BUTTON_START,
+    SDL_CONTROLLER_BUTTON_DPAD_RIGHT,
+    SDL_CONTROLLER_BUTTON_DPAD_LEFT,
+    SDL_CONTROLLER_BUTTON_DPAD_UP,
+    SDL_CONTROLLER_BUTTON_DPAD_DOWN,
+    SDL_CONTROLLER_BUTTON_RIGHTSHOULDER,
+    SDL_CONTROLLER_BUTTON_LEFTSHOULDER};
+// in CAM_* order
+static const SDL_Scancode freecam_map[CAM_SLOW] = {
+    SDL_SCANCODE_E,
+    SDL_SCANCODE_Q,
+    SDL_SCANCODE_DOWN,
+    SDL_SCANCODE_UP,
+    SDL_SCANCODE_A,
+    SDL_SCANCODE_D,
+    SDL_SCANCODE_LEFT,
+    SDL_SCANCODE_RIGHT,
+    SDL_SCANCODE_W,
+    SDL_SCANCODE_S};
+
 const char usage[] = "ntremu [options] <romfile>\n"
                      "-b -- boot from firmware\n"
                      "-d -- run the debugger\n"
                      "-p <path> -- path to bios/firmware files\n"
-                     "-s <path> -- path to SD card image for DLDI\n"
+                     "-s <path> -- SD card image or directory for DLDI\n"
+                     "-o -- keep sd card and save writes in memory until "
+                     "committed\n"
+                     "-f <n|auto> -- skip n frames between drawn frames\n"
+                     "-v <ds|vsync|vrr> -- frame pacing (default ds)\n"
+                     "-S <speed> -- emulation speed from 0.25 to 8\n"
+                     "-c -- emulate arm9 cache timing\n"
+                     "-H -- use hle bios (default if bios files are missing)\n"
+                     "-V -- check hle bios calls against the real bios\n"
+                     "-t <file> -- write a chrome trace of emulator events\n"
+                     "-g <file> -- record 3d commands for ntremu-gxreplay\n"
+                     "-l <file> -- record 2d line state for ntremu-ppureplay\n"
+                     "-r <file> -- record every frame to file.y4m and "
+                     "file.wav\n"
+                     "-e <name> -- export frames and audio and read input "
+                     "through shared memory\n"
+                     "-T <file> -- record executed instructions for "
+                     "ntremu-tracedis\n"
+                     "-W <cpu>[,<start>,<last>][,r] -- cpu (7 or 9) and "
+                     "address range to trace, r adds register changes\n"
+                     "-G <port> -- wait for gdb on a localhost port\n"
+                     "-P <file> -- write a profile of guest code on exit\n"
+                     "-y <file> -- arm9 symbols for the profile (elf or map)\n"
+                     "-Y <file> -- arm7 symbols for the profile (elf or map)\n"
                      "-h -- print help";
 
 int emulator_init(int argc, char** argv) {
+    ntremu.frameskip = FRAMESKIP_AUTO;
+    ntremu.speed = 1;
+    ntremu.cputrace_last = -1;
     read_args(argc, argv);
     if (!ntremu.romfile) {
         eprintf(usage);
@@ -46,48 +106,97 @@ int emulator_init(int argc, char** argv) {
 
     close(dirfd);
 
-    if (bios7fd < 0 || bios9fd < 0 || firmwarefd < 0) {
-        eprintf("Missing bios or firmware. Make sure 'bios7.bin','bios9.bin', "
-                "and 'firmware.bin' exist.\n");
+    if (firmwarefd < 0) {
+        eprintf("Missing firmware. Make sure 'firmware.bin' exists.\n");
         return -1;
     }
 
-    ntremu.bios7 =
-        mmap(NULL, BIOS7SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, bios7fd, 0);
-    ntremu.bios9 =
-        mmap(NULL, BIOS9SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, bios9fd, 0);
+    if (bios7fd < 0 || bios9fd < 0) {
+        if (ntremu.bootbios || ntremu.bios_mode == BIOS_VERIFY) {
+            eprintf("Missing bios. Make sure 'bios7.bin' and 'bios9.bin' "
+                    "exist.\n");
+            return -1;
+        }
+        ntremu.bios_mode = BIOS_HLE;
+        ntremu.bios7 = mmap(NULL, BIOS7SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        ntremu.bios9 = mmap(NULL, BIOS9SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        bios_make_stub(ntremu.bios7, ntremu.bios9);
+    } else {
+        ntremu.bios7 = mmap(NULL, BIOS7SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE, bios7fd, 0);
+        ntremu.bios9 = mmap(NULL, BIOS9SIZE, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE, bios9fd, 0);
+    }
     ntremu.firmware = mmap(NULL, FIRMWARESIZE, PROT_READ | PROT_WRITE,
                            MAP_SHARED, firmwarefd, 0);
 
-    close(bios7fd);
-    close(bios9fd);
+    if (bios7fd >= 0) close(bios7fd);
+    if (bios9fd >= 0) close(bios9fd);
     close(firmwarefd);
 
-    ntremu.nds = malloc(sizeof *ntremu.nds);
-    ntremu.card = create_card(ntremu.romfile);
+    ntremu.nds = calloc(1, sizeof *ntremu.nds);
+    ntremu.card = create_card(ntremu.romfile, ntremu.overlay);
     if (!ntremu.card) {
         eprintf("Invalid rom file\n");
         return -1;
     }
 
+    ntremu.dldi_sd_fd = -1;
     if (ntremu.sd_path) {
-        ntremu.dldi_sd_fd = open(ntremu.sd_path, O_RDWR);
-        if (ntremu.dldi_sd_fd >= 0) {
-            struct stat st;
-            fstat(ntremu.dldi_sd_fd, &st);
-            if (S_ISBLK(st.st_mode)) {
-                ntremu.dldi_sd_size = lseek(ntremu.dldi_sd_fd, 0, SEEK_END);
-            } else {
-                ntremu.dldi_sd_size = st.st_size;
-            }
+        struct stat st;
+        if (!stat(ntremu.sd_path, &st) && S_ISDIR(st.st_mode)) {
+            ntremu.dldi_vfat = vfat_open(ntremu.sd_path);
+            if (!ntremu.dldi_vfat) eprintf("Invalid SD card directory\n");
+        } else {
+            ntremu.dldi_sd_fd = open(ntremu.sd_path, O_RDWR);
         }
-    } else {
-        ntremu.dldi_sd_fd = -1;
     }
 
-    arm_generate_lookup();
-    thumb_generate_lookup();
-    generate_adpcm_table();
+    if (ntremu.trace_path) {
+        ntremu.trace = trace_open(ntremu.trace_path);
+        if (!ntremu.trace) eprintf("Could not open trace file\n");
+    }
+    if (ntremu.gxlog_path) {
+        ntremu.gxlog = gxlog_open(ntremu.gxlog_path);
+        if (!ntremu.gxlog) eprintf("Could not open gx log file\n");
+    }
+    if (ntremu.ppulog_path) {
+        ntremu.ppulog = ppulog_open(ntremu.ppulog_path);
+        if (!ntremu.ppulog) eprintf("Could not open ppu log file\n");
+    }
+    if (ntremu.capture_path) {
+        ntremu.capture = capture_open(ntremu.capture_path);
+        if (!ntremu.capture) eprintf("Could not open capture files\n");
+    }
+    // every recorded frame should be drawn
+    if (ntremu.capture) ntremu.frameskip = 0;
+    if (ntremu.shm_name) {
+        ntremu.shm = shmexport_open(ntremu.shm_name);
+        if (!ntremu.shm) eprintf("Could not create shared memory\n");
+    }
+    if (ntremu.prof_path) {
+        ntremu.prof = profiler_open(ntremu.prof_path);
+        if (!ntremu.prof) eprintf("Could not open profile file\n");
+    }
+    if (ntremu.prof && ntremu.prof_syms9 &&
+        !profiler_load_symbols(ntremu.prof, CPU9, ntremu.prof_syms9))
+        eprintf("Could not load arm9 symbols\n");
+    if (ntremu.prof && ntremu.prof_syms7 &&
+        !profiler_load_symbols(ntremu.prof, CPU7, ntremu.prof_syms7))
+        eprintf("Could not load arm7 symbols\n");
+    if (ntremu.cputrace_path) {
+        ntremu.cputrace = cputrace_open(
+            ntremu.cputrace_path, ntremu.cputrace_cpu, ntremu.cputrace_start,
+            ntremu.cputrace_last, ntremu.cputrace_flags);
+        if (!ntremu.cputrace) eprintf("Could not open trace file\n");
+    }
+    if (ntremu.gdb_port) {
+        ntremu.gdb = gdb_open(ntremu.gdb_port);
+        if (!ntremu.gdb) eprintf("Could not listen for gdb\n");
+    }
+    if (ntremu.debugger) rewind_init(&ntremu.rewind);
 
     emulator_reset();
 
@@ -98,17 +207,90 @@ int emulator_init(int argc, char** argv) {
 }
 
 void emulator_quit() {
+    overlay_clear(&ntremu.sd_overlay);
     close(ntremu.dldi_sd_fd);
+    vfat_close(ntremu.dldi_vfat);
     destroy_card(ntremu.card);
+    bios_hle_free(ntremu.nds);
+    dldi_free(&ntremu.nds->dldi);
     free(ntremu.nds);
     munmap(ntremu.bios7, BIOS7SIZE);
     munmap(ntremu.bios9, BIOS9SIZE);
     munmap(ntremu.firmware, FIRMWARESIZE);
+    trace_close(ntremu.trace);
+    gxlog_close(ntremu.gxlog);
+    ppulog_close(ntremu.ppulog);
+    profiler_close(ntremu.prof);
+    capture_close(ntremu.capture);
+    shmexport_close(ntremu.shm);
+    gdb_close(ntremu.gdb);
+    cputrace_close(ntremu.cputrace);
+    rewind_free(&ntremu.rewind);
 }
 
 void emulator_reset() {
+    GPU* gpu = &ntremu.nds->gpu;
+    bool threaded = gpu->threaded;
+    bool wireframe = gpu->wireframe;
+    bool freecam = gpu->freecam;
+    mat4 freecam_mtx = gpu->freecam_mtx;
+
+    destroy_gpu_thread(gpu);
+    bios_hle_free(ntremu.nds);
+    dldi_free(&ntremu.nds->dldi);
     init_nds(ntremu.nds, ntremu.card, ntremu.bios7, ntremu.bios9,
-             ntremu.firmware, ntremu.bootbios);
+             ntremu.firmware, ntremu.dldi_sd_fd, ntremu.dldi_vfat,
+             ntremu.bootbios);
+    if (threaded) init_gpu_thread(gpu);
+    gpu->wireframe = wireframe;
+    gpu->freecam = freecam;
+    gpu->freecam_mtx = freecam_mtx;
+    ntremu.nds->cpu9.cache_model = ntremu.cache_model;
+    if (ntremu.overlay) ntremu.nds->dldi.overlay = &ntremu.sd_overlay;
+    ntremu.nds->trace = ntremu.trace;
+    ntremu.nds->gxlog = ntremu.gxlog;
+    ntremu.nds->ppulog = ntremu.ppulog;
+    if (ntremu.prof) profiler_attach(ntremu.prof, ntremu.nds);
+    if (ntremu.cputrace) cputrace_attach(ntremu.cputrace, ntremu.nds);
+    if (ntremu.debugger || ntremu.gdb) {
+        ntremu.nds->bkpt = &ntremu.bkpt;
+        ntremu.nds->watch = &ntremu.watch;
+    }
+    bios_hle_init(ntremu.nds, ntremu.bios_mode);
+    if (ntremu.debugger) rewind_reset(&ntremu.rewind, ntremu.nds);
+}
+
+// writes made while running with -o are only kept if committed
+bool emulator_commit() {
+    bool ok = dldi_commit(&ntremu.nds->dldi);
+    if (!card_commit_save(ntremu.card)) ok = false;
+    return ok;
+}
+
+void emulator_discard() {
+    dldi_discard(&ntremu.nds->dldi);
+    card_discard_save(ntremu.card);
+}
+
+// <cpu>[,<start>,<last>][,r]
+static bool parse_cputrace_spec(char* spec) {
+    char* p;
+    long cpu = strtol(spec, &p, 10);
+    if (cpu != 7 && cpu != 9) return false;
+    ntremu.cputrace_cpu = cpu == 7 ? CPU7 : CPU9;
+    if (*p == ',' && p[1] != 'r') {
+        char* end;
+        ntremu.cputrace_start = strtoul(p + 1, &end, 0);
+        if (end == p + 1 || *end != ',') return false;
+        p = end;
+        ntremu.cputrace_last = strtoul(p + 1, &end, 0);
+        if (end == p + 1 || ntremu.cputrace_last < ntremu.cputrace_start)
+            return false;
+        p = end;
+    }
+    if (!strcmp(p, ",r")) ntremu.cputrace_flags |= CPUTRACE_REGS;
+    else if (*p) return false;
+    return true;
 }
 
 void read_args(int argc, char** argv) {
@@ -122,6 +304,18 @@ void read_args(int argc, char** argv) {
                     case 'b':
                         ntremu.bootbios = true;
                         break;
+                    case 'c':
+                        ntremu.cache_model = true;
+                        break;
+                    case 'H':
+                        ntremu.bios_mode = BIOS_HLE;
+                        break;
+                    case 'V':
+                        ntremu.bios_mode = BIOS_VERIFY;
+                        break;
+                    case 'o':
+                        ntremu.overlay = true;
+                        break;
                     case 'p':
                         if (!f[1] && i + 1 < argc) {
                             ntremu.biosPath = argv[++i];
@@ -136,6 +330,126 @@ void read_args(int argc, char** argv) {
                             eprintf("Missing argument for '-s'\n");
                         }
                         break;
+                    case 'f':
+                        if (!f[1] && i + 1 < argc) {
+                            i++;
+                            if (!strcmp(argv[i], "auto")) {
+                                ntremu.frameskip = FRAMESKIP_AUTO;
+                            } else {
+                                ntremu.frameskip = atoi(argv[i]);
+                                if (ntremu.frameskip < 0) ntremu.frameskip = 0;
+                                if (ntremu.frameskip > MAX_FRAMESKIP)
+                                    ntremu.frameskip = MAX_FRAMESKIP;
+                            }
+                        } else {
+                            eprintf("Missing argument for '-f'\n");
+                        }
+                        break;
+                    case 'v':
+                        if (!f[1] && i + 1 < argc) {
+                            i++;
+                            if (!strcmp(argv[i], "ds")) {
+                                ntremu.pace_mode = PACE_DS;
+                            } else if (!strcmp(argv[i], "vsync")) {
+                                ntremu.pace_mode = PACE_VSYNC;
+                            } else if (!strcmp(argv[i], "vrr")) {
+                                ntremu.pace_mode = PACE_VRR;
+                            } else {
+                                eprintf("Invalid pacing mode '%s'\n", argv[i]);
+                            }
+                        } else {
+                            eprintf("Missing argument for '-v'\n");
+                        }
+                        break;
+                    case 'S':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.speed = atof(argv[++i]);
+                            if (!(ntremu.speed >= MIN_SPEED))
+                                ntremu.speed = MIN_SPEED;
+                            if (ntremu.speed > MAX_SPEED)
+                                ntremu.speed = MAX_SPEED;
+                        } else {
+                            eprintf("Missing argument for '-S'\n");
+                        }
+                        break;
+                    case 't':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.trace_path = argv[++i];
+                        } else {
+                            eprintf("Missing argument for '-t'\n");
+                        }
+                        break;
+                    case 'g':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.gxlog_path = argv[++i];
+                        } else {
+                            eprintf("Missing argument for '-g'\n");
+                        }
+                        break;
+                    case 'l':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.ppulog_path = argv[++i];
+                        } else {
+                            eprintf("Missing argument for '-l'\n");
+                        }
+                        break;
+                    case 'r':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.capture_path = argv[++i];
+                        } else {
+                            eprintf("Missing argument for '-r'\n");
+                        }
+                        break;
+                    case 'e':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.shm_name = argv[++i];
+                        } else {
+                            eprintf("Missing argument for '-e'\n");
+                        }
+                        break;
+                    case 'T':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.cputrace_path = argv[++i];
+                        } else {
+                            eprintf("Missing argument for '-T'\n");
+                        }
+                        break;
+                    case 'W':
+                        if (!f[1] && i + 1 < argc) {
+                            if (!parse_cputrace_spec(argv[++i]))
+                                eprintf("Invalid trace range '%s'\n", argv[i]);
+                        } else {
+                            eprintf("Missing argument for '-W'\n");
+                        }
+                        break;
+                    case 'G':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.gdb_port = atoi(argv[++i]);
+                        } else {
+                            eprintf("Missing argument for '-G'\n");
+                        }
+                        break;
+                    case 'P':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.prof_path = argv[++i];
+                        } else {
+                            eprintf("Missing argument for '-P'\n");
+                        }
+                        break;
+                    case 'y':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.prof_syms9 = argv[++i];
+                        } else {
+                            eprintf("Missing argument for '-y'\n");
+                        }
+                        break;
+                    case 'Y':
+                        if (!f[1] && i + 1 < argc) {
+                            ntremu.prof_syms7 = argv[++i];
+                        } else {
+                            eprintf("Missing argument for '-Y'\n");
+                        }
+                        break;
                     case 'h':
                         eprintf(usage);
                         exit(0);
@@ -164,8 +478,14 @@ void hotkey_press(SDL_KeyCode key) {
         case SDLK_TAB:
             ntremu.uncap = !ntremu.uncap;
             break;
+        case SDLK_MINUS:
+            ntremu.speed = fmax(ntremu.speed / 2, MIN_SPEED);
+            break;
+        case SDLK_EQUALS:
+            ntremu.speed = fmin(ntremu.speed * 2, MAX_SPEED);
+            break;
         case SDLK_o:
-            ntremu.wireframe = !ntremu.wireframe;
+            ntremu.nds->gpu.wireframe = !ntremu.nds->gpu.wireframe;
             break;
         case SDLK_BACKSPACE:
             if (ntremu.nds->io7.extkeyin.hinge) {
@@ -176,15 +496,15 @@ void hotkey_press(SDL_KeyCode key) {
             }
             break;
         case SDLK_c:
-            if (ntremu.freecam) {
-                ntremu.freecam = false;
+            if (ntremu.nds->gpu.freecam) {
+                ntremu.nds->gpu.freecam = false;
             } else {
-                ntremu.freecam = true;
-                ntremu.freecam_mtx = (mat4){0};
-                ntremu.freecam_mtx.p[0][0] = 1;
-                ntremu.freecam_mtx.p[1][1] = 1;
-                ntremu.freecam_mtx.p[2][2] = 1;
-                ntremu.freecam_mtx.p[3][3] = 1;
+                ntremu.nds->gpu.freecam = true;
+                ntremu.nds->gpu.freecam_mtx = (mat4){0};
+                ntremu.nds->gpu.freecam_mtx.p[0][0] = 1;
+                ntremu.nds->gpu.freecam_mtx.p[1][1] = 1;
+                ntremu.nds->gpu.freecam_mtx.p[2][2] = 1;
+                ntremu.nds->gpu.freecam_mtx.p[3][3] = 1;
             }
             break;
         case SDLK_u:
@@ -195,54 +515,39 @@ void hotkey_press(SDL_KeyCode key) {
     }
 }
 
-void update_input_keyboard(NDS* nds) {
+void update_input_keyboard(InputState* in) {
     const Uint8* keys = SDL_GetKeyboardState(NULL);
-    nds->io7.keyinput.a = ~keys[SDL_SCANCODE_Z];
-    nds->io7.keyinput.b = ~keys[SDL_SCANCODE_X];
-    nds->io7.keyinput.start = ~keys[SDL_SCANCODE_RETURN];
-    nds->io7.keyinput.select = ~keys[SDL_SCANCODE_RSHIFT];
-    nds->io7.keyinput.left = ~keys[SDL_SCANCODE_LEFT];
-    nds->io7.keyinput.right = ~keys[SDL_SCANCODE_RIGHT];
-    nds->io7.keyinput.up = ~keys[SDL_SCANCODE_UP];
-    nds->io7.keyinput.down = ~keys[SDL_SCANCODE_DOWN];
-    nds->io7.keyinput.l = ~keys[SDL_SCANCODE_Q];
-    nds->io7.keyinput.r = ~keys[SDL_SCANCODE_W];
-    nds->io9.keyinput = nds->io7.keyinput;
+    in->keys = 0x3ff;
+    for (int i = 0; i < 10; i++) {
+        if (keys[keyboard_map[i]]) in->keys &= ~(1 << i);
+    }
+    in->x = ~keys[SDL_SCANCODE_A];
+    in->y = ~keys[SDL_SCANCODE_S];
 
-    nds->io7.extkeyin.x = ~keys[SDL_SCANCODE_A];
-    nds->io7.extkeyin.y = ~keys[SDL_SCANCODE_S];
+    in->cam = 0;
+    for (int i = 0; i < CAM_SLOW; i++) {
+        if (keys[freecam_map[i]]) in->cam |= 1 << i;
+    }
+    if (keys[SDL_SCANCODE_LSHIFT] || keys[SDL_SCANCODE_RSHIFT])
+        in->cam |= 1 << CAM_SLOW;
 }
 
-void update_input_controller(NDS* nds, SDL_GameController* controller) {
-    nds->io7.keyinput.a &=
-        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_B);
-    nds->io7.keyinput.b &=
-        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_A);
-    nds->io7.keyinput.start &=
-        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_START);
-    nds->io7.keyinput.select &=
-        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_BACK);
-    nds->io7.keyinput.left &= ~SDL_GameControllerGetButton(
-        controller, SDL_CONTROLLER_BUTTON_DPAD_LEFT);
-    nds->io7.keyinput.right &= ~SDL_GameControllerGetButton(
-        controller, SDL_CONTROLLER_BUTTON_DPAD_RIGHT);
-    nds->io7.keyinput.up &=
-        ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_DPAD_UP);
-    nds->io7.keyinput.down &= ~SDL_GameControllerGetButton(
-        controller, SDL_CONTROLLER_BUTTON_DPAD_DOWN);
-    nds->io7.keyinput.l &= ~SDL_GameControllerGetButton(
-        controller, SDL_CONTROLLER_BUTTON_LEFTSHOULDER);
-    nds->io7.keyinput.r &= ~SDL_GameControllerGetButton(
-        controller, SDL_CONTROLLER_BUTTON_RIGHTSHOULDER);
-    nds->io9.keyinput = nds->io7.keyinput;
-
-    nds->io7.extkeyin.x &=
+void update_input_controller(InputState* in, SDL_GameController* controller) {
+    in->pad_keys = 0x3ff;
+    in->pad_x = 1;
+    in->pad_y = 1;
+    if (!controller) return;
+    for (int i = 0; i < 10; i++) {
+        if (SDL_GameControllerGetButton(controller, controller_map[i]))
+            in->pad_keys &= ~(1 << i);
+    }
+    in->pad_x =
         ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_Y);
-    nds->io7.extkeyin.y &=
+    in->pad_y =
         ~SDL_GameControllerGetButton(controller, SDL_CONTROLLER_BUTTON_X);
 }
 
-void update_input_touch(NDS* nds, SDL_Rect* ts_bounds,
+void update_input_touch(InputState* in, SDL_Rect* ts_bounds,
                         SDL_GameController* controller) {
     int x, y;
     bool pressed = SDL_GetMouseState(&x, &y) & SDL_BUTTON(SDL_BUTTON_LEFT);
@@ -251,8 +556,8 @@ void update_input_touch(NDS* nds, SDL_Rect* ts_bounds,
     if (x < 0 || x >= NDS_SCREEN_W || y < 0 || y >= NDS_SCREEN_H)
         pressed = false;
     if (pressed) {
-        nds->tsc.x = x;
-        nds->tsc.y = y;
+        in->tsc_x = x;
+        in->tsc_y = y;
     }
 
     if (controller) {
@@ -264,21 +569,21 @@ void update_input_touch(NDS* nds, SDL_Rect* ts_bounds,
             pressed = true;
 
             if (ntremu.abs_touch) {
-                nds->tsc.x =
+                in->tsc_x =
                     NDS_SCREEN_W / 2 + (x * (NDS_SCREEN_W / 2 - 10) >> 15);
-                nds->tsc.y =
+                in->tsc_y =
                     NDS_SCREEN_H / 2 + (y * (NDS_SCREEN_H / 2 - 10) >> 15);
             } else {
                 static int prev_x = 0, prev_y = 0;
 
                 x >>= 13, y >>= 13;
 
-                if (nds->tsc.y == (u8) -1) {
-                    nds->tsc.x = NDS_SCREEN_W / 2;
-                    nds->tsc.y = NDS_SCREEN_H / 2;
+                if (in->tsc_y == (u8) -1) {
+                    in->tsc_x = NDS_SCREEN_W / 2;
+                    in->tsc_y = NDS_SCREEN_H / 2;
                 } else if (prev_x != x || prev_y != y) {
-                    int tmpx = nds->tsc.x;
-                    int tmpy = nds->tsc.y;
+                    int tmpx = in->tsc_x;
+                    int tmpy = in->tsc_y;
                     tmpx += x;
                     tmpy += y;
                     if (tmpx < 0) tmpx = 0;
@@ -286,19 +591,52 @@ void update_input_touch(NDS* nds, SDL_Rect* ts_bounds,
                     if (tmpy < 0) tmpy = 0;
                     if (tmpy >= NDS_SCREEN_H) tmpy = NDS_SCREEN_H - 1;
 
-                    nds->tsc.x = tmpx;
-                    nds->tsc.y = tmpy;
+                    in->tsc_x = tmpx;
+                    in->tsc_y = tmpy;
                 }
                 prev_x = x, prev_y = y;
             }
         }
     }
 
-    nds->io7.extkeyin.pen = !pressed;
+    in->pen = !pressed;
     if (!pressed) {
-        nds->tsc.x = -1;
-        nds->tsc.y = -1;
+        in->tsc_x = -1;
+        in->tsc_y = -1;
+    }
+}
+
+// keyboard keys are ignored while the freecam is being moved
+// keys pressed through the shared memory are added to the host input
+void update_input_shm(InputState* in, ShmExport* e) {
+    u32 keys = atomic_load_explicit(&e->shm->keys, memory_order_relaxed);
+    in->keys &= ~keys;
+    if (keys & (1 << 10)) in->x = 0;
+    if (keys & (1 << 11)) in->y = 0;
+    u32 touch = atomic_load_explicit(&e->shm->touch, memory_order_relaxed);
+    int x = touch & 0xff;
+    int y = (touch >> 8) & 0xff;
+    if ((touch & SHM_TOUCH_PRESSED) && y < NDS_SCREEN_H) {
+        in->pen = 0;
+        in->tsc_x = x;
+        in->tsc_y = y;
+    }
+}
+
+void apply_input(NDS* nds, InputState in) {
+    if (nds->gpu.freecam) {
+        update_input_freecam(nds, in.cam);
+        in.keys = 0x3ff;
+        in.x = 1;
+        in.y = 1;
     }
+    nds->io7.keyinput.keys = in.keys & in.pad_keys;
+    nds->io9.keyinput = nds->io7.keyinput;
+    nds->io7.extkeyin.x = in.x & in.pad_x;
+    nds->io7.extkeyin.y = in.y & in.pad_y;
+    nds->io7.extkeyin.pen = in.pen;
+    nds->tsc.x = in.tsc_x;
+    nds->tsc.y = in.tsc_y;
 }
 
 void matmul2(mat4* a, mat4* b, mat4* dst) {
@@ -313,13 +651,11 @@ void matmul2(mat4* a, mat4* b, mat4* dst) {
     }
 }
 
-void update_input_freecam() {
-    const Uint8* keys = SDL_GetKeyboardState(NULL);
-
+void update_input_freecam(NDS* nds, u32 cam) {
     float speed = TRANSLATE_SPEED;
-    if (keys[SDL_SCANCODE_LSHIFT] || keys[SDL_SCANCODE_RSHIFT]) speed /= 20;
+    if (cam & 1 << CAM_SLOW) speed /= 20;
 
-    if (keys[SDL_SCANCODE_E]) {
+    if (cam & 1 << CAM_E) {
         mat4 m = {0};
         m.p[0][0] = 1;
         m.p[1][1] = 1;
@@ -327,10 +663,10 @@ void update_input_freecam() {
         m.p[3][3] = 1;
         m.p[1][3] = -speed;
         mat4 tmp;
-        matmul2(&m, &ntremu.freecam_mtx, &tmp);
-        ntremu.freecam_mtx = tmp;
+        matmul2(&m, &nds->gpu.freecam_mtx, &tmp);
+        nds->gpu.freecam_mtx = tmp;
     }
-    if (keys[SDL_SCANCODE_Q]) {
+    if (cam & 1 << CAM_Q) {
         mat4 m = {0};
         m.p[0][0] = 1;
         m.p[1][1] = 1;
@@ -338,10 +674,10 @@ void update_input_freecam() {
         m.p[3][3] = 1;
         m.p[1][3] = speed;
         mat4 tmp;
-        matmul2(&m, &ntremu.freecam_mtx, &tmp);
-        ntremu.freecam_mtx = tmp;
+        matmul2(&m, &nds->gpu.freecam_mtx, &tmp);
+        nds->gpu.freecam_mtx = tmp;
     }
-    if (keys[SDL_SCANCODE_DOWN]) {
+    if (cam & 1 << CAM_DOWN) {
         mat4 m = {0};
         m.p[3][3] = 1;
         m.p[0][0] = 1;
@@ -350,10 +686,10 @@ void update_input_freecam() {
         m.p[2][1] = sinf(ROTATE_SPEED);
         m.p[2][2] = cosf(ROTATE_SPEED);
         mat4 tmp;
-        matmul2(&m, &ntremu.freecam_mtx, &tmp);
-        ntremu.freecam_mtx = tmp;
+        matmul2(&m, &nds->gpu.freecam_mtx, &tmp);
+        nds->gpu.freecam_mtx = tmp;
     }
-    if (keys[SDL_SCANCODE_UP]) {
+    if (cam & 1 << CAM_UP) {
         mat4 m = {0};
         m.p[3][3] = 1;
         m.p[0][0] = 1;
@@ -362,10 +698,10 @@ void update_input_freecam() {
         m.p[2][1] = sinf(-ROTATE_SPEED);
         m.p[2][2] = cosf(-ROTATE_SPEED);
         mat4 tmp;
-        matmul2(&m, &ntremu.freecam_mtx, &tmp);
-        ntremu.freecam_mtx = tmp;
+        matmul2(&m, &nds->gpu.freecam_mtx, &tmp);
+        nds->gpu.freecam_mtx = tmp;
     }
-    if (keys[SDL_SCANCODE_A]) {
+    if (cam & 1 << CAM_A) {
         mat4 m = {0};
         m.p[0][0] = 1;
         m.p[1][1] = 1;
@@ -373,10 +709,10 @@ void update_input_freecam() {
         m.p[3][3] = 1;
         m.p[0][3] = speed;
         mat4 tmp;
-        matmul2(&m, &ntremu.freecam_mtx, &tmp);
-        ntremu.freecam_mtx = tmp;
+        matmul2(&m, &nds->gpu.freecam_mtx, &tmp);
+        nds->gpu.freecam_mtx = tmp;
     }
-    if (keys[SDL_SCANCODE_D]) {
+    if (cam & 1 << CAM_D) {
         mat4 m = {0};
         m.p[0][0] = 1;
         m.p[1][1] = 1;
@@ -384,10 +720,10 @@ void update_input_freecam() {
         m.p[3][3] = 1;
         m.p[0][3] = -speed;
         mat4 tmp;
-        matmul2(&m, &ntremu.freecam_mtx, &tmp);
-        ntremu.freecam_mtx = tmp;
+        matmul2(&m, &nds->gpu.freecam_mtx, &tmp);
+        nds->gpu.freecam_mtx = tmp;
     }
-    if (keys[SDL_SCANCODE_LEFT]) {
+    if (cam & 1 << CAM_LEFT) {
         mat4 m = {0};
         m.p[3][3] = 1;
         m.p[1][1] = 1;
@@ -396,10 +732,10 @@ void update_input_freecam() {
         m.p[0][2] = sinf(-ROTATE_SPEED);
         m.p[0][0] = cosf(-ROTATE_SPEED);
         mat4 tmp;
-        matmul2(&m, &ntremu.freecam_mtx, &tmp);
-        ntremu.freecam_mtx = tmp;
+        matmul2(&m, &nds->gpu.freecam_mtx, &tmp);
+        nds->gpu.freecam_mtx = tmp;
     }
-    if (keys[SDL_SCANCODE_RIGHT]) {
+    if (cam & 1 << CAM_RIGHT) {
         mat4 m = {0};
         m.p[3][3] = 1;
         m.p[1][1] = 1;
@@ -408,10 +744,10 @@ void update_input_freecam() {
         m.p[0][2] = sinf(ROTATE_SPEED);
         m.p[0][0] = cosf(ROTATE_SPEED);
         mat4 tmp;
-        matmul2(&m, &ntremu.freecam_mtx, &tmp);
-        ntremu.freecam_mtx = tmp;
+        matmul2(&m, &nds->gpu.freecam_mtx, &tmp);
+        nds->gpu.freecam_mtx = tmp;
     }
-    if (keys[SDL_SCANCODE_W]) {
+    if (cam & 1 << CAM_W) {
         mat4 m = {0};
         m.p[0][0] = 1;
         m.p[1][1] = 1;
@@ -419,10 +755,10 @@ void update_input_freecam() {
         m.p[3][3] = 1;
         m.p[2][3] = speed;
         mat4 tmp;
-        matmul2(&m, &ntremu.freecam_mtx, &tmp);
-        ntremu.freecam_mtx = tmp;
+        matmul2(&m, &nds->gpu.freecam_mtx, &tmp);
+        nds->gpu.freecam_mtx = tmp;
     }
-    if (keys[SDL_SCANCODE_S]) {
+    if (cam & 1 << CAM_S) {
         mat4 m = {0};
         m.p[0][0] = 1;
         m.p[1][1] = 1;
@@ -430,12 +766,7 @@ void update_input_freecam() {
         m.p[3][3] = 1;
         m.p[2][3] = -speed;
         mat4 tmp;
-        matmul2(&m, &ntremu.freecam_mtx, &tmp);
-        ntremu.freecam_mtx = tmp;
+        matmul2(&m, &nds->gpu.freecam_mtx, &tmp);
+        nds->gpu.freecam_mtx = tmp;
     }
-
-    ntremu.nds->io7.keyinput.keys = 0x3ff;
-    ntremu.nds->io9.keyinput.keys = 0x3ff;
-    ntremu.nds->io7.extkeyin.x = 1;
-    ntremu.nds->io7.extkeyin.y = 1;
 }
\ No newline at end of file
@@ -8,18 +8,55 @@
 #include "nds.h"
 #include "types.h"
 
+enum {
+    CAM_E,
+    CAM_Q,
+    CAM_DOWN,
+    CAM_UP,
+    CAM_A,
+    CAM_D,
+    CAM_LEFT,
+    CAM_RIGHT,
+    CAM_W,
+    CAM_S,
+    CAM_SLOW
+};
+
+// host input sampled by the sdl thread. it fits in one word so it can be
+// handed to the emulation thread with a single atomic store
+typedef union {
+    u64 w;
+    struct {
+        u64 keys : 10;
+        u64 x : 1;
+        u64 y : 1;
+        u64 pad_keys : 10;
+        u64 pad_x : 1;
+        u64 pad_y : 1;
+        u64 pen : 1;
+        u64 tsc_x : 8;
+        u64 tsc_y : 8;
+        u64 cam : 12;
+    };
+} InputState;
+
 int emulator_init(int argc, char** argv);
 void emulator_quit();
 
 void emulator_reset();
 
+bool emulator_commit();
+void emulator_discard();
+
 void read_args(int argc, char** argv);
 void hotkey_press(SDL_KeyCode key);
-void update_input_keyboard(NDS* nds);
-void update_input_controller(NDS* nds, SDL_GameController* controller);
-void update_input_touch(NDS* nds, SDL_Rect* ts_bounds,
+void update_input_keyboard(InputState* in);
+void update_input_controller(InputState* in, SDL_GameController* controller);
+void update_input_touch(InputState* in, SDL_Rect* ts_bounds,
                         SDL_GameController* controller);
+void update_input_shm(InputState* in, ShmExport* e);
+void apply_input(NDS* nds, InputState in);
 
-void update_input_freecam();
+void update_input_freecam(NDS* nds, u32 cam);
 
 #endif
\ No newline at end of file
@@ -1,10 +1,22 @@
 #ifndef EMULATOR_STATE_H
 #define EMULATOR_STATE_H
 
+#include "capture.h"
 #include "gamecard.h"
+#include "gdbstub.h"
 #include "nds.h"
+#include "pacer.h"
+#include "rewind.h"
+#include "shmexport.h"
+#include "stretch.h"
 #include "types.h"
 
+#define FRAMESKIP_AUTO -1
+#define MAX_FRAMESKIP 16
+#define MAX_AUTO_FRAMESKIP 4
+#define MIN_SPEED 0.25
+#define MAX_SPEED 8
+
 typedef struct {
     char* romfile;
     char* romfilenodir;
@@ -18,8 +30,21 @@ typedef struct {
     bool debugger;
     bool frame_adv;
     bool abs_touch;
+    bool cache_model;
+    bool overlay;
+    BiosMode bios_mode;
+
+    int frameskip;
+
+    PaceMode pace_mode;
+    Pacer pacer;
 
-    u32 breakpoint;
+    double speed;
+    Stretch stretch;
+
+    Breakpoints bkpt;
+    Watchpoints watch;
+    Rewind rewind;
 
     NDS* nds;
     GameCard* card;
@@ -29,11 +54,38 @@ typedef struct {
 
     char* sd_path;
     int dldi_sd_fd;
-    u64 dldi_sd_size;
+    VFat* dldi_vfat;
+    Overlay sd_overlay;
+
+    char* trace_path;
+    Tracer* trace;
+
+    char* gxlog_path;
+    GXLog* gxlog;
+
+    char* ppulog_path;
+    PPULog* ppulog;
+
+    char* capture_path;
+    Capture* capture;
+
+    char* shm_name;
+    ShmExport* shm;
+
+    char* prof_path;
+    char* prof_syms9;
+    char* prof_syms7;
+    Profiler* prof;
+
+    char* cputrace_path;
+    int cputrace_cpu;
+    u32 cputrace_start;
+    u32 cputrace_last;
+    int cputrace_flags;
+    CpuTrace* cputrace;
 
-    bool wireframe;
-    bool freecam;
-    mat4 freecam_mtx;
+    int gdb_port;
+    GdbStub* gdb;
 
 } EmulatorState;
 
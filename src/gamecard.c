@@ -10,16 +10,7 @@
 
 #include "key1.h"
 
-GameCard* create_card(char* filename) {
-
-    int fd = open(filename, O_RDONLY);
-    if (fd < 0) return NULL;
-
-    GameCard* card = calloc(1, sizeof *card);
-    
-    struct stat st;
-    fstat(fd, &st);
-    u64 v = st.st_size;
+static u64 rom_alloc_size(u64 v) {
     v--;
     v |= v >> 1;
     v |= v >> 2;
@@ -29,13 +20,26 @@ GameCard* create_card(char* filename) {
     v |= v >> 32;
     v++;
     if (v < (1 << 17)) v = 1 << 17;
-    card->rom_size = v;
+    return v;
+}
+
+GameCard* create_card(char* filename, bool sav_overlay) {
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    GameCard* card = calloc(1, sizeof *card);
+    
+    struct stat st;
+    fstat(fd, &st);
+    card->rom_size = rom_alloc_size(st.st_size);
     card->rom = mmap(NULL, card->rom_size, PROT_READ | PROT_WRITE,
                      MAP_PRIVATE | MAP_ANON, -1, 0);
     card->rom = mmap(card->rom, st.st_size, PROT_READ | PROT_WRITE,
                      MAP_FIXED | MAP_PRIVATE, fd, 0);
     close(fd);
 
+    card->sav_overlay = sav_overlay;
     card->rom_filename = strdup(filename);
     int i = strrchr(filename, '.') - filename;
     card->sav_filename = malloc(i + sizeof ".sav");
@@ -56,21 +60,43 @@ GameCard* create_card(char* filename) {
         else if (card->eeprom_size <= (1 << 16)) card->addrtype = 2;
         else card->addrtype = 3;
         card->eeprom_detected = true;
+        // a private mapping keeps the written pages in memory only
         card->eeprom = mmap(NULL, card->eeprom_size, PROT_READ | PROT_WRITE,
-                            MAP_SHARED, fd, 0);
+                            sav_overlay ? MAP_PRIVATE : MAP_SHARED, fd, 0);
         close(fd);
     }
 
     return card;
 }
 
+// the rom is copied and the save is kept in memory only
+GameCard* create_card_from_buffer(const u8* data, u64 size) {
+    if (size < sizeof(CardHeader)) return NULL;
+
+    GameCard* card = calloc(1, sizeof *card);
+
+    card->rom_size = rom_alloc_size(size);
+    card->rom = mmap(NULL, card->rom_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANON, -1, 0);
+    memcpy(card->rom, data, size);
+
+    card->sav_new = true;
+    card->eeprom_size = 1 << 16;
+    card->eeprom = calloc(1 << 16, 1);
+    card->addrtype = 2;
+
+    return card;
+}
+
 void destroy_card(GameCard* card) {
-    if (card->sav_new) {
+    if (card->sav_new && card->sav_filename && !card->sav_overlay) {
         FILE* fp = fopen(card->sav_filename, "wb");
         if (fp) {
             fwrite(card->eeprom, 1, card->eeprom_size, fp);
             fclose(fp);
         }
+    }
+    if (card->sav_new) {
         free(card->eeprom);
     } else {
         munmap(card->eeprom, card->eeprom_size);
@@ -82,18 +108,38 @@ void destroy_card(GameCard* card) {
     free(card);
 }
 
+bool card_commit_save(GameCard* card) {
+    if (!card->sav_overlay || !card->sav_filename) return true;
+    int fd = open(card->sav_filename, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) return false;
+    bool ok = pwrite(fd, card->eeprom, card->eeprom_size, 0) ==
+              card->eeprom_size;
+    close(fd);
+    return ok;
+}
+
+void card_discard_save(GameCard* card) {
+    if (!card->sav_overlay) return;
+    int fd = card->sav_filename ? open(card->sav_filename, O_RDONLY) : -1;
+    if (fd < 0 || pread(fd, card->eeprom, card->eeprom_size, 0) !=
+                      card->eeprom_size) {
+        memset(card->eeprom, 0, card->eeprom_size);
+    }
+    if (fd >= 0) close(fd);
+}
+
 void encrypt_securearea(GameCard* card, u32* keys) {
     if (card->encrypted) return;
     card->encrypted = true;
 
     memcpy(&card->rom[0x4000], "encryObj", 8);
 
-    init_keycode(*(u32*) &card->rom[0xc], 3, 2, keys);
+    init_keycode(&card->key1, *(u32*) &card->rom[0xc], 3, 2, keys);
     for (int i = 0; i < 0x800; i += 8) {
-        encrypt64((u32*) &card->rom[0x4000 + i]);
+        encrypt64(&card->key1, (u32*) &card->rom[0x4000 + i]);
     }
-    init_keycode(*(u32*) &card->rom[0xc], 2, 2, keys);
-    encrypt64((u32*) &card->rom[0x4000]);
+    init_keycode(&card->key1, *(u32*) &card->rom[0xc], 2, 2, keys);
+    encrypt64(&card->key1, (u32*) &card->rom[0x4000]);
 }
 
 bool card_write_command(GameCard* card, u8* command) {
@@ -102,7 +148,7 @@ bool card_write_command(GameCard* card, u8* command) {
         for (int i = 0; i < 8; i++) {
             dec[i] = command[7 - i];
         }
-        decrypt64((u32*) dec);
+        decrypt64(&card->key1, (u32*) dec);
         for (int i = 0; i < 8; i++) {
             command[i] = dec[7 - i];
         }
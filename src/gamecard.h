@@ -1,6 +1,7 @@
 #ifndef GAMECARD_H
 #define GAMECARD_H
 
+#include "key1.h"
 #include "types.h"
 
 #define CHIPID 0x00001fc2
@@ -56,6 +57,8 @@ typedef struct {
     char* sav_filename;
 
     bool sav_new;
+    // the save file is only written on commit
+    bool sav_overlay;
 
     u8* rom;
     u64 rom_size;
@@ -68,6 +71,7 @@ typedef struct {
     u32 i;
     u32 len;
     bool key1mode;
+    Key1 key1;
 
     u8* eeprom;
     u32 eeprom_size;
@@ -86,9 +90,13 @@ typedef struct {
 
 } GameCard;
 
-GameCard* create_card(char* filename);
+GameCard* create_card(char* filename, bool sav_overlay);
+GameCard* create_card_from_buffer(const u8* data, u64 size);
 void destroy_card(GameCard* card);
 
+bool card_commit_save(GameCard* card);
+void card_discard_save(GameCard* card);
+
 void encrypt_securearea(GameCard* card, u32* keys);
 
 bool card_write_command(GameCard* card, u8* command);
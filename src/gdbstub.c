@@ -0,0 +1,519 @@
+#include "gdbstub.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "breakpoint.h"
+#include "nds.h"
+#include "watch.h"
+
+static const char target_xml[] =
+    "<?xml version=\"1.0\"?>"
+    "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">"
+    "<target version=\"1.0\"><architecture>arm</architecture>"
+    "<feature name=\"org.gnu.gdb.arm.core\">"
+    "<reg name=\"r0\" bitsize=\"32\"/><reg name=\"r1\" bitsize=\"32\"/>"
+    "<reg name=\"r2\" bitsize=\"32\"/><reg name=\"r3\" bitsize=\"32\"/>"
+    "<reg name=\"r4\" bitsize=\"32\"/><reg name=\"r5\" bitsize=\"32\"/>"
+    "<reg name=\"r6\" bitsize=\"32\"/><reg name=\"r7\" bitsize=\"32\"/>"
+    "<reg name=\"r8\" bitsize=\"32\"/><reg name=\"r9\" bitsize=\"32\"/>"
+    "<reg name=\"r10\" bitsize=\"32\"/><reg name=\"r11\" bitsize=\"32\"/>"
+    "<reg name=\"r12\" bitsize=\"32\"/>"
+    "<reg name=\"sp\" bitsize=\"32\" type=\"data_ptr\"/>"
+    "<reg name=\"lr\" bitsize=\"32\"/>"
+    "<reg name=\"pc\" bitsize=\"32\" type=\"code_ptr\"/>"
+    "<reg name=\"cpsr\" bitsize=\"32\" regnum=\"25\"/>"
+    "</feature></target>";
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static int hexval(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static u32 parse_hex(char** s) {
+    u32 v = 0;
+    int d;
+    while ((d = hexval(**s)) >= 0) {
+        v = v << 4 | d;
+        (*s)++;
+    }
+    return v;
+}
+
+// registers are sent as little endian bytes
+static char* put_reg(char* p, u32 v) {
+    for (int i = 0; i < 4; i++, v >>= 8) {
+        *p++ = hexdigits[v >> 4 & 15];
+        *p++ = hexdigits[v & 15];
+    }
+    *p = '\0';
+    return p;
+}
+
+static bool get_reg(char** s, u32* v) {
+    *v = 0;
+    for (int i = 0; i < 4; i++) {
+        int hi = hexval((*s)[0]);
+        int lo = hi < 0 ? -1 : hexval((*s)[1]);
+        if (lo < 0) return false;
+        *v |= (hi << 4 | lo) << 8 * i;
+        *s += 2;
+    }
+    return true;
+}
+
+static int get_char(GdbStub* g) {
+    if (g->buf_pos == g->buf_len) {
+        ssize_t n = recv(g->fd, g->buf, sizeof g->buf, 0);
+        if (n <= 0) {
+            g->closed = true;
+            return -1;
+        }
+        g->buf_len = n;
+        g->buf_pos = 0;
+    }
+    return g->buf[g->buf_pos++];
+}
+
+static void send_all(GdbStub* g, const char* data, size_t len) {
+    while (len) {
+        ssize_t n = send(g->fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            g->closed = true;
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static void send_packet(GdbStub* g, const char* data) {
+    char* pkt = g->send_buf;
+    size_t len = strlen(data);
+    u8 sum = 0;
+    pkt[0] = '$';
+    for (size_t i = 0; i < len; i++) {
+        pkt[i + 1] = data[i];
+        sum += data[i];
+    }
+    len = sprintf(pkt + len + 1, "#%02x", sum) + len + 1;
+    while (!g->closed) {
+        send_all(g, pkt, len);
+        if (g->noack) return;
+        int c;
+        while ((c = get_char(g)) != '+' && c != '-' && c >= 0);
+        if (c != '-') return;
+    }
+}
+
+// other characters between packets like acks or a late ctrl-c are ignored
+static bool read_packet(GdbStub* g, char* data) {
+    while (true) {
+        int c;
+        while ((c = get_char(g)) != '$') {
+            if (c < 0) return false;
+        }
+        int len = 0;
+        u8 sum = 0;
+        while ((c = get_char(g)) != '#') {
+            if (c < 0) return false;
+            if (len < GDB_PACKET_LEN - 1) data[len++] = c;
+            sum += c;
+        }
+        int hi = get_char(g);
+        int lo = get_char(g);
+        if (lo < 0) return false;
+        data[len] = '\0';
+        if (g->noack) return true;
+        if ((hexval(hi) << 4 | hexval(lo)) == sum) {
+            send_all(g, "+", 1);
+            return true;
+        }
+        send_all(g, "-", 1);
+    }
+}
+
+GdbStub* gdb_open(int port) {
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (lfd < 0) return NULL;
+    int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    struct sockaddr_in addr = {.sin_family = AF_INET,
+                               .sin_port = htons(port),
+                               .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    if (bind(lfd, (struct sockaddr*) &addr, sizeof addr) < 0 ||
+        listen(lfd, 1) < 0) {
+        close(lfd);
+        return NULL;
+    }
+    printf("Waiting for gdb on localhost:%d\n", port);
+    int fd = accept(lfd, NULL, NULL);
+    close(lfd);
+    if (fd < 0) return NULL;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+    GdbStub* g = calloc(1, sizeof *g);
+    g->fd = fd;
+    g->g_cpu = CPU9;
+    g->c_cpu = CPU9;
+    printf("gdb connected\n");
+    return g;
+}
+
+void gdb_close(GdbStub* g) {
+    if (!g) return;
+    close(g->fd);
+    free(g);
+}
+
+bool gdb_interrupted(GdbStub* g) {
+    u8 c;
+    ssize_t n = recv(g->fd, &c, 1, MSG_DONTWAIT);
+    if (n == 0) {
+        g->closed = true;
+        return true;
+    }
+    if (n == 1 && c == 0x03) {
+        g->interrupted = true;
+        return true;
+    }
+    return false;
+}
+
+static ArmCore* get_cpu(NDS* nds, int cpu) {
+    return cpu == CPU9 ? &nds->cpu9.c : &nds->cpu7.c;
+}
+
+static int parse_thread(char* s) {
+    if (s[0] == '-') return -1;
+    return parse_hex(&s);
+}
+
+// the pc is the address of the next instruction to execute
+static u32 read_reg(ArmCore* c, int r) {
+    if (r < 15) return c->r[r];
+    if (r == 15) return c->cur_instr_addr;
+    if (r == 25) return c->cpsr.w;
+    return 0;
+}
+
+static void write_reg(ArmCore* c, int r, u32 v) {
+    if (r < 15) {
+        c->r[r] = v;
+    } else if (r == 15) {
+        c->pc = v & ~1;
+        cpu_flush(c);
+    } else if (r == 25) {
+        CpuMode old = c->cpsr.m;
+        c->cpsr.w = v;
+        cpu_update_mode(c, old);
+        c->pc = c->cur_instr_addr;
+        cpu_flush(c);
+    }
+}
+
+static void make_stop(GdbStub* g, NDS* nds, Watchpoints* w) {
+    Breakpoints* b = nds->bkpt;
+    if (w->hit) {
+        static const char* kinds[] = {"", "rwatch", "watch", "awatch"};
+        snprintf(g->stop, sizeof g->stop, "T05%s:%08x;thread:%x;",
+                 kinds[w->wp[w->hit_wp].kind], w->hit_addr, w->hit_cpu + 1);
+        g->c_cpu = g->g_cpu = w->hit_cpu;
+    } else if (b->hit) {
+        snprintf(g->stop, sizeof g->stop, "T05thread:%x;",
+                 b->bp[b->hit_bp].cpu + 1);
+        g->c_cpu = g->g_cpu = b->bp[b->hit_bp].cpu;
+    } else {
+        snprintf(g->stop, sizeof g->stop, "T%02xthread:%x;",
+                 g->interrupted ? 2 : 5, g->c_cpu + 1);
+    }
+    b->hit = false;
+    w->hit = false;
+    nds->debug_stop = false;
+    g->interrupted = false;
+}
+
+// gdb's accesses don't change the cpu timing and io reads are peeked
+static void read_memory(NDS* nds, int cpu, char* s, char* out) {
+    u32 addr = parse_hex(&s);
+    s++;
+    u32 len = parse_hex(&s);
+    if (len > GDB_PACKET_LEN / 2 - 1) len = GDB_PACKET_LEN / 2 - 1;
+    for (u32 i = 0; i < len; i++) {
+        u8 b = bkpt_read(nds, cpu, addr + i, OPND_MEM8);
+        *out++ = hexdigits[b >> 4];
+        *out++ = hexdigits[b & 15];
+    }
+    *out = '\0';
+}
+
+static bool write_memory(NDS* nds, int cpu, char* s) {
+    u32 addr = parse_hex(&s);
+    if (*s++ != ',') return false;
+    u32 len = parse_hex(&s);
+    u8 data[GDB_PACKET_LEN / 2];
+    if (*s++ != ':' || len > sizeof data || strlen(s) < 2 * (size_t) len)
+        return false;
+    for (u32 i = 0; i < len; i++) {
+        int hi = hexval(s[2 * i]);
+        int lo = hexval(s[2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+        data[i] = hi << 4 | lo;
+    }
+    // breakpoints patched in by gdb and word sized pokes need full width
+    // writes for memory like vram
+    if (len == 4 && !(addr & 3)) {
+        bkpt_write(nds, cpu, addr,
+                   data[0] | data[1] << 8 | data[2] << 16 | data[3] << 24,
+                   OPND_MEM32);
+    } else if (len == 2 && !(addr & 1)) {
+        bkpt_write(nds, cpu, addr, data[0] | data[1] << 8, OPND_MEM16);
+    } else {
+        for (u32 i = 0; i < len; i++) {
+            bkpt_write(nds, cpu, addr + i, data[i], OPND_MEM8);
+        }
+    }
+    return true;
+}
+
+static int find_bkpt(Breakpoints* b, int cpu, u32 addr) {
+    for (int i = 0; i < b->n; i++) {
+        if (b->bp[i].cpu == cpu && b->bp[i].addr == (addr & ~1)) return i;
+    }
+    return -1;
+}
+
+static int find_watch(Watchpoints* w, int cpu, u32 addr, u32 len,
+                      WatchKind kind) {
+    for (int i = 0; i < w->n; i++) {
+        Watchpoint* wp = &w->wp[i];
+        if (wp->cpu == cpu && wp->start == addr && wp->last == addr + len - 1 &&
+            wp->kind == kind)
+            return i;
+    }
+    return -1;
+}
+
+// Z0/Z1 are breakpoints, Z2 write, Z3 read and Z4 access watchpoints
+static bool set_point(NDS* nds, Watchpoints* watch, char* s, bool add) {
+    int type = s[1] - '0';
+    s += 2;
+    if (*s++ != ',') return false;
+    u32 addr = parse_hex(&s);
+    if (*s++ != ',') return false;
+    u32 len = parse_hex(&s);
+    static const WatchKind kinds[] = {0, 0, WATCH_WRITE, WATCH_READ,
+                                      WATCH_ACCESS};
+    // the point is set on both cpus or neither
+    if (add && type <= 1) {
+        int n = nds->bkpt->n;
+        for (int cpu = CPU9; cpu <= CPU7; cpu++) {
+            if (find_bkpt(nds->bkpt, cpu, addr) < 0) n++;
+        }
+        if (n > BKPT_MAX) return false;
+    } else if (add && type <= 4) {
+        if (watch->n + 2 > WATCH_MAX) return false;
+    }
+    for (int cpu = CPU9; cpu <= CPU7; cpu++) {
+        if (type <= 1) {
+            if (add) {
+                if (find_bkpt(nds->bkpt, cpu, addr) < 0 &&
+                    bkpt_add(nds->bkpt, cpu, addr, NULL) < 0)
+                    return false;
+            } else {
+                bkpt_remove(nds->bkpt, find_bkpt(nds->bkpt, cpu, addr));
+            }
+        } else if (type <= 4) {
+            if (add) {
+                if (!watch_add(watch, cpu, addr, len, kinds[type]))
+                    return false;
+            } else {
+                watch_remove(watch,
+                             find_watch(watch, cpu, addr, len, kinds[type]));
+            }
+        } else return false;
+    }
+    return true;
+}
+
+// nds_step alternates between the cpus so this runs until the selected one
+// has executed once
+static void step_cpu(NDS* nds, int cpu) {
+    while (true) {
+        bool cur = nds->cur_cpu_type == cpu;
+        nds_step(nds);
+        if (cur || nds->debug_stop) return;
+    }
+}
+
+static void query(GdbStub* g, char* pkt, char* out) {
+    out[0] = '\0';
+    if (!strncmp(pkt, "qSupported", 10)) {
+        sprintf(out, "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+",
+                GDB_PACKET_LEN);
+    } else if (!strncmp(pkt, "qXfer:features:read:target.xml:", 31)) {
+        char* s = pkt + 31;
+        u32 off = parse_hex(&s);
+        s++;
+        u32 len = parse_hex(&s);
+        u32 total = sizeof target_xml - 1;
+        if (len > GDB_PACKET_LEN - 2) len = GDB_PACKET_LEN - 2;
+        if (off >= total) {
+            strcpy(out, "l");
+        } else {
+            if (len > total - off) len = total - off;
+            out[0] = off + len < total ? 'm' : 'l';
+            memcpy(out + 1, target_xml + off, len);
+            out[len + 1] = '\0';
+        }
+    } else if (!strcmp(pkt, "qfThreadInfo")) {
+        strcpy(out, "m1,2");
+    } else if (!strcmp(pkt, "qsThreadInfo")) {
+        strcpy(out, "l");
+    } else if (!strcmp(pkt, "qC")) {
+        sprintf(out, "QC%x", g->g_cpu + 1);
+    } else if (!strncmp(pkt, "qAttached", 9)) {
+        strcpy(out, "1");
+    } else if (!strncmp(pkt, "qThreadExtraInfo,", 17)) {
+        const char* name = parse_thread(pkt + 17) == 2 ? "ARM7" : "ARM9";
+        for (int i = 0; name[i]; i++) {
+            *out++ = hexdigits[name[i] >> 4];
+            *out++ = hexdigits[name[i] & 15];
+        }
+        *out = '\0';
+    }
+}
+
+GdbAction gdb_stopped(GdbStub* g, NDS* nds) {
+    char* pkt = g->pkt;
+    char* out = g->out;
+    Watchpoints* watch = nds->watch;
+
+    // gdb asks for the reason of the first stop itself
+    if (g->running || !g->stop[0]) make_stop(g, nds, watch);
+    if (g->running) send_packet(g, g->stop);
+    g->running = false;
+
+    GdbAction action = GDB_DETACH;
+    while (read_packet(g, pkt)) {
+        out[0] = '\0';
+        char* s = pkt + 1;
+        ArmCore* c = get_cpu(nds, g->g_cpu);
+        switch (pkt[0]) {
+            case '?':
+                strcpy(out, g->stop);
+                break;
+            case 'Q':
+                if (!strcmp(pkt, "QStartNoAckMode")) {
+                    send_packet(g, "OK");
+                    g->noack = true;
+                    continue;
+                }
+                break;
+            case 'q':
+                query(g, pkt, out);
+                break;
+            case 'H': {
+                int t = parse_thread(pkt + 2);
+                if (t > 0) {
+                    if (pkt[1] == 'g') g->g_cpu = t - 1;
+                    else g->c_cpu = t - 1;
+                }
+                strcpy(out, "OK");
+                break;
+            }
+            case 'T': {
+                int t = parse_thread(s);
+                strcpy(out, t == 1 || t == 2 ? "OK" : "E01");
+                break;
+            }
+            case 'g': {
+                char* p = out;
+                for (int r = 0; r < 16; r++) p = put_reg(p, read_reg(c, r));
+                put_reg(p, read_reg(c, 25));
+                break;
+            }
+            case 'G': {
+                u32 v;
+                for (int r = 0; r < 16 && get_reg(&s, &v); r++) {
+                    write_reg(c, r, v);
+                }
+                if (get_reg(&s, &v)) write_reg(c, 25, v);
+                strcpy(out, "OK");
+                break;
+            }
+            case 'p':
+                put_reg(out, read_reg(c, parse_hex(&s)));
+                break;
+            case 'P': {
+                int r = parse_hex(&s);
+                u32 v;
+                s++;
+                if (get_reg(&s, &v)) {
+                    write_reg(c, r, v);
+                    strcpy(out, "OK");
+                } else strcpy(out, "E01");
+                break;
+            }
+            case 'm':
+                read_memory(nds, g->g_cpu, s, out);
+                break;
+            case 'M':
+                strcpy(out, write_memory(nds, g->g_cpu, s) ? "OK" : "E01");
+                break;
+            case 'Z':
+            case 'z':
+                if (pkt[1] < '0' || pkt[1] > '4') break;
+                strcpy(out, set_point(nds, watch, pkt, pkt[0] == 'Z') ? "OK"
+                                                                      : "E01");
+                break;
+            case 's':
+                step_cpu(nds, g->c_cpu);
+                make_stop(g, nds, watch);
+                strcpy(out, g->stop);
+                break;
+            case 'c':
+                // nds_run checks for breakpoints before executing each
+                // instruction so the ones the cpus are stopped on are
+                // stepped over first
+                for (int cpu = CPU9; cpu <= CPU7 && !nds->debug_stop; cpu++) {
+                    if (find_bkpt(nds->bkpt, cpu,
+                                  get_cpu(nds, cpu)->cur_instr_addr) >= 0)
+                        step_cpu(nds, cpu);
+                }
+                if (!nds->debug_stop) {
+                    g->running = true;
+                    return GDB_CONTINUE;
+                }
+                make_stop(g, nds, watch);
+                strcpy(out, g->stop);
+                break;
+            case 'D':
+                send_packet(g, "OK");
+                action = GDB_DETACH;
+                return action;
+            case 'k':
+                action = GDB_KILL;
+                return action;
+            case 'v':
+                if (!strncmp(pkt, "vKill", 5)) {
+                    send_packet(g, "OK");
+                    action = GDB_KILL;
+                    return action;
+                }
+                break;
+        }
+        send_packet(g, out);
+    }
+    return action;
+}
@@ -0,0 +1,46 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include "types.h"
+
+#define GDB_PACKET_LEN 0x4000
+
+typedef enum { GDB_CONTINUE, GDB_DETACH, GDB_KILL } GdbAction;
+
+typedef struct _NDS NDS;
+
+// gdb remote serial protocol over a localhost tcp socket. the arm9 is thread
+// 1 and the arm7 thread 2, breakpoints and watchpoints from gdb are set on
+// both. the stub uses the breakpoints and watchpoints attached to the nds
+typedef struct {
+    int fd;
+    u8 buf[GDB_PACKET_LEN];
+    int buf_len;
+    int buf_pos;
+
+    bool noack;
+    bool running;
+    bool interrupted;
+    bool closed;
+
+    int g_cpu;
+    int c_cpu;
+    char stop[64];
+
+    char pkt[GDB_PACKET_LEN];
+    char out[GDB_PACKET_LEN + 1];
+    char send_buf[2 * GDB_PACKET_LEN];
+} GdbStub;
+
+// waits for gdb to connect
+GdbStub* gdb_open(int port);
+void gdb_close(GdbStub* g);
+
+// handles packets while the emulator is stopped until gdb continues,
+// detaches or kills it
+GdbAction gdb_stopped(GdbStub* g, NDS* nds);
+
+// checks for a ctrl-c from gdb while running without blocking
+bool gdb_interrupted(GdbStub* g);
+
+#endif
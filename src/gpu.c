@@ -5,14 +5,9 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "emulator_state.h"
 #include "io.h"
 #include "nds.h"
 
-pthread_t gpu_thread;
-pthread_mutex_t gpu_mutex = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t gpu_cond = PTHREAD_COND_INITIALIZER;
-
 const int cmd_parms[8][16] = {{0},
                               {1, 0, 1, 1, 1, 0, 16, 12, 16, 12, 9, 3, 3},
                               {1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1},
@@ -24,23 +19,53 @@ const int cmd_parms[8][16] = {{0},
 
 void* gpu_thread_run(void* data) {
     GPU* gpu = data;
-    pthread_mutex_lock(&gpu_mutex);
+    pthread_mutex_lock(&gpu->mutex);
     while (true) {
-        pthread_cond_wait(&gpu_cond, &gpu_mutex);
+        while (!gpu->render_pending && !gpu->thread_quit) {
+            pthread_cond_wait(&gpu->cond, &gpu->mutex);
+        }
+        if (gpu->thread_quit) break;
+        u64 host_start = gpu->master->trace ? trace_host_time() : 0;
         gpu_render(gpu);
+        if (gpu->master->trace) {
+            trace_host_span(gpu->master->trace, TRACE_RENDER, "Render",
+                            host_start, trace_host_time());
+        }
+        gpu->render_pending = false;
+        pthread_cond_signal(&gpu->cond);
     }
+    pthread_mutex_unlock(&gpu->mutex);
     return NULL;
 }
 
 void init_gpu_thread(GPU* gpu) {
-    pthread_create(&gpu_thread, NULL, gpu_thread_run, gpu);
-    pthread_detach(gpu_thread);
+    pthread_mutex_init(&gpu->mutex, NULL);
+    pthread_cond_init(&gpu->cond, NULL);
+    gpu->render_pending = false;
+    gpu->thread_quit = false;
+    gpu->threaded = true;
+    pthread_create(&gpu->thread, NULL, gpu_thread_run, gpu);
 }
 
-void destroy_gpu_thread() {
-    pthread_cancel(gpu_thread);
-    pthread_mutex_destroy(&gpu_mutex);
-    pthread_cond_destroy(&gpu_cond);
+void destroy_gpu_thread(GPU* gpu) {
+    if (!gpu->threaded) return;
+    pthread_mutex_lock(&gpu->mutex);
+    gpu->thread_quit = true;
+    pthread_cond_signal(&gpu->cond);
+    pthread_mutex_unlock(&gpu->mutex);
+    pthread_join(gpu->thread, NULL);
+    pthread_mutex_destroy(&gpu->mutex);
+    pthread_cond_destroy(&gpu->cond);
+    gpu->threaded = false;
+}
+
+void wait_gpu_render(GPU* gpu) {
+    if (!gpu->threaded) return;
+    pthread_mutex_lock(&gpu->mutex);
+    while (gpu->render_pending) {
+        pthread_cond_wait(&gpu->cond, &gpu->mutex);
+    }
+    pthread_mutex_unlock(&gpu->mutex);
 }
 
 void gpu_init_ptrs(GPU* gpu) {
@@ -95,8 +120,16 @@ void gxfifo_write(GPU* gpu, u32 command) {
 
 void gxcmd_execute_all(GPU* gpu) {
     if (!gpu->params_pending) {
+        u64 host_start = gpu->master->trace ? trace_host_time() : 0;
+        int n = 0;
         while (!gpu->blocked && gpu->cmd_fifo.size) {
             gxcmd_execute(gpu);
+            n++;
+        }
+        if (gpu->master->trace && n) {
+            trace_span(gpu->master->trace, TRACE_GX, "GX Batch",
+                       gpu->master->sched.now, gpu->master->sched.now,
+                       host_start, "\"commands\":%d", n);
         }
     }
 }
@@ -147,9 +180,9 @@ void update_mtxs(GPU* gpu) {
         }
     }
 
-    if (ntremu.freecam) {
+    if (gpu->freecam) {
         gpu->clipmtx = gpu->projmtx;
-        matmul(&gpu->clipmtx, &ntremu.freecam_mtx);
+        matmul(&gpu->clipmtx, &gpu->freecam_mtx);
         matmul(&gpu->clipmtx, &gpu->posmtx);
     }
 }
@@ -409,6 +442,7 @@ void normalize_vtxs(GPU* gpu) {
 void gxcmd_execute(GPU* gpu) {
     u8 cmd;
     FIFO_pop(gpu->cmd_fifo, cmd);
+    if (gpu->master->gxlog) gxlog_cmd(gpu->master->gxlog, gpu->master, cmd);
     u32 p0, p1, p2;
     switch (cmd) {
         case MTX_MODE:
@@ -1029,6 +1063,8 @@ void gxcmd_execute(GPU* gpu) {
 }
 
 void swap_buffers(GPU* gpu) {
+    if (gpu->master->gxlog) gxlog_frame(gpu->master->gxlog, gpu->master);
+
     normalize_vtxs(gpu);
 
     void* tmp = gpu->vertexram;
@@ -1042,10 +1078,26 @@ void swap_buffers(GPU* gpu) {
     gpu->n_polys = 0;
     gpu->master->io9.ram_count.w = 0;
 
+    if (gpu->master->skip_next && !gpu->master->io9.dispcapcnt.enable) {
+        gpu->render_skipped = true;
+        return;
+    }
+    gpu->render_skipped = false;
     gpu->drawing = true;
 
-    pthread_cond_signal(&gpu_cond);
-    pthread_mutex_unlock(&gpu_mutex);
+    if (gpu->threaded) {
+        pthread_mutex_lock(&gpu->mutex);
+        gpu->render_pending = true;
+        pthread_cond_signal(&gpu->cond);
+        pthread_mutex_unlock(&gpu->mutex);
+    } else {
+        u64 host_start = gpu->master->trace ? trace_host_time() : 0;
+        gpu_render(gpu);
+        if (gpu->master->trace) {
+            trace_host_span(gpu->master->trace, TRACE_RENDER, "Render",
+                            host_start, trace_host_time());
+        }
+    }
 }
 
 void render_line(GPU* gpu, vertex* v0, vertex* v1) {
@@ -1568,7 +1620,7 @@ void gpu_render(GPU* gpu) {
             }
         }
     }
-    if (ntremu.wireframe) {
+    if (gpu->wireframe) {
         for (int i = 0; i < gpu->n_polys_rendering; i++) {
             render_polygon_wireframe(gpu, &gpu->polygonram_rendering[i]);
         }
@@ -58,6 +58,8 @@ enum {
 };
 
 enum { MM_PROJ, MM_POS, MM_POSVEC, MM_TEX };
+
+extern const int cmd_parms[8][16];
 enum { POLY_TRIS, POLY_QUADS, POLY_TRI_STRIP, POLY_QUAD_STRIP };
 
 enum {
@@ -209,6 +211,18 @@ typedef struct {
     bool blocked;
     bool drawing;
     bool pending_swapbuffers;
+    bool render_skipped;
+
+    bool threaded;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool render_pending;
+    bool thread_quit;
+
+    bool wireframe;
+    bool freecam;
+    mat4 freecam_mtx;
 
     FIFO(u8, 256) cmd_fifo;
     FIFO(u32, 256) param_fifo;
@@ -267,12 +281,9 @@ typedef struct {
 
 } GPU;
 
-extern pthread_t gpu_thread;
-extern pthread_mutex_t gpu_mutex;
-extern pthread_cond_t gpu_cond;
-
 void init_gpu_thread(GPU* gpu);
-void destroy_gpu_thread();
+void destroy_gpu_thread(GPU* gpu);
+void wait_gpu_render(GPU* gpu);
 
 void gpu_init_ptrs(GPU* gpu);
 
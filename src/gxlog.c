@@ -0,0 +1,76 @@
+#include "gxlog.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nds.h"
+
+GXLog* gxlog_open(char* filename) {
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) return NULL;
+    GXLog* log = calloc(1, sizeof *log);
+    log->fp = fp;
+    log->first = true;
+    u32 hdr[2] = {GXLOG_MAGIC, GXLOG_VERSION};
+    fwrite(hdr, sizeof hdr, 1, fp);
+    return log;
+}
+
+void gxlog_close(GXLog* log) {
+    if (!log) return;
+    fclose(log->fp);
+    free(log);
+}
+
+// called before the command is executed, its parameters are still in the fifo
+void gxlog_cmd(GXLog* log, NDS* nds, u8 cmd) {
+    GPU* gpu = &nds->gpu;
+    u8 h = cmd >> 4;
+    u8 l = cmd & 0xf;
+    u8 rec[3] = {GXLOG_CMD, cmd, h < 8 ? cmd_parms[h][l] : 0};
+    fwrite(rec, 1, 3, log->fp);
+    for (int i = 0; i < rec[2]; i++) {
+        u32 idx = (gpu->param_fifo.head + i) & (FIFO_MAX(gpu->param_fifo) - 1);
+        u32 p = gpu->param_fifo.d[idx];
+        fwrite(&p, 4, 1, log->fp);
+    }
+}
+
+static void write_chunks(GXLog* log, u8* copy, u8* mem, u32 size, u8 slot,
+                         u16* count) {
+    for (u32 i = 0; i < size / GXLOG_CHUNK; i++) {
+        u8* src = mem + i * GXLOG_CHUNK;
+        u8* dst = copy + i * GXLOG_CHUNK;
+        if (!log->first && !memcmp(src, dst, GXLOG_CHUNK)) continue;
+        memcpy(dst, src, GXLOG_CHUNK);
+        u8 hdr[2] = {slot, i};
+        fwrite(hdr, 1, 2, log->fp);
+        fwrite(src, 1, GXLOG_CHUNK, log->fp);
+        (*count)++;
+    }
+}
+
+void gxlog_frame(GXLog* log, NDS* nds) {
+    u8 type = GXLOG_FRAME;
+    fwrite(&type, 1, 1, log->fp);
+    fwrite(&nds->io9.b[DISP3DCNT], 2, 1, log->fp);
+    fwrite(&nds->io9.b[EDGE_COLOR], 1, GXFIFO - EDGE_COLOR, log->fp);
+
+    // the count goes before the chunks so it is patched in afterwards
+    long count_pos = ftell(log->fp);
+    u16 count = 0;
+    fwrite(&count, 2, 1, log->fp);
+    for (int i = 0; i < 4; i++) {
+        write_chunks(log, log->tex[i], nds->gpu.texram[i], GXLOG_TEXSIZE, i,
+                     &count);
+    }
+    for (int i = 0; i < 6; i++) {
+        write_chunks(log, log->pal[i], (u8*) nds->gpu.texpal[i],
+                     GXLOG_PALSIZE, 4 + i, &count);
+    }
+    log->first = false;
+    long end_pos = ftell(log->fp);
+    fseek(log->fp, count_pos, SEEK_SET);
+    fwrite(&count, 2, 1, log->fp);
+    fseek(log->fp, end_pos, SEEK_SET);
+}
@@ -0,0 +1,40 @@
+#ifndef GXLOG_H
+#define GXLOG_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+#define GXLOG_MAGIC 0x58475452
+#define GXLOG_VERSION 1
+
+#define GXLOG_CHUNK (1 << 12)
+#define GXLOG_TEXSIZE (1 << 17)
+#define GXLOG_PALSIZE (1 << 14)
+#define GXLOG_SLOTS 10
+
+// the file starts with the magic and version as u32, followed by records.
+// a cmd record is the type, command, parameter count and the parameters as
+// u32. a frame record is written when the buffers are swapped and has the
+// type, disp3dcnt, the 3d registers from EDGE_COLOR to GXFIFO, the number of
+// vram chunks and the chunks, each being the slot (texture slots 0-3 and
+// palette slots 4-9), the chunk index and GXLOG_CHUNK bytes of data. only
+// chunks which changed since the previous frame are written
+enum { GXLOG_CMD, GXLOG_FRAME };
+
+typedef struct {
+    FILE* fp;
+    u8 tex[4][GXLOG_TEXSIZE];
+    u8 pal[6][GXLOG_PALSIZE];
+    bool first;
+} GXLog;
+
+typedef struct _NDS NDS;
+
+GXLog* gxlog_open(char* filename);
+void gxlog_close(GXLog* log);
+
+void gxlog_cmd(GXLog* log, NDS* nds, u8 cmd);
+void gxlog_frame(GXLog* log, NDS* nds);
+
+#endif
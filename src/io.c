@@ -5,6 +5,7 @@
 
 #include "bus7.h"
 #include "dldi.h"
+#include "memtiming.h"
 #include "nds.h"
 
 #define UPDATE_IRQ(x)                                                          \
@@ -157,14 +158,20 @@ void io7_write16(IO* io, u32 addr, u16 data) {
                 dma7_enable(&io->master->dma7, i);
             break;
         }
+        case TM0CNT:
+        case TM1CNT:
+        case TM2CNT:
+        case TM3CNT: {
+            int i = (addr - TM0CNT) / (TM1CNT - TM0CNT);
+            write_timer_reload(&io->master->tmc7, i, data);
+            break;
+        }
         case TM0CNT + 2:
         case TM1CNT + 2:
         case TM2CNT + 2:
         case TM3CNT + 2: {
             int i = (addr - TM0CNT - 2) / (TM1CNT - TM0CNT);
-            update_timer_count(&io->master->tmc7, i);
-            io->h[addr >> 1] = data;
-            update_timer_reload(&io->master->tmc7, i);
+            write_timer_cnt(&io->master->tmc7, i, data);
             break;
         }
         case KEYINPUT:
@@ -259,6 +266,7 @@ void io7_write16(IO* io, u32 addr, u16 data) {
         case EXMEMCNT:
             io->exmemcnt.h &= 0xff80;
             io->exmemcnt.h |= data & 0x7f;
+            update_gbaslot_waitstates(io->master);
             break;
         case IME:
             io->ime = data & 1;
@@ -343,11 +351,17 @@ u32 io7_read32(IO* io, u32 addr) {
             return data;
         }
         case DLDI_CTRL:
-            return dldi_get_status();
+            return dldi_get_status(&io->master->dldi);
             break;
         case DLDI_DATA:
-            return dldi_read_data();
-            break;
+            return dldi_read_data(&io->master->dldi);
+            break;
+        case DLDI_BUF:
+            return io->master->dldi.buf_addr;
+        case DLDI_COUNT:
+            return io->master->dldi.count;
+        case DLDI_CMD:
+            return io->master->dldi.result;
         default:
             return io7_read16(io, addr) | (io7_read16(io, addr | 2) << 16);
     }
@@ -383,10 +397,20 @@ void io7_write32(IO* io, u32 addr, u32 data) {
             UPDATE_IRQ(7);
             break;
         case DLDI_CTRL:
-            dldi_write_addr(data);
+            dldi_write_addr(&io->master->dldi, data);
             break;
         case DLDI_DATA:
-            dldi_write_data(data);
+            dldi_write_data(&io->master->dldi, data);
+            break;
+        case DLDI_BUF:
+            io->master->dldi.buf_addr = data;
+            break;
+        case DLDI_COUNT:
+            io->master->dldi.count = data;
+            break;
+        case DLDI_CMD:
+            dldi_command(&io->master->dldi, io->master,
+                         (ArmCore*) &io->master->cpu7, data);
             break;
         default:
             io7_write16(io, addr, data);
@@ -756,14 +780,20 @@ void io9_write16(IO* io, u32 addr, u16 data) {
                 dma9_enable(&io->master->dma9, i);
             break;
         }
+        case TM0CNT:
+        case TM1CNT:
+        case TM2CNT:
+        case TM3CNT: {
+            int i = (addr - TM0CNT) / (TM1CNT - TM0CNT);
+            write_timer_reload(&io->master->tmc9, i, data);
+            break;
+        }
         case TM0CNT + 2:
         case TM1CNT + 2:
         case TM2CNT + 2:
         case TM3CNT + 2: {
             int i = (addr - TM0CNT - 2) / (TM1CNT - TM0CNT);
-            update_timer_count(&io->master->tmc9, i);
-            io->h[addr >> 1] = data;
-            update_timer_reload(&io->master->tmc9, i);
+            write_timer_cnt(&io->master->tmc9, i, data);
             break;
         }
         case KEYINPUT:
@@ -832,6 +862,7 @@ void io9_write16(IO* io, u32 addr, u16 data) {
             io->exmemcnt.h = data;
             io->master->io7.exmemcnt.h &= 0x7f;
             io->master->io7.exmemcnt.h |= data & 0xff80;
+            update_gbaslot_waitstates(io->master);
             break;
         case IME:
             io->ime = data & 1;
@@ -914,11 +945,17 @@ u32 io9_read32(IO* io, u32 addr) {
             return data;
         }
         case DLDI_CTRL:
-            return dldi_get_status();
+            return dldi_get_status(&io->master->dldi);
             break;
         case DLDI_DATA:
-            return dldi_read_data();
-            break;
+            return dldi_read_data(&io->master->dldi);
+            break;
+        case DLDI_BUF:
+            return io->master->dldi.buf_addr;
+        case DLDI_COUNT:
+            return io->master->dldi.count;
+        case DLDI_CMD:
+            return io->master->dldi.result;
         default:
             return io9_read16(io, addr) | (io9_read16(io, addr | 2) << 16);
     }
@@ -969,13 +1006,62 @@ void io9_write32(IO* io, u32 addr, u32 data) {
             UPDATE_IRQ(9);
             break;
         case DLDI_CTRL:
-            dldi_write_addr(data);
+            dldi_write_addr(&io->master->dldi, data);
             break;
         case DLDI_DATA:
-            dldi_write_data(data);
+            dldi_write_data(&io->master->dldi, data);
+            break;
+        case DLDI_BUF:
+            io->master->dldi.buf_addr = data;
+            break;
+        case DLDI_COUNT:
+            io->master->dldi.count = data;
+            break;
+        case DLDI_CMD:
+            dldi_command(&io->master->dldi, io->master,
+                         (ArmCore*) &io->master->cpu9, data);
             break;
         default:
             io9_write16(io, addr, data);
             io9_write16(io, addr | 2, data >> 16);
     }
-}
\ No newline at end of file
+}
+
+static u16 peek16(IO* io, TimerController* tmc, u32 addr, bool arm9) {
+    if (TM0CNT <= addr && addr <= TM3CNT && !(addr & 3)) {
+        return timer_peek_count(tmc, (addr - TM0CNT) / (TM1CNT - TM0CNT));
+    }
+    return arm9 ? io9_read16(io, addr) : io7_read16(io, addr);
+}
+
+static u32 peek32(IO* io, TimerController* tmc, u32 fifo_next, u32 addr,
+                  bool arm9) {
+    switch (addr) {
+        case IPCFIFORECV:
+            return fifo_next;
+        case GAMECARDIN:
+        case DLDI_DATA:
+            return 0;
+        case DLDI_CTRL:
+            return dldi_peek_status(&io->master->dldi);
+        case DLDI_BUF:
+        case DLDI_COUNT:
+        case DLDI_CMD:
+            return arm9 ? io9_read32(io, addr) : io7_read32(io, addr);
+    }
+    return peek16(io, tmc, addr, arm9) | peek16(io, tmc, addr | 2, arm9) << 16;
+}
+
+u32 io7_peek32(IO* io, u32 addr) {
+    return peek32(io, &io->master->tmc7, FIFO_peek(io->master->ipcfifo9to7),
+                  addr, false);
+}
+
+u32 io9_peek32(IO* io, u32 addr) {
+    // the result matrices are only recomputed when read
+    if (CLIPMTX_RESULT <= addr && addr < VECMTX_RESULT + 0x24) {
+        update_mtxs(&io->master->gpu);
+    }
+    return peek32(io, &io->master->tmc9, FIFO_peek(io->master->ipcfifo7to9),
+                  addr, true);
+}
@@ -840,4 +840,10 @@ void io9_write16(IO* io, u32 addr, u16 data);
 u32 io9_read32(IO* io, u32 addr);
 void io9_write32(IO* io, u32 addr, u32 data);
 
+// reads an aligned word for the debugger without changing the emulated state.
+// the ipc fifo returns its next value without removing it and the card and
+// sd data registers read as 0
+u32 io7_peek32(IO* io, u32 addr);
+u32 io9_peek32(IO* io, u32 addr);
+
 #endif
\ No newline at end of file
@@ -3,10 +3,15 @@
 
 #include "types.h"
 
-void init_keycode(u32 idcode, int level, int mod, u32* keybuf);
-void apply_keycode(int mod);
-void encrypt64(u32* data);
-void decrypt64(u32* data);
+typedef struct {
+    u32 keybuf[0x412];
+    u32 keycode[3];
+} Key1;
+
+void init_keycode(Key1* key1, u32 idcode, int level, int mod, u32* keybuf);
+void apply_keycode(Key1* key1, int mod);
+void encrypt64(Key1* key1, u32* data);
+void decrypt64(Key1* key1, u32* data);
 u32 bswap32(u32 data);
 
 #endif
\ No newline at end of file
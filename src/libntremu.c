@@ -0,0 +1,193 @@
+#include "libntremu.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+#include "nds.h"
+
+struct _NtremuCtx {
+    NDS* nds;
+    GameCard* card;
+
+    u8* bios7;
+    u8* bios9;
+    u8* firmware;
+    bool hle;
+
+    // the part of the sound ring written by the last frame which wasn't
+    // returned yet
+    int audio_start;
+    int audio_end;
+
+    Capture* capture;
+};
+
+NtremuCtx* ntremu_create(void) {
+    NtremuCtx* ctx = calloc(1, sizeof *ctx);
+    if (!ctx) return NULL;
+    ctx->nds = calloc(1, sizeof *ctx->nds);
+    ctx->bios7 = calloc(1, BIOS7SIZE);
+    ctx->bios9 = calloc(1, BIOS9SIZE);
+    ctx->firmware = calloc(1, FIRMWARESIZE);
+    if (!ctx->nds || !ctx->bios7 || !ctx->bios9 || !ctx->firmware) {
+        ntremu_destroy(ctx);
+        return NULL;
+    }
+    bios_make_stub(ctx->bios7, ctx->bios9);
+    ctx->hle = true;
+    return ctx;
+}
+
+void ntremu_destroy(NtremuCtx* ctx) {
+    if (!ctx) return;
+    capture_close(ctx->capture);
+    if (ctx->nds) bios_hle_free(ctx->nds);
+    if (ctx->card) destroy_card(ctx->card);
+    free(ctx->nds);
+    free(ctx->bios7);
+    free(ctx->bios9);
+    free(ctx->firmware);
+    free(ctx);
+}
+
+bool ntremu_load_bios(NtremuCtx* ctx, const void* bios7, size_t len7,
+                      const void* bios9, size_t len9) {
+    if (!bios7 || !bios9) {
+        memset(ctx->bios7, 0, BIOS7SIZE);
+        memset(ctx->bios9, 0, BIOS9SIZE);
+        bios_make_stub(ctx->bios7, ctx->bios9);
+        ctx->hle = true;
+        return true;
+    }
+    if (len7 != BIOS7SIZE || len9 != BIOS9SIZE) return false;
+    memcpy(ctx->bios7, bios7, BIOS7SIZE);
+    memcpy(ctx->bios9, bios9, BIOS9SIZE);
+    ctx->hle = false;
+    return true;
+}
+
+bool ntremu_load_firmware(NtremuCtx* ctx, const void* firmware, size_t len) {
+    if (!firmware) {
+        memset(ctx->firmware, 0, FIRMWARESIZE);
+        return true;
+    }
+    if (len != FIRMWARESIZE) return false;
+    memcpy(ctx->firmware, firmware, FIRMWARESIZE);
+    return true;
+}
+
+bool ntremu_load_rom(NtremuCtx* ctx, const void* rom, size_t len) {
+    GameCard* card = create_card_from_buffer(rom, len);
+    if (!card) return false;
+    if (ctx->card) destroy_card(ctx->card);
+    ctx->card = card;
+    ntremu_reset(ctx);
+    return true;
+}
+
+void ntremu_reset(NtremuCtx* ctx) {
+    if (!ctx->card) return;
+    bios_hle_free(ctx->nds);
+    init_nds(ctx->nds, ctx->card, ctx->bios7, ctx->bios9, ctx->firmware, -1,
+             NULL, false);
+    bios_hle_init(ctx->nds, ctx->hle ? BIOS_HLE : BIOS_LLE);
+    ctx->audio_start = ctx->audio_end = ctx->nds->spu.sample_idx;
+}
+
+bool ntremu_run_frame(NtremuCtx* ctx) {
+    NDS* nds = ctx->nds;
+    if (!ctx->card || nds->cpuerr) return false;
+
+    ctx->audio_start = ctx->audio_end = nds->spu.sample_idx;
+    while (!nds->frame_complete) {
+        nds_run(nds);
+        ctx->audio_end = nds->spu.sample_idx;
+        if (nds->cpuerr) return false;
+        if (nds->samples_full) {
+            nds->samples_full = false;
+            if (ctx->capture) {
+                capture_audio(ctx->capture,
+                              &nds->spu.sample_buf[nds->spu.sample_full],
+                              SAMPLE_BUF_LEN);
+            }
+        }
+    }
+    nds->frame_complete = false;
+    if (ctx->capture) {
+        capture_frame(ctx->capture, &nds->screen_top[0][0],
+                      &nds->screen_bottom[0][0]);
+    }
+    return true;
+}
+
+bool ntremu_capture_start(NtremuCtx* ctx, const char* prefix) {
+    ntremu_capture_stop(ctx);
+    ctx->capture = capture_open((char*) prefix);
+    return ctx->capture;
+}
+
+void ntremu_capture_stop(NtremuCtx* ctx) {
+    capture_close(ctx->capture);
+    ctx->capture = NULL;
+}
+
+bool ntremu_get_error(NtremuCtx* ctx, int* cpu, uint32_t* addr) {
+    NDS* nds = ctx->nds;
+    if (!nds->cpuerr) return false;
+    if (cpu) *cpu = nds->cpuerr_cpu == CPU7 ? 7 : 9;
+    if (addr) *addr = nds->cpuerr_addr;
+    return true;
+}
+
+void ntremu_set_keys(NtremuCtx* ctx, uint32_t keys) {
+    NDS* nds = ctx->nds;
+    nds->io7.keyinput.h = ~keys & 0x3ff;
+    nds->io9.keyinput = nds->io7.keyinput;
+    nds->io7.extkeyin.x = !(keys & NTREMU_KEY_X);
+    nds->io7.extkeyin.y = !(keys & NTREMU_KEY_Y);
+}
+
+void ntremu_set_touch(NtremuCtx* ctx, bool pressed, int x, int y) {
+    NDS* nds = ctx->nds;
+    if (x < 0 || x >= NDS_SCREEN_W || y < 0 || y >= NDS_SCREEN_H)
+        pressed = false;
+    nds->io7.extkeyin.pen = !pressed;
+    if (pressed) {
+        nds->tsc.x = x;
+        nds->tsc.y = y;
+    } else {
+        nds->tsc.x = -1;
+        nds->tsc.y = -1;
+    }
+}
+
+const uint16_t* ntremu_get_framebuffer(NtremuCtx* ctx, NtremuScreen screen) {
+    if (screen == NTREMU_SCREEN_BOTTOM) return &ctx->nds->screen_bottom[0][0];
+    return &ctx->nds->screen_top[0][0];
+}
+
+const float* ntremu_get_audio(NtremuCtx* ctx, size_t* frames) {
+    int start = ctx->audio_start;
+    int end = ctx->audio_end;
+    if (end < start) end = SAMPLE_BUFS * SAMPLE_BUF_LEN;
+    ctx->audio_start = end % (SAMPLE_BUFS * SAMPLE_BUF_LEN);
+    if (frames) *frames = (end - start) / 2;
+    return &ctx->nds->spu.sample_buf[start];
+}
+
+size_t ntremu_state_size(NtremuCtx* ctx) {
+    return nds_state_size(ctx->nds);
+}
+
+bool ntremu_state_get(NtremuCtx* ctx, void* buf, size_t len) {
+    if (!ctx->card || len < nds_state_size(ctx->nds)) return false;
+    nds_save_state(ctx->nds, buf);
+    return true;
+}
+
+bool ntremu_state_set(NtremuCtx* ctx, const void* buf, size_t len) {
+    if (!ctx->card || !nds_load_state(ctx->nds, buf, len)) return false;
+    ctx->audio_start = ctx->audio_end = ctx->nds->spu.sample_idx;
+    return true;
+}
@@ -0,0 +1,76 @@
+#ifndef LIBNTREMU_H
+#define LIBNTREMU_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define NTREMU_API_VERSION 2
+
+#define NTREMU_SCREEN_W 256
+#define NTREMU_SCREEN_H 192
+#define NTREMU_SAMPLE_FREQ 32768
+
+typedef struct _NtremuCtx NtremuCtx;
+
+enum {
+    NTREMU_KEY_A = 1 << 0,
+    NTREMU_KEY_B = 1 << 1,
+    NTREMU_KEY_SELECT = 1 << 2,
+    NTREMU_KEY_START = 1 << 3,
+    NTREMU_KEY_RIGHT = 1 << 4,
+    NTREMU_KEY_LEFT = 1 << 5,
+    NTREMU_KEY_UP = 1 << 6,
+    NTREMU_KEY_DOWN = 1 << 7,
+    NTREMU_KEY_R = 1 << 8,
+    NTREMU_KEY_L = 1 << 9,
+    NTREMU_KEY_X = 1 << 10,
+    NTREMU_KEY_Y = 1 << 11,
+};
+
+typedef enum { NTREMU_SCREEN_TOP, NTREMU_SCREEN_BOTTOM } NtremuScreen;
+
+// contexts are independent of each other and can be used from different
+// threads, a single context must not be used from two threads at once
+NtremuCtx* ntremu_create(void);
+void ntremu_destroy(NtremuCtx* ctx);
+
+// all data is copied. without bios images the hle bios is used, without a
+// firmware image a blank one is used. these take effect on the next reset
+bool ntremu_load_bios(NtremuCtx* ctx, const void* bios7, size_t len7,
+                      const void* bios9, size_t len9);
+bool ntremu_load_firmware(NtremuCtx* ctx, const void* firmware, size_t len);
+
+// loads the rom and resets, the save is kept in memory
+bool ntremu_load_rom(NtremuCtx* ctx, const void* rom, size_t len);
+void ntremu_reset(NtremuCtx* ctx);
+
+// returns false if the emulated cpu hit an error
+bool ntremu_run_frame(NtremuCtx* ctx);
+
+// returns true if the emulated cpu hit an invalid instruction fetch, cpu is
+// set to 7 or 9 and addr to the fetch address
+bool ntremu_get_error(NtremuCtx* ctx, int* cpu, uint32_t* addr);
+
+// keys is a mask of NTREMU_KEY_* for the currently pressed keys
+void ntremu_set_keys(NtremuCtx* ctx, uint32_t keys);
+void ntremu_set_touch(NtremuCtx* ctx, bool pressed, int x, int y);
+
+// BGR555, NTREMU_SCREEN_W x NTREMU_SCREEN_H, valid until the next frame
+const uint16_t* ntremu_get_framebuffer(NtremuCtx* ctx, NtremuScreen screen);
+// interleaved stereo samples produced by the last frame, returned in place
+// from the core's sound ring. when they wrap around the end of the ring the
+// rest is returned by a second call, after which frames is 0
+const float* ntremu_get_audio(NtremuCtx* ctx, size_t* frames);
+
+// writes every following frame to <prefix>.y4m and its audio to <prefix>.wav
+// from a background thread until stopped or the context is destroyed
+bool ntremu_capture_start(NtremuCtx* ctx, const char* prefix);
+void ntremu_capture_stop(NtremuCtx* ctx);
+
+// the size changes when the save type is detected
+size_t ntremu_state_size(NtremuCtx* ctx);
+bool ntremu_state_get(NtremuCtx* ctx, void* buf, size_t len);
+bool ntremu_state_set(NtremuCtx* ctx, const void* buf, size_t len);
+
+#endif
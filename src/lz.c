@@ -0,0 +1,123 @@
+#include "lz.h"
+
+#include <string.h>
+
+#define MIN_MATCH 4
+#define MAX_OFFSET 0xffff
+
+static inline u32 load32(const u8* p) {
+    u32 v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline u64 load64(const u8* p) {
+    u64 v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline u32 hash(u32 v) {
+    return v * 2654435761u >> (32 - LZ_HASH_BITS);
+}
+
+static u8* put_len(u8* op, size_t n) {
+    for (; n >= 255; n -= 255) *op++ = 255;
+    *op++ = n;
+    return op;
+}
+
+static u8* put_literals(u8* op, const u8* lit, size_t n, size_t mlen) {
+    *op++ = (n < 15 ? n : 15) << 4 | (mlen < 15 ? mlen : 15);
+    if (n >= 15) op = put_len(op, n - 15);
+    memcpy(op, lit, n);
+    return op + n;
+}
+
+size_t lz_compress(const u8* src, size_t len, u8* dst, u32* table) {
+    memset(table, 0, sizeof(u32) << LZ_HASH_BITS);
+    const u8* ip = src;
+    const u8* anchor = src;
+    const u8* end = src + len;
+    u8* op = dst;
+
+    // positions are only hashed while a whole word can be read
+    while (len >= 8 && ip <= end - 8) {
+        u32 v = load32(ip);
+        u32 h = hash(v);
+        const u8* ref = src + table[h];
+        table[h] = ip - src;
+        if (ref >= ip || ip - ref > MAX_OFFSET || load32(ref) != v) {
+            // skip faster through data that doesn't compress
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        size_t mlen = MIN_MATCH;
+        while (ip + mlen + 8 <= end) {
+            u64 x = load64(ref + mlen) ^ load64(ip + mlen);
+            if (x) {
+                mlen += __builtin_ctzll(x) >> 3;
+                goto matched;
+            }
+            mlen += 8;
+        }
+        while (ip + mlen < end && ref[mlen] == ip[mlen]) mlen++;
+    matched:
+
+        op = put_literals(op, anchor, ip - anchor, mlen - MIN_MATCH);
+        *op++ = (ip - ref) & 0xff;
+        *op++ = (ip - ref) >> 8;
+        if (mlen - MIN_MATCH >= 15) op = put_len(op, mlen - MIN_MATCH - 15);
+        ip += mlen;
+        anchor = ip;
+    }
+    op = put_literals(op, anchor, end - anchor, 0);
+    return op - dst;
+}
+
+static bool get_len(const u8** ip, const u8* end, size_t* n) {
+    u8 b;
+    do {
+        if (*ip == end) return false;
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return true;
+}
+
+size_t lz_decompress(const u8* src, size_t len, u8* dst, size_t cap) {
+    const u8* ip = src;
+    const u8* end = src + len;
+    u8* op = dst;
+    u8* op_end = dst + cap;
+
+    while (ip < end) {
+        u8 token = *ip++;
+        size_t n = token >> 4;
+        if (n == 15 && !get_len(&ip, end, &n)) return 0;
+        if (n > (size_t) (end - ip) || n > (size_t) (op_end - op)) return 0;
+        memcpy(op, ip, n);
+        ip += n;
+        op += n;
+        if (ip == end) break;
+
+        if (end - ip < 2) return 0;
+        size_t off = ip[0] | ip[1] << 8;
+        ip += 2;
+        size_t mlen = token & 15;
+        if (mlen == 15 && !get_len(&ip, end, &mlen)) return 0;
+        mlen += MIN_MATCH;
+        if (!off || off > (size_t) (op - dst) || mlen > (size_t) (op_end - op))
+            return 0;
+        // matches can overlap the bytes they produce, which repeat every off
+        // bytes so the copies double in length
+        const u8* ref = op - off;
+        while (mlen) {
+            size_t n = op - ref < mlen ? op - ref : mlen;
+            memcpy(op, ref, n);
+            op += n;
+            mlen -= n;
+        }
+    }
+    return op - dst;
+}
@@ -0,0 +1,24 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+
+#include "types.h"
+
+#define LZ_HASH_BITS 14
+
+// the output of lz_compress is at most this long
+#define LZ_BOUND(len) ((len) + (len) / 255 + 16)
+
+// lz77 in the lz4 block layout, each sequence is a token with the literal
+// and match lengths in the high and low nibble, extra literal length bytes,
+// the literals, a 16 bit offset and extra match length bytes. lengths of 15
+// or more continue in bytes which are added until one is less than 255. the
+// last sequence only has literals. table is scratch space for the matcher
+size_t lz_compress(const u8* src, size_t len, u8* dst, u32* table);
+
+// returns the decompressed length or 0 if the data is invalid or more than
+// cap bytes
+size_t lz_decompress(const u8* src, size_t len, u8* dst, size_t cap);
+
+#endif
@@ -1,14 +1,35 @@
 #include <SDL2/SDL.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "debugger.h"
 #include "emulator.h"
 #include "nds.h"
+#include "triplebuf.h"
 #include "types.h"
 
+#define HOTKEY_QUEUE 64
+// enough for one buffer of samples stretched to MIN_SPEED
+#define AUDIO_OUT_LEN (SAMPLE_BUF_LEN / 2 * 4 + 2 * STRETCH_HOP)
+
 char wintitle[200];
 
+// the emulation thread owns the nds and runs the debugger, the main thread
+// only presents frames and samples input
+TripleBuf frames;
+SDL_AudioDeviceID audio;
+atomic_ulong input;
+atomic_ulong frame_count;
+atomic_bool quit_requested;
+atomic_bool emu_done;
+
+// key presses are passed to the emulation thread which handles the hotkeys
+SDL_KeyCode hotkeys[HOTKEY_QUEUE];
+atomic_uint hotkey_head;
+atomic_uint hotkey_tail;
+
 static inline void center_screen_in_window(int windowW, int windowH,
                                            SDL_Rect* dst) {
     if (windowW * (2 * NDS_SCREEN_H) / NDS_SCREEN_W > windowH) {
@@ -24,151 +45,176 @@ static inline void center_screen_in_window(int windowW, int windowH,
     }
 }
 
-int main(int argc, char** argv) {
-
-    if (emulator_init(argc, argv) < 0) return -1;
-
-    init_gpu_thread(&ntremu.nds->gpu);
-
-    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER);
+void push_hotkey(SDL_KeyCode key) {
+    unsigned tail = atomic_load_explicit(&hotkey_tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&hotkey_head, memory_order_acquire) ==
+        HOTKEY_QUEUE)
+        return;
+    hotkeys[tail % HOTKEY_QUEUE] = key;
+    atomic_store_explicit(&hotkey_tail, tail + 1, memory_order_release);
+}
 
-    SDL_GameController* controller = NULL;
-    if (SDL_NumJoysticks() > 0) {
-        controller = SDL_GameControllerOpen(0);
+void handle_hotkeys() {
+    unsigned head = atomic_load_explicit(&hotkey_head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&hotkey_tail, memory_order_acquire);
+    for (; head != tail; head++) {
+        hotkey_press(hotkeys[head % HOTKEY_QUEUE]);
     }
+    atomic_store_explicit(&hotkey_head, head, memory_order_release);
+}
 
-    SDL_Window* window;
-    SDL_Renderer* renderer;
-    SDL_CreateWindowAndRenderer(NDS_SCREEN_W * 2, NDS_SCREEN_H * 4,
-                                SDL_WINDOW_RESIZABLE, &window, &renderer);
-    snprintf(wintitle, 199, "ntremu | %s | %.2lf FPS", ntremu.romfilenodir,
-             0.0);
-    SDL_SetWindowTitle(window, wintitle);
-    SDL_RenderClear(renderer);
-    SDL_RenderPresent(renderer);
-
-    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_BGR555,
-                                             SDL_TEXTUREACCESS_STREAMING,
-                                             NDS_SCREEN_W, 2 * NDS_SCREEN_H);
-
-    SDL_AudioSpec audio_spec = {.freq = SAMPLE_FREQ,
-                                .format = AUDIO_F32,
-                                .channels = 2,
-                                .samples = SAMPLE_BUF_LEN / 2};
-    SDL_AudioDeviceID audio =
-        SDL_OpenAudioDevice(NULL, 0, &audio_spec, NULL, 0);
-    SDL_PauseAudioDevice(audio, 0);
+// audio at any speed other than 1x is time stretched to keep its pitch. when
+// uncapped the measured speed is used and audio is dropped if it gets behind
+void queue_audio(float* samples, double speed) {
+    static float out[2 * AUDIO_OUT_LEN];
+    if (ntremu.uncap &&
+        SDL_GetQueuedAudioSize(audio) >= 16 * SAMPLE_BUF_LEN)
+        return;
+    if (speed == 1) {
+        stretch_init(&ntremu.stretch, 1);
+        SDL_QueueAudio(audio, samples, SAMPLE_BUF_LEN * 4);
+        return;
+    }
+    stretch_set_speed(&ntremu.stretch, speed);
+    int n = stretch_process(&ntremu.stretch, samples, SAMPLE_BUF_LEN / 2, out,
+                            AUDIO_OUT_LEN);
+    SDL_QueueAudio(audio, out, n * 2 * sizeof *out);
+}
 
+void* emu_thread(void* arg) {
     Uint64 prev_time = SDL_GetPerformanceCounter();
-    Uint64 prev_fps_update = prev_time;
-    Uint64 prev_fps_frame = 0;
-    const Uint64 frame_ticks = SDL_GetPerformanceFrequency() / 60;
-    Uint64 frame = 0;
+    const Uint64 frame_ticks =
+        SDL_GetPerformanceFrequency() * FRAME_CYCLES / NDS_CLOCK;
 
-    bool bkpthit = false;
+    double uncap_speed = 1;
 
-    ntremu.running = !ntremu.debugger;
+    ntremu.running = !ntremu.debugger && !ntremu.gdb;
+    bool quit = false;
     while (true) {
         while (ntremu.running) {
             Uint64 cur_time;
             Uint64 elapsed;
 
-            bkpthit = false;
+            if (atomic_exchange(&quit_requested, false)) {
+                ntremu.running = false;
+                quit = true;
+                break;
+            }
+            if (ntremu.gdb && gdb_interrupted(ntremu.gdb)) {
+                ntremu.running = false;
+                break;
+            }
+            handle_hotkeys();
+            InputState in = {.w = atomic_load(&input)};
+            if (ntremu.shm) update_input_shm(&in, ntremu.shm);
+            // the history can only replay input changed between batches
+            if (!ntremu.debugger ||
+                rewind_at_batch(&ntremu.rewind, ntremu.nds)) {
+                apply_input(ntremu.nds, in);
+                if (ntremu.debugger) rewind_input(&ntremu.rewind, ntremu.nds);
+            }
 
-            bool play_audio = !(ntremu.pause || ntremu.mute || ntremu.uncap);
+            bool play_audio = !(ntremu.pause || ntremu.mute);
+            double speed = ntremu.uncap ? uncap_speed : ntremu.speed;
+            Uint64 target = frame_ticks / ntremu.speed;
+            if (ntremu.pacer.speed != ntremu.speed)
+                pacer_set_speed(&ntremu.pacer, ntremu.speed);
 
+            // skipped frames aren't presented, their screen buffers are stale
+            bool drawn = ntremu.pause;
             if (!(ntremu.pause)) {
+                int frames_run = 0;
                 do {
                     while (!ntremu.nds->frame_complete) {
-                        if (ntremu.debugger) {
-                            if (ntremu.nds->cur_cpu->cur_instr_addr ==
-                                ntremu.breakpoint) {
-                                bkpthit = true;
-                                break;
-                            }
-                            nds_step(ntremu.nds);
-                        } else {
-                            nds_run(ntremu.nds);
-                        }
+                        nds_run(ntremu.nds);
                         if (ntremu.nds->cpuerr) break;
+                        if (ntremu.debugger && !ntremu.nds->debug_stop)
+                            rewind_update(&ntremu.rewind, ntremu.nds);
                         if (ntremu.nds->samples_full) {
                             ntremu.nds->samples_full = false;
+                            SPU* spu = &ntremu.nds->spu;
+                            float* block = &spu->sample_buf[spu->sample_full];
+                            if (ntremu.shm) {
+                                shmexport_audio(ntremu.shm, block,
+                                                SAMPLE_BUF_LEN);
+                            }
+                            if (ntremu.capture) {
+                                capture_audio(ntremu.capture, block,
+                                              SAMPLE_BUF_LEN);
+                            }
                             if (play_audio) {
-                                SDL_QueueAudio(audio,
-                                               ntremu.nds->spu.sample_buf,
-                                               SAMPLE_BUF_LEN * 4);
+                                queue_audio(block, speed);
                             }
                         }
+                        if (ntremu.nds->debug_stop) break;
                     }
-                    if (bkpthit || ntremu.nds->cpuerr) break;
+                    if (ntremu.nds->debug_stop || ntremu.nds->cpuerr) break;
                     ntremu.nds->frame_complete = false;
-                    frame++;
+                    if (!ntremu.nds->skip_draw) drawn = true;
+                    if (ntremu.shm && !ntremu.nds->skip_draw) {
+                        shmexport_frame(ntremu.shm,
+                                        &ntremu.nds->screen_top[0][0],
+                                        &ntremu.nds->screen_bottom[0][0]);
+                    }
+                    if (ntremu.capture) {
+                        capture_frame(ntremu.capture,
+                                      &ntremu.nds->screen_top[0][0],
+                                      &ntremu.nds->screen_bottom[0][0]);
+                    }
+                    atomic_fetch_add(&frame_count, 1);
+                    frames_run++;
 
                     cur_time = SDL_GetPerformanceCounter();
                     elapsed = cur_time - prev_time;
                 } while (ntremu.uncap && elapsed < frame_ticks);
-            }
-            if (bkpthit || ntremu.nds->cpuerr) break;
-
-            void* pixels;
-            int pitch;
-            SDL_LockTexture(texture, NULL, &pixels, &pitch);
-            memcpy(pixels, ntremu.nds->screen_top,
-                   sizeof ntremu.nds->screen_top);
-            memcpy(pixels + sizeof ntremu.nds->screen_top,
-                   ntremu.nds->screen_bottom, sizeof ntremu.nds->screen_bottom);
-            SDL_UnlockTexture(texture);
-
-            int windowW, windowH;
-            SDL_GetWindowSize(window, &windowW, &windowH);
-            SDL_Rect dst;
-            center_screen_in_window(windowW, windowH, &dst);
-            SDL_RenderClear(renderer);
-            SDL_RenderCopy(renderer, texture, NULL, &dst);
-            SDL_RenderPresent(renderer);
+                if (ntremu.uncap && elapsed) {
+                    uncap_speed = (double) frames_run * frame_ticks / elapsed;
+                    if (uncap_speed < 1) uncap_speed = 1;
+                }
 
-            SDL_Event e;
-            while (SDL_PollEvent(&e)) {
-                if (e.type == SDL_QUIT) ntremu.running = false;
-                if (e.type == SDL_KEYDOWN) hotkey_press(e.key.keysym.sym);
+                if (ntremu.frameskip != FRAMESKIP_AUTO) {
+                    ntremu.nds->frameskip = ntremu.frameskip;
+                } else if (ntremu.uncap) {
+                    ntremu.nds->frameskip = frames_run - 1;
+                    if (ntremu.nds->frameskip > MAX_FRAMESKIP)
+                        ntremu.nds->frameskip = MAX_FRAMESKIP;
+                } else if (elapsed > target) {
+                    if (ntremu.nds->frameskip < MAX_AUTO_FRAMESKIP)
+                        ntremu.nds->frameskip++;
+                } else if (elapsed < target * 3 / 4) {
+                    if (ntremu.nds->frameskip > 0) ntremu.nds->frameskip--;
+                }
             }
-            if (ntremu.freecam) {
-                update_input_freecam();
-            } else {
-                update_input_keyboard(ntremu.nds);
+            if (ntremu.nds->debug_stop || ntremu.nds->cpuerr) break;
+
+            if (drawn) {
+                u8* back = triplebuf_back(&frames);
+                memcpy(back, ntremu.nds->screen_top,
+                       sizeof ntremu.nds->screen_top);
+                memcpy(back + sizeof ntremu.nds->screen_top,
+                       ntremu.nds->screen_bottom,
+                       sizeof ntremu.nds->screen_bottom);
+                triplebuf_publish(&frames);
             }
-            if (controller) update_input_controller(ntremu.nds, controller);
-            dst.h /= 2;
-            dst.y += dst.h;
-            update_input_touch(ntremu.nds, &dst, controller);
 
-            if (!ntremu.uncap) {
+            if (ntremu.uncap) {
+                pacer_reset(&ntremu.pacer);
+            } else {
+                // the audio queue only holds emulation back if the host audio
+                // clock is slower than the emulated one
                 if (play_audio) {
                     while (SDL_GetQueuedAudioSize(audio) >= 16 * SAMPLE_BUF_LEN)
                         SDL_Delay(1);
-                } else {
-                    cur_time = SDL_GetPerformanceCounter();
-                    elapsed = cur_time - prev_time;
-                    Sint64 wait = frame_ticks - elapsed;
-                    Sint64 waitMS =
-                        wait * 1000 / (Sint64) SDL_GetPerformanceFrequency();
-                    if (waitMS > 1 && !ntremu.uncap) {
-                        SDL_Delay(waitMS);
-                    }
+                }
+                u64 dt = pacer_wait(&ntremu.pacer);
+                if (ntremu.trace && dt) {
+                    trace_host_counter(ntremu.trace, "Frame time",
+                                       ntremu.pacer.last,
+                                       "\"ms\":%.3f,\"stddev_ms\":%.3f",
+                                       dt / 1e6, pacer_stddev(&ntremu.pacer));
                 }
             }
-            cur_time = SDL_GetPerformanceCounter();
-            elapsed = cur_time - prev_fps_update;
-            if (elapsed >= SDL_GetPerformanceFrequency() / 2) {
-                double fps = (double) SDL_GetPerformanceFrequency() *
-                             (frame - prev_fps_frame) / elapsed;
-                snprintf(wintitle, 199, "ntremu | %s | %.2lf FPS",
-                         ntremu.romfilenodir, fps);
-                SDL_SetWindowTitle(window, wintitle);
-                prev_fps_update = cur_time;
-                prev_fps_frame = frame;
-            }
-            prev_time = cur_time;
+            prev_time = SDL_GetPerformanceCounter();
 
             if (ntremu.frame_adv) {
                 ntremu.running = false;
@@ -176,17 +222,152 @@ int main(int argc, char** argv) {
             }
         }
 
-        if (ntremu.debugger) {
-            ntremu.running = false;
-            if (bkpthit) {
-                printf("Breakpoint hit: %08x\n", ntremu.breakpoint);
+        if (ntremu.gdb) {
+            if (quit) break;
+            GdbAction action = gdb_stopped(ntremu.gdb, ntremu.nds);
+            if (action == GDB_KILL) break;
+            if (action == GDB_DETACH) {
+                gdb_close(ntremu.gdb);
+                ntremu.gdb = NULL;
+                bkpt_clear(&ntremu.bkpt);
+                watch_clear(&ntremu.watch);
+                if (!ntremu.debugger) {
+                    ntremu.nds->bkpt = NULL;
+                    ntremu.nds->watch = NULL;
+                }
+                ntremu.nds->debug_stop = false;
             }
+            ntremu.running = true;
+            prev_time = SDL_GetPerformanceCounter();
+            pacer_reset(&ntremu.pacer);
+        } else if (ntremu.debugger) {
+            ntremu.running = false;
+            if (ntremu.bkpt.hit) print_bkpt_hit(&ntremu.bkpt);
+            if (ntremu.watch.hit) print_watch_hit(&ntremu.watch);
             debugger_run();
+            // accesses made by the debugger itself also hit
+            ntremu.bkpt.hit = false;
+            ntremu.watch.hit = false;
+            ntremu.nds->debug_stop = false;
+            prev_time = SDL_GetPerformanceCounter();
+            pacer_reset(&ntremu.pacer);
         } else {
             break;
         }
     }
 
+    atomic_store(&emu_done, true);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+
+    if (emulator_init(argc, argv) < 0) return -1;
+
+    init_gpu_thread(&ntremu.nds->gpu);
+
+    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER);
+
+    SDL_GameController* controller = NULL;
+    if (SDL_NumJoysticks() > 0) {
+        controller = SDL_GameControllerOpen(0);
+    }
+
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    SDL_CreateWindowAndRenderer(NDS_SCREEN_W * 2, NDS_SCREEN_H * 4,
+                                SDL_WINDOW_RESIZABLE, &window, &renderer);
+    snprintf(wintitle, 199, "ntremu | %s | %.2lf FPS", ntremu.romfilenodir,
+             0.0);
+    SDL_SetWindowTitle(window, wintitle);
+    SDL_RenderClear(renderer);
+    SDL_RenderPresent(renderer);
+
+    // with vrr the display follows the paced frames so vsync does not stall
+    SDL_DisplayMode mode = {0};
+    SDL_GetWindowDisplayMode(window, &mode);
+    if (ntremu.pace_mode != PACE_DS) SDL_RenderSetVSync(renderer, 1);
+    pacer_init(&ntremu.pacer, ntremu.pace_mode, mode.refresh_rate);
+
+    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_BGR555,
+                                             SDL_TEXTUREACCESS_STREAMING,
+                                             NDS_SCREEN_W, 2 * NDS_SCREEN_H);
+
+    SDL_AudioSpec audio_spec = {.freq = SAMPLE_FREQ,
+                                .format = AUDIO_F32,
+                                .channels = 2,
+                                .samples = SAMPLE_BUF_LEN / 2};
+    audio = SDL_OpenAudioDevice(NULL, 0, &audio_spec, NULL, 0);
+    SDL_PauseAudioDevice(audio, 0);
+
+    triplebuf_init(&frames, sizeof ntremu.nds->screen_top +
+                                sizeof ntremu.nds->screen_bottom);
+    InputState in = {.pen = 1, .tsc_x = -1, .tsc_y = -1};
+    update_input_keyboard(&in);
+    update_input_controller(&in, controller);
+    atomic_store(&input, in.w);
+
+    pthread_t emu;
+    pthread_create(&emu, NULL, emu_thread, NULL);
+
+    Uint64 prev_fps_update = SDL_GetPerformanceCounter();
+    Uint64 prev_fps_frame = 0;
+
+    while (!atomic_load(&emu_done)) {
+        SDL_Event e;
+        while (SDL_PollEvent(&e)) {
+            if (e.type == SDL_QUIT) atomic_store(&quit_requested, true);
+            if (e.type == SDL_KEYDOWN) push_hotkey(e.key.keysym.sym);
+        }
+
+        int windowW, windowH;
+        SDL_GetWindowSize(window, &windowW, &windowH);
+        SDL_Rect dst;
+        center_screen_in_window(windowW, windowH, &dst);
+
+        update_input_keyboard(&in);
+        update_input_controller(&in, controller);
+        SDL_Rect ts_bounds = dst;
+        ts_bounds.h /= 2;
+        ts_bounds.y += ts_bounds.h;
+        update_input_touch(&in, &ts_bounds, controller);
+        atomic_store(&input, in.w);
+
+        u8* frame = triplebuf_acquire(&frames);
+        if (frame) {
+            void* pixels;
+            int pitch;
+            SDL_LockTexture(texture, NULL, &pixels, &pitch);
+            memcpy(pixels, frame,
+                   sizeof ntremu.nds->screen_top +
+                       sizeof ntremu.nds->screen_bottom);
+            SDL_UnlockTexture(texture);
+
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, texture, NULL, &dst);
+            SDL_RenderPresent(renderer);
+        } else {
+            SDL_Delay(1);
+        }
+
+        Uint64 cur_time = SDL_GetPerformanceCounter();
+        Uint64 elapsed = cur_time - prev_fps_update;
+        if (elapsed >= SDL_GetPerformanceFrequency() / 2) {
+            Uint64 frame = atomic_load(&frame_count);
+            double fps = (double) SDL_GetPerformanceFrequency() *
+                         (frame - prev_fps_frame) / elapsed;
+            snprintf(wintitle, 199, "ntremu | %s | %.2lf FPS",
+                     ntremu.romfilenodir, fps);
+            SDL_SetWindowTitle(window, wintitle);
+            prev_fps_update = cur_time;
+            prev_fps_frame = frame;
+        }
+    }
+
+    pthread_join(emu, NULL);
+
+    if (ntremu.trace) pacer_report(&ntremu.pacer, stdout);
+
 #ifdef CPULOG
     FILE* fp = fopen("arm7.log", "w");
     for (int i = 0; i < LOGMAX; i++) {
@@ -221,7 +402,9 @@ int main(int argc, char** argv) {
 
     SDL_Quit();
 
-    destroy_gpu_thread();
+    triplebuf_free(&frames);
+
+    destroy_gpu_thread(&ntremu.nds->gpu);
 
     emulator_quit();
 
@@ -0,0 +1,58 @@
+#include "memtiming.h"
+
+#include "nds.h"
+
+// all timings are in 33MHz bus cycles, the arm9 tables are scaled to its clock
+static void set_waitstates(u8 (*ws)[WS_MAX], int start, int end, int buswidth,
+                           int n, int s, int shift) {
+    int n16 = n, s16 = s, n32 = n, s32 = s;
+    if (buswidth == 8) {
+        n16 = n + s;
+        s16 = 2 * s;
+        n32 = n + 3 * s;
+        s32 = 4 * s;
+    } else if (buswidth == 16) {
+        n32 = n + s;
+        s32 = 2 * s;
+    }
+    for (int i = start; i < end; i++) {
+        ws[i][WS_N16] = n16 << shift;
+        ws[i][WS_S16] = s16 << shift;
+        ws[i][WS_N32] = n32 << shift;
+        ws[i][WS_S32] = s32 << shift;
+    }
+}
+
+void init_waitstates(NDS* nds) {
+    set_waitstates(nds->cpu9.waitstates, 0x00, 0x100, 32, 1, 1, 1);
+    set_waitstates(nds->cpu9.waitstates, 0x02, 0x03, 16, 8, 1, 1);
+    set_waitstates(nds->cpu9.waitstates, 0x05, 0x07, 16, 1, 1, 1);
+
+    set_waitstates(nds->cpu7.waitstates, 0x00, 0x100, 32, 1, 1, 0);
+    set_waitstates(nds->cpu7.waitstates, 0x02, 0x03, 16, 8, 1, 0);
+    set_waitstates(nds->cpu7.waitstates, 0x06, 0x07, 16, 1, 1, 0);
+
+    update_gbaslot_waitstates(nds);
+}
+
+void update_gbaslot_waitstates(NDS* nds) {
+    static const int ntimings[4] = {10, 8, 6, 18};
+
+    u8(*owner)[WS_MAX] = nds->cpu9.waitstates;
+    u8(*other)[WS_MAX] = nds->cpu7.waitstates;
+    int shift = 1;
+    IO* io = &nds->io9;
+    if (nds->io9.exmemcnt.gbacartrights) {
+        owner = nds->cpu7.waitstates;
+        other = nds->cpu9.waitstates;
+        shift = 0;
+        io = &nds->io7;
+    }
+
+    int romN = ntimings[io->exmemcnt.gbaromtime];
+    int romS = io->exmemcnt.gbaromstime ? 4 : 6;
+    int ramN = ntimings[io->exmemcnt.gbasramtime];
+    set_waitstates(owner, 0x08, 0x0a, 16, romN, romS, shift);
+    set_waitstates(owner, 0x0a, 0x0b, 8, ramN, ramN, shift);
+    set_waitstates(other, 0x08, 0x0b, 32, 1, 1, !shift);
+}
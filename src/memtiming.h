@@ -0,0 +1,13 @@
+#ifndef MEMTIMING_H
+#define MEMTIMING_H
+
+#include "types.h"
+
+enum { WS_N16, WS_S16, WS_N32, WS_S32, WS_MAX };
+
+typedef struct _NDS NDS;
+
+void init_waitstates(NDS* nds);
+void update_gbaslot_waitstates(NDS* nds);
+
+#endif
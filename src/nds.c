@@ -1,17 +1,34 @@
 #include "nds.h"
 
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include "arm/arm.h"
+#include "arm/thumb.h"
 #include "bus7.h"
 #include "bus9.h"
 #include "dldi.h"
+#include "memtiming.h"
 #include "ppu.h"
 
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void generate_tables() {
+    arm_generate_lookup();
+    thumb_generate_lookup();
+    generate_adpcm_table();
+}
+
 void init_nds(NDS* nds, GameCard* card, u8* bios7, u8* bios9, u8* firmware,
-              bool bootbios) {
+              int sd_fd, VFat* sd_vfat, bool bootbios) {
+    pthread_once(&tables_once, generate_tables);
+
     memset(nds, 0, sizeof *nds);
     nds->sched.master = nds;
+    nds->rtc.base_time = time(NULL);
 
     arm7_init(&nds->cpu7);
     nds->cpu7.master = nds;
@@ -95,6 +112,8 @@ void init_nds(NDS* nds, GameCard* card, u8* bios7, u8* bios9, u8* firmware,
     nds->bios9 = bios9;
     nds->firmware = firmware;
 
+    dldi_init(&nds->dldi, sd_fd, sd_vfat);
+
     nds->io9.keyinput.h = 0x3ff;
     nds->io7.keyinput.h = 0x3ff;
     nds->io7.extkeyin.h = 0x7f;
@@ -149,7 +168,7 @@ void init_nds(NDS* nds, GameCard* card, u8* bios7, u8* bios9, u8* firmware,
 
         memcpy(&nds->ram[0x3ffe00], header, sizeof *header);
 
-        dldi_patch_binary(&card->rom[header->arm9_rom_offset],
+        dldi_patch_binary(&nds->dldi, &card->rom[header->arm9_rom_offset],
                           header->arm9_size);
         for (int i = 0; i < header->arm9_size; i += 4) {
             bus9_write32(nds, header->arm9_ram_offset + i,
@@ -166,7 +185,7 @@ void init_nds(NDS* nds, GameCard* card, u8* bios7, u8* bios9, u8* firmware,
         nds->cpu9.c.cpsr.m = M_SYSTEM;
         cpu_flush((ArmCore*) &nds->cpu9);
 
-        dldi_patch_binary(&card->rom[header->arm7_rom_offset],
+        dldi_patch_binary(&nds->dldi, &card->rom[header->arm7_rom_offset],
                           header->arm7_size);
         for (int i = 0; i < header->arm7_size; i += 4) {
             bus7_write32(nds, header->arm7_ram_offset + i,
@@ -181,26 +200,49 @@ void init_nds(NDS* nds, GameCard* card, u8* bios7, u8* bios9, u8* firmware,
         cpu_flush((ArmCore*) &nds->cpu7);
     }
 
+    init_waitstates(nds);
+
     lcd_hdraw(nds);
     spu_sample(&nds->spu);
 }
 
+// if debug_stop is set nds_run returns right after the instruction, or before
+// it for a breakpoint, and the next call resumes the same cpu like nds_step
 void nds_run(NDS* nds) {
-    while (nds->sched.now - nds->last_event < 512 &&
-           !event_pending(&nds->sched)) {
-        if (arm9_step(&nds->cpu9)) {
-            nds->sched.now += nds->cpu9.c.cycles >> 1;
-            if (!(nds->half_tick ^= nds->cpu9.c.cycles & 1)) {
-                nds->sched.now++;
+    u64 host_start = nds->trace ? trace_host_time() : 0;
+    if (nds->cur_cpu_type == CPU9) {
+        while (nds->sched.now - nds->last_event < 512 &&
+               !event_pending(&nds->sched)) {
+            if ((!nds->cpu9.halt || nds->cpu9.c.irq) && BKPT_STEPS(nds, CPU9))
+                return;
+            if (!nds->cpu9.halt && BKPT(nds, CPU9, nds->cpu9.c.cur_instr_addr))
+                return;
+            if (arm9_step(&nds->cpu9)) {
+                nds->steps[CPU9]++;
+                nds->sched.now += nds->cpu9.c.cycles >> 1;
+                if (!(nds->half_tick ^= nds->cpu9.c.cycles & 1)) {
+                    nds->sched.now++;
+                }
+            } else {
+                nds->sched.now = FIFO_peek(nds->sched.event_queue).time;
+                break;
             }
-        } else {
-            nds->sched.now = FIFO_peek(nds->sched.event_queue).time;
-            break;
+            if (nds->debug_stop) return;
+        }
+        if (nds->trace) {
+            trace_span(nds->trace, TRACE_ARM9,
+                       nds->cpu9.halt ? "ARM9 Halt" : "ARM9", nds->last_event,
+                       nds->sched.now, host_start, NULL);
+            host_start = trace_host_time();
         }
+        if (nds->prof) {
+            profiler_sample(nds->prof, CPU9, (ArmCore*) &nds->cpu9,
+                            nds->cpu9.halt, nds->sched.now);
+        }
+        nds->cur_cpu = (ArmCore*) &nds->cpu7;
+        nds->cur_cpu_type = CPU7;
+        nds->sched.now = nds->last_event;
     }
-    nds->cur_cpu = (ArmCore*) &nds->cpu7;
-    nds->cur_cpu_type = CPU7;
-    nds->sched.now = nds->last_event;
     while (nds->sched.now - nds->last_event < 512 &&
            !event_pending(&nds->sched)) {
         if (nds->halt7) {
@@ -213,10 +255,22 @@ void nds_run(NDS* nds) {
                 break;
             }
         } else {
+            if (BKPT_STEPS(nds, CPU7)) return;
+            if (BKPT(nds, CPU7, nds->cpu7.c.cur_instr_addr)) return;
             arm7_step(&nds->cpu7);
+            nds->steps[CPU7]++;
             nds->sched.now += nds->cpu7.c.cycles;
+            if (nds->debug_stop) return;
         }
     }
+    if (nds->trace) {
+        trace_span(nds->trace, TRACE_ARM7, nds->halt7 ? "ARM7 Halt" : "ARM7",
+                   nds->last_event, nds->sched.now, host_start, NULL);
+    }
+    if (nds->prof) {
+        profiler_sample(nds->prof, CPU7, (ArmCore*) &nds->cpu7, nds->halt7,
+                        nds->sched.now);
+    }
     run_to_present(&nds->sched);
     nds->cpu7.c.irq = nds->io7.ime && (nds->io7.ie.w & nds->io7.ifl.w);
     nds->cpu9.c.irq = nds->io9.ime && (nds->io9.ie.w & nds->io9.ifl.w);
@@ -226,6 +280,222 @@ void nds_run(NDS* nds) {
     nds->last_event = nds->sched.now;
 }
 
+#define STATE_MAGIC 0x5453524e
+#define STATE_VERSION 5
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u64 size;
+    GameCard card;
+} StateHeader;
+
+// internal pointers are stored as offsets from the start of the NDS struct so
+// a state can be loaded into any instance
+static void relocate_state(NDS* nds, uintptr_t delta) {
+#define RELOC(p) ((p) = (void*) ((uintptr_t) (p) + delta))
+    for (int i = 0; i < 9; i++) RELOC(nds->vrambanks[i]);
+    RELOC(nds->cur_cpu);
+
+    RELOC(nds->sched.master);
+    RELOC(nds->cpu7.master);
+    RELOC(nds->cpu9.master);
+    RELOC(nds->dma7.master);
+    RELOC(nds->dma9.master);
+    RELOC(nds->tmc7.master);
+    RELOC(nds->tmc7.io);
+    RELOC(nds->tmc9.master);
+    RELOC(nds->tmc9.io);
+    RELOC(nds->spu.master);
+    RELOC(nds->io7.master);
+    RELOC(nds->io9.master);
+
+    PPU* ppus[2] = {&nds->ppuA, &nds->ppuB};
+    for (int p = 0; p < 2; p++) {
+        RELOC(ppus[p]->master);
+        RELOC(ppus[p]->io);
+        RELOC(ppus[p]->pal);
+        for (int i = 0; i < 4; i++) RELOC(ppus[p]->extPalBg[i]);
+        RELOC(ppus[p]->extPalObj);
+        RELOC(ppus[p]->oam);
+        RELOC(ppus[p]->screen);
+    }
+
+    GPU* gpu = &nds->gpu;
+    RELOC(gpu->master);
+    RELOC(gpu->screen);
+    RELOC(gpu->screen_back);
+    for (int i = 0; i < 4; i++) RELOC(gpu->texram[i]);
+    for (int i = 0; i < 6; i++) RELOC(gpu->texpal[i]);
+    RELOC(gpu->vertexram);
+    RELOC(gpu->polygonram);
+    RELOC(gpu->vertexram_rendering);
+    RELOC(gpu->polygonram_rendering);
+    for (int i = 0; i < 4; i++) RELOC(gpu->cur_poly_strip[i]);
+    for (int b = 0; b < 2; b++) {
+        for (int i = 0; i < MAX_POLY; i++) {
+            for (int j = 0; j < MAX_POLY_N; j++) {
+                RELOC(gpu->polygonrambufs[b][i].p[j]);
+            }
+        }
+    }
+#undef RELOC
+}
+
+static void copy_callbacks(ArmCore* dst, ArmCore* src) {
+    dst->read8 = src->read8;
+    dst->read16 = src->read16;
+    dst->read32 = src->read32;
+    dst->write8 = src->write8;
+    dst->write16 = src->write16;
+    dst->write32 = src->write32;
+    dst->fetch16 = src->fetch16;
+    dst->fetch32 = src->fetch32;
+    dst->cp15_read = src->cp15_read;
+    dst->cp15_write = src->cp15_write;
+    dst->swi_hle = src->swi_hle;
+    dst->call_hook = src->call_hook;
+    dst->exec_hook = src->exec_hook;
+}
+
+// the save follows the NDS struct
+size_t nds_state_size(NDS* nds) {
+    return sizeof(StateHeader) + sizeof(NDS) +
+           (nds->card ? nds->card->eeprom_size : 0);
+}
+
+// the gpu thread's sync objects can be in use and are never copied
+#define SYNC_START offsetof(NDS, gpu.mutex)
+#define SYNC_END (offsetof(NDS, gpu.cond) + sizeof(pthread_cond_t))
+
+static void copy_state(void* dst, const void* src) {
+    memcpy(dst, src, SYNC_START);
+    memcpy((u8*) dst + SYNC_END, (const u8*) src + SYNC_END,
+           sizeof(NDS) - SYNC_END);
+}
+
+void nds_save_state(NDS* nds, void* buf) {
+    wait_gpu_render(&nds->gpu);
+
+    StateHeader* hdr = buf;
+    hdr->magic = STATE_MAGIC;
+    hdr->version = STATE_VERSION;
+    hdr->size = nds_state_size(nds);
+    memcpy(&hdr->card, nds->card, sizeof(GameCard));
+
+    u8* state = (u8*) buf + sizeof *hdr;
+    relocate_state(nds, -(uintptr_t) nds);
+    copy_state(state, nds);
+    relocate_state(nds, (uintptr_t) nds);
+    memset(state + SYNC_START, 0, SYNC_END - SYNC_START);
+    memcpy(state + sizeof *nds, nds->card->eeprom, nds->card->eeprom_size);
+}
+
+// host resources (bios, firmware, card data, sd image, render thread) and
+// settings of nds are kept, only emulated state is replaced. the save is
+// resized with the state unless it is mapped from a file
+bool nds_load_state(NDS* nds, const void* buf, size_t len) {
+    const StateHeader* hdr = buf;
+    GameCard* card = nds->card;
+    if (len < sizeof *hdr || hdr->magic != STATE_MAGIC ||
+        hdr->version != STATE_VERSION ||
+        hdr->size != sizeof *hdr + sizeof *nds + hdr->card.eeprom_size ||
+        len < hdr->size)
+        return false;
+    if (hdr->card.eeprom_size != card->eeprom_size) {
+        if (!card->sav_new) return false;
+        u8* eeprom = realloc(card->eeprom, hdr->card.eeprom_size);
+        if (!eeprom) return false;
+        card->eeprom = eeprom;
+        card->eeprom_size = hdr->card.eeprom_size;
+    }
+
+    wait_gpu_render(&nds->gpu);
+
+    u8* bios7 = nds->bios7;
+    u8* bios9 = nds->bios9;
+    u8* firmware = nds->firmware;
+    int sd_fd = nds->dldi.sd_fd;
+    VFat* sd_vfat = nds->dldi.vfat;
+    Overlay* sd_overlay = nds->dldi.overlay;
+    u8* sd_ra_buf = nds->dldi.ra_buf;
+    u64 sd_size = nds->dldi.sd_size;
+    BiosMode bios_mode = nds->bios_mode;
+    u8* check_buf7 = nds->hle7.check_buf;
+    u8* check_buf9 = nds->hle9.check_buf;
+    int frameskip = nds->frameskip;
+    Tracer* trace = nds->trace;
+    GXLog* gxlog = nds->gxlog;
+    PPULog* ppulog = nds->ppulog;
+    Profiler* prof = nds->prof;
+    CpuTrace* cputrace = nds->cputrace;
+    Watchpoints* watch = nds->watch;
+    Breakpoints* bkpt = nds->bkpt;
+    bool cache_model = nds->cpu9.cache_model;
+    ArmCore cb7 = nds->cpu7.c;
+    ArmCore cb9 = nds->cpu9.c;
+    GPU* gpu = &nds->gpu;
+    bool threaded = gpu->threaded;
+    pthread_t thread = gpu->thread;
+    bool wireframe = gpu->wireframe;
+    bool freecam = gpu->freecam;
+    mat4 freecam_mtx = gpu->freecam_mtx;
+
+    const u8* state = (const u8*) buf + sizeof *hdr;
+    copy_state(nds, state);
+    relocate_state(nds, (uintptr_t) nds);
+
+    nds->bios7 = bios7;
+    nds->bios9 = bios9;
+    nds->firmware = firmware;
+    nds->card = card;
+    nds->dldi.sd_fd = sd_fd;
+    nds->dldi.vfat = sd_vfat;
+    nds->dldi.overlay = sd_overlay;
+    nds->dldi.ra_buf = sd_ra_buf;
+    nds->dldi.sd_size = sd_size;
+    nds->dldi.ra_count = 0;
+    nds->bios_mode = bios_mode;
+    nds->hle7.check = false;
+    nds->hle9.check = false;
+    nds->hle7.check_buf = check_buf7;
+    nds->hle9.check_buf = check_buf9;
+    nds->frameskip = frameskip;
+    nds->trace = trace;
+    nds->gxlog = gxlog;
+    nds->ppulog = ppulog;
+    nds->prof = prof;
+    nds->cputrace = cputrace;
+    nds->watch = watch;
+    nds->bkpt = bkpt;
+    nds->debug_stop = false;
+    nds->cpu9.cache_model = cache_model;
+    copy_callbacks(&nds->cpu7.c, &cb7);
+    copy_callbacks(&nds->cpu9.c, &cb9);
+    gpu->threaded = threaded;
+    gpu->thread = thread;
+    gpu->render_pending = false;
+    gpu->thread_quit = false;
+    gpu->wireframe = wireframe;
+    gpu->freecam = freecam;
+    gpu->freecam_mtx = freecam_mtx;
+
+    card->state = hdr->card.state;
+    card->addr = hdr->card.addr;
+    card->i = hdr->card.i;
+    card->len = hdr->card.len;
+    card->key1mode = hdr->card.key1mode;
+    card->key1 = hdr->card.key1;
+    card->eeprom_state = hdr->card.eeprom_state;
+    card->spidata = hdr->card.spidata;
+    card->eepromst = hdr->card.eepromst;
+    card->addrtype = hdr->card.addrtype;
+    card->eeprom_detected = hdr->card.eeprom_detected;
+    memcpy(card->eeprom, state + sizeof *nds, card->eeprom_size);
+
+    return true;
+}
+
 bool nds_step(NDS* nds) {
     if (nds->cur_cpu_type == CPU7) {
         if (nds->halt7) {
@@ -238,15 +508,16 @@ bool nds_step(NDS* nds) {
             }
         } else {
             arm7_step(&nds->cpu7);
+            nds->steps[CPU7]++;
             nds->sched.now += nds->cpu7.c.cycles;
         }
     } else {
+        // timed the same as nds_run so stepping doesn't change the history
         if (arm9_step(&nds->cpu9)) {
+            nds->steps[CPU9]++;
             nds->sched.now += nds->cpu9.c.cycles >> 1;
-            if (nds->cpu9.c.cycles & 1) {
-                if (nds->half_tick ^= 1) {
-                    nds->sched.now++;
-                }
+            if (!(nds->half_tick ^= nds->cpu9.c.cycles & 1)) {
+                nds->sched.now++;
             }
         } else {
             nds->sched.now = FIFO_peek(nds->sched.event_queue).time;
@@ -377,7 +648,8 @@ void rtc_write(NDS* nds) {
             nds->rtc.bi = -1;
             nds->rtc.i++;
 
-            struct tm* t = localtime(&(time_t){time(NULL)});
+            time_t now = nds->rtc.base_time + nds->sched.now / BUS_CLK;
+            struct tm* t = localtime(&now);
             u8 year = (t->tm_year / 10 % 10) << 4 | t->tm_year % 10;
             u8 month = ((t->tm_mon + 1) / 10) << 4 | (t->tm_mon + 1) % 10;
             u8 day = (t->tm_mday / 10) << 4 | t->tm_mday % 10;
@@ -3,14 +3,25 @@
 
 #include "arm7tdmi.h"
 #include "arm946e.h"
+#include "bios.h"
+#include "breakpoint.h"
+#include "cputrace.h"
+#include "dldi.h"
 #include "dma.h"
 #include "gamecard.h"
 #include "gpu.h"
+#include "gxlog.h"
 #include "io.h"
 #include "ppu.h"
+#include "ppulog.h"
+#include "profiler.h"
 #include "scheduler.h"
 #include "spu.h"
 #include "timer.h"
+#include "trace.h"
+#include "watch.h"
+
+#define NDS_CLOCK 33513982
 
 #define RAMSIZE (1 << 22)
 
@@ -201,36 +212,70 @@ typedef struct _NDS {
         int bi;
         u8 com;
         u8 data[7];
+        // host time at startup, the clock advances with the emulated time so
+        // it is part of the state
+        s64 base_time;
     } rtc;
 
     GameCard* card;
 
+    DLDI dldi;
+
     FIFO(u32, 16) ipcfifo7to9, ipcfifo9to7;
 
     bool halt7;
     bool sleep;
 
+    BiosMode bios_mode;
+    BiosHLE hle7;
+    BiosHLE hle9;
+
     CPUType cur_cpu_type;
     ArmCore* cur_cpu;
 
     u64 last_event;
     u64 next_vblank;
     int half_tick;
+    // instructions executed by each cpu, positions in the history are the
+    // point before a cpu executes its next one
+    u64 steps[2];
 
     bool frame_complete;
     bool samples_full;
 
+    int frameskip;
+    int frameskip_ctr;
+    bool skip_draw;
+    bool skip_next;
+
+    Tracer* trace;
+    GXLog* gxlog;
+    PPULog* ppulog;
+    Profiler* prof;
+    CpuTrace* cputrace;
+    Watchpoints* watch;
+    Breakpoints* bkpt;
+
+    // set by the debugger hooks, nds_run returns after the current instruction
+    bool debug_stop;
+
     bool memerr;
     bool cpuerr;
+    CPUType cpuerr_cpu;
+    u32 cpuerr_addr;
 
 } NDS;
 
 void init_nds(NDS* nds, GameCard* card, u8* bios7, u8* bios9, u8* firmware,
-              bool bootbios);
+              int sd_fd, VFat* sd_vfat, bool bootbios);
 
 bool nds_step(NDS* nds);
 void nds_run(NDS* nds);
 
+size_t nds_state_size(NDS* nds);
+void nds_save_state(NDS* nds, void* buf);
+bool nds_load_state(NDS* nds, const void* buf, size_t len);
+
 void firmware_spi_write(NDS* nds, u8 data, bool hold);
 void tsc_spi_write(NDS* nds, u8 data);
 void rtc_write(NDS* nds);
@@ -0,0 +1,70 @@
+#include "overlay.h"
+
+#include <stdlib.h>
+
+static u32 hash(u32 key, u32 cap) {
+    key *= 0x9e3779b1;
+    return (key ^ key >> 15) & (cap - 1);
+}
+
+u8* overlay_find(Overlay* o, u32 block) {
+    if (!o->size) return NULL;
+    u32 i = hash(block + 1, o->cap);
+    while (o->keys[i]) {
+        if (o->keys[i] == block + 1) return o->data[i];
+        i = (i + 1) & (o->cap - 1);
+    }
+    return NULL;
+}
+
+static void insert(Overlay* o, u32 key, u8* data) {
+    u32 i = hash(key, o->cap);
+    while (o->keys[i]) i = (i + 1) & (o->cap - 1);
+    o->keys[i] = key;
+    o->data[i] = data;
+    o->size++;
+}
+
+u8* overlay_get(Overlay* o, u32 block) {
+    u8* data = overlay_find(o, block);
+    if (data) return data;
+    if (2 * (o->size + 1) > o->cap) {
+        u32* keys = o->keys;
+        u8** datas = o->data;
+        u32 cap = o->cap;
+        o->cap = cap ? 2 * cap : 1024;
+        o->size = 0;
+        o->keys = calloc(o->cap, sizeof *o->keys);
+        o->data = calloc(o->cap, sizeof *o->data);
+        for (u32 i = 0; i < cap; i++) {
+            if (keys[i]) insert(o, keys[i], datas[i]);
+        }
+        free(keys);
+        free(datas);
+    }
+    data = malloc(OVERLAY_BLOCK);
+    insert(o, block + 1, data);
+    return data;
+}
+
+void overlay_clear(Overlay* o) {
+    for (u32 i = 0; i < o->cap; i++) free(o->data[i]);
+    free(o->keys);
+    free(o->data);
+    *o = (Overlay){0};
+}
+
+static int cmp_u32(const void* a, const void* b) {
+    u32 x = *(const u32*) a, y = *(const u32*) b;
+    return (x > y) - (x < y);
+}
+
+u32 overlay_blocks(Overlay* o, u32** blocks) {
+    *blocks = malloc((o->size + 1) * sizeof **blocks);
+    u32 n = 0;
+    for (u32 i = 0; i < o->cap; i++) {
+        if (o->keys[i]) (*blocks)[n++] = o->keys[i] - 1;
+    }
+    qsort(*blocks, n, sizeof **blocks, cmp_u32);
+    return n;
+}
@@ -0,0 +1,25 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "types.h"
+
+#define OVERLAY_BLOCK 512
+
+// sparse in memory copy of written 512 byte blocks so an image can be used
+// without changing it. keys are stored plus one so 0 marks an empty slot
+typedef struct {
+    u32* keys;
+    u8** data;
+    u32 cap;
+    u32 size;
+} Overlay;
+
+u8* overlay_find(Overlay* o, u32 block);
+// the block is created if it is not there yet, new blocks are not initialized
+u8* overlay_get(Overlay* o, u32 block);
+void overlay_clear(Overlay* o);
+
+// the written blocks in ascending order, returns the count
+u32 overlay_blocks(Overlay* o, u32** blocks);
+
+#endif
@@ -0,0 +1,80 @@
+#include "pacer.h"
+
+#include <errno.h>
+#include <math.h>
+#include <sched.h>
+#include <time.h>
+
+#include "nds.h"
+
+u64 pacer_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void pacer_init(Pacer* p, PaceMode mode, double host_hz) {
+    *p = (Pacer){0};
+    p->mode = mode;
+    if (mode == PACE_VSYNC && host_hz > 0) {
+        p->base_period = 1e9 / host_hz;
+    } else {
+        p->base_period = (u64) FRAME_CYCLES * 1000000000 / NDS_CLOCK;
+    }
+    pacer_set_speed(p, 1);
+}
+
+void pacer_set_speed(Pacer* p, double speed) {
+    p->speed = speed;
+    p->period = p->base_period / speed;
+    pacer_reset(p);
+}
+
+void pacer_reset(Pacer* p) {
+    p->last = 0;
+    p->deadline = pacer_time() + p->period;
+}
+
+u64 pacer_wait(Pacer* p) {
+    u64 now = pacer_time();
+    if (p->deadline > now + PACE_SPIN_NS) {
+        u64 wake = p->deadline - PACE_SPIN_NS;
+        struct timespec ts = {wake / 1000000000, wake % 1000000000};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+               EINTR)
+            ;
+    }
+    while ((now = pacer_time()) < p->deadline) {
+        sched_yield();
+    }
+
+    p->deadline += p->period;
+    if (now > p->deadline + PACE_MAX_LAG * p->period)
+        p->deadline = now + p->period;
+
+    u64 dt = p->last ? now - p->last : 0;
+    p->last = now;
+    if (dt) {
+        double ms = dt / 1e6;
+        p->frames++;
+        double d = ms - p->mean;
+        p->mean += d / p->frames;
+        p->m2 += d * (ms - p->mean);
+        if (p->frames == 1 || ms < p->min) p->min = ms;
+        if (ms > p->max) p->max = ms;
+    }
+    return dt;
+}
+
+double pacer_stddev(Pacer* p) {
+    return p->frames > 1 ? sqrt(p->m2 / (p->frames - 1)) : 0;
+}
+
+void pacer_report(Pacer* p, FILE* out) {
+    static const char* modes[] = {"ds", "vsync", "vrr"};
+    fprintf(out,
+            "Pacing (%s, target %.3f ms): %lu frames, mean %.3f ms, "
+            "stddev %.3f ms, min %.3f ms, max %.3f ms\n",
+            modes[p->mode], p->period / 1e6, p->frames, p->mean,
+            pacer_stddev(p), p->min, p->max);
+}
@@ -0,0 +1,47 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+#define FRAME_CYCLES (LINES_H * DOTS_W * 6)
+// the end of each wait is spun instead of slept
+#define PACE_SPIN_NS 500000
+// if emulation falls this many frames behind it is not caught up
+#define PACE_MAX_LAG 4
+
+typedef enum { PACE_DS, PACE_VSYNC, PACE_VRR } PaceMode;
+
+// frames are released at absolute deadlines one period apart so sleep errors
+// do not accumulate. ds and vrr pace to the ds refresh rate, vsync to the
+// refresh rate of the host display
+typedef struct {
+    PaceMode mode;
+    u64 base_period;
+    double speed;
+    u64 period;
+    u64 deadline;
+    u64 last;
+
+    // frame times between consecutive paced frames
+    u64 frames;
+    double mean;
+    double m2;
+    double min;
+    double max;
+} Pacer;
+
+u64 pacer_time();
+
+void pacer_init(Pacer* p, PaceMode mode, double host_hz);
+void pacer_set_speed(Pacer* p, double speed);
+// start from now, for when frames were not paced (pause, uncap, debugger)
+void pacer_reset(Pacer* p);
+// returns the time since the previous frame or 0 after a reset
+u64 pacer_wait(Pacer* p);
+
+double pacer_stddev(Pacer* p);
+void pacer_report(Pacer* p, FILE* out);
+
+#endif
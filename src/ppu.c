@@ -998,9 +998,26 @@ void lcd_hdraw(NDS* nds) {
         if (nds->io7.vcount == 0) {
             apply_screenswap(nds);
 
+            nds->skip_draw = nds->skip_next;
+            if (nds->frameskip_ctr < nds->frameskip) {
+                nds->frameskip_ctr++;
+                nds->skip_next = true;
+            } else {
+                nds->frameskip_ctr = 0;
+                nds->skip_next = false;
+            }
+
             if (nds->gpu.drawing) {
                 nds->gpu.drawing = false;
-                pthread_mutex_lock(&gpu_mutex);
+                wait_gpu_render(&nds->gpu);
+                void* tmp = nds->gpu.screen_back;
+                nds->gpu.screen_back = nds->gpu.screen;
+                nds->gpu.screen = tmp;
+            }
+            if (nds->gpu.render_skipped &&
+                (!nds->skip_draw || nds->io9.dispcapcnt.enable)) {
+                nds->gpu.render_skipped = false;
+                gpu_render(&nds->gpu);
                 void* tmp = nds->gpu.screen_back;
                 nds->gpu.screen_back = nds->gpu.screen;
                 nds->gpu.screen = tmp;
@@ -1011,11 +1028,21 @@ void lcd_hdraw(NDS* nds) {
             }
         }
 
-        draw_scanline(&nds->ppuA);
-        draw_scanline(&nds->ppuB);
+        bool capture =
+            nds->io9.dispcapcnt.enable &&
+            nds->io7.vcount < DISPCAPLAYOUT[nds->io9.dispcapcnt.size][1];
+
+        if (!nds->skip_draw) {
+            if (nds->ppulog) ppulog_line(nds->ppulog, nds);
+            draw_scanline(&nds->ppuA);
+            draw_scanline(&nds->ppuB);
+        } else if (capture && nds->io9.dispcapcnt.source != 1 &&
+                   !nds->io9.dispcapcnt.srcA &&
+                   !nds->io9.ppuA.dispcnt.forced_blank) {
+            draw_scanline_normal(&nds->ppuA);
+        }
 
-        if (nds->io9.dispcapcnt.enable &&
-            nds->io7.vcount < DISPCAPLAYOUT[nds->io9.dispcapcnt.size][1]) {
+        if (capture) {
             lcd_capture_line(nds);
         }
 
@@ -116,6 +116,7 @@ typedef struct {
 } PPU;
 
 void draw_scanline(PPU* ppu);
+void draw_scanline_normal(PPU* ppu);
 
 void lcd_hdraw(NDS* nds);
 void lcd_vblank(NDS* nds);
@@ -0,0 +1,109 @@
+#include "ppulog.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nds.h"
+
+PPULog* ppulog_open(char* filename) {
+    FILE* fp = fopen(filename, "wb");
+    if (!fp) return NULL;
+    PPULog* log = calloc(1, sizeof *log);
+    log->fp = fp;
+    log->first = true;
+    log->vram = malloc(VRAMSIZE);
+    log->screen3d = malloc(NDS_SCREEN_H * NDS_SCREEN_W * 4);
+    log->pal = malloc(2 * PALSIZE);
+    log->oam = malloc(2 * OAMSIZE);
+    u32 hdr[2] = {PPULOG_MAGIC, PPULOG_VERSION};
+    fwrite(hdr, sizeof hdr, 1, fp);
+    return log;
+}
+
+void ppulog_close(PPULog* log) {
+    if (!log) return;
+    fclose(log->fp);
+    free(log->vram);
+    free(log->screen3d);
+    free(log->pal);
+    free(log->oam);
+    free(log);
+}
+
+static void write_chunks(PPULog* log, u8* copy, u8* mem, u32 size, u32 chunk) {
+    for (u32 i = 0; i < size / chunk; i++) {
+        if (!log->first && !memcmp(&mem[i * chunk], &copy[i * chunk], chunk))
+            continue;
+        memcpy(&copy[i * chunk], &mem[i * chunk], chunk);
+        u16 idx = i;
+        fwrite(&idx, 2, 1, log->fp);
+        fwrite(&mem[i * chunk], 1, chunk, log->fp);
+    }
+    u16 end = PPULOG_END;
+    fwrite(&end, 2, 1, log->fp);
+}
+
+static u32 vram_offset(NDS* nds, void* p) {
+    if (!p) return PPULOG_NOPTR;
+    return (u8*) p - nds->vram;
+}
+
+void ppulog_save_line_state(PPU* ppu, PPULineState* s) {
+    memset(s, 0, sizeof *s);
+    memcpy(s->bgaffintr, ppu->bgaffintr, sizeof s->bgaffintr);
+    s->bgmos_y = ppu->bgmos_y;
+    s->bgmos_ct = ppu->bgmos_ct;
+    s->objmos_y = ppu->objmos_y;
+    s->objmos_ct = ppu->objmos_ct;
+    s->in_win[0] = ppu->in_win[0];
+    s->in_win[1] = ppu->in_win[1];
+}
+
+void ppulog_load_line_state(PPU* ppu, PPULineState* s) {
+    memcpy(ppu->bgaffintr, s->bgaffintr, sizeof s->bgaffintr);
+    ppu->bgmos_y = s->bgmos_y;
+    ppu->bgmos_ct = s->bgmos_ct;
+    ppu->objmos_y = s->objmos_y;
+    ppu->objmos_ct = s->objmos_ct;
+    ppu->in_win[0] = s->in_win[0];
+    ppu->in_win[1] = s->in_win[1];
+}
+
+static void write_frame(PPULog* log, NDS* nds) {
+    u8 type = PPULOG_FRAME;
+    fwrite(&type, 1, 1, log->fp);
+    write_chunks(log, log->vram, nds->vram, VRAMSIZE, PPULOG_CHUNK);
+    write_chunks(log, log->screen3d, (u8*) nds->gpu.screen,
+                 NDS_SCREEN_H * NDS_SCREEN_W * 4, PPULOG_CHUNK);
+    fwrite(&nds->vramstate, sizeof nds->vramstate, 1, log->fp);
+    u8 screenswap = nds->io9.powcnt.screenswap;
+    fwrite(&screenswap, 1, 1, log->fp);
+    PPU* ppus[2] = {&nds->ppuA, &nds->ppuB};
+    for (int p = 0; p < 2; p++) {
+        u32 ofs[5];
+        for (int i = 0; i < 4; i++) {
+            ofs[i] = vram_offset(nds, ppus[p]->extPalBg[i]);
+        }
+        ofs[4] = vram_offset(nds, ppus[p]->extPalObj);
+        fwrite(ofs, sizeof ofs, 1, log->fp);
+    }
+}
+
+// called before each drawn line
+void ppulog_line(PPULog* log, NDS* nds) {
+    if (nds->ppuA.ly == 0) write_frame(log, nds);
+
+    u8 type = PPULOG_LINE;
+    fwrite(&type, 1, 1, log->fp);
+    fwrite(&nds->ppuA.ly, 2, 1, log->fp);
+    fwrite(&nds->io9.ppuA, sizeof(PPUIO), 1, log->fp);
+    fwrite(&nds->io9.ppuB, sizeof(PPUIO), 1, log->fp);
+    PPULineState s;
+    ppulog_save_line_state(&nds->ppuA, &s);
+    fwrite(&s, sizeof s, 1, log->fp);
+    ppulog_save_line_state(&nds->ppuB, &s);
+    fwrite(&s, sizeof s, 1, log->fp);
+    write_chunks(log, log->pal, nds->pal, 2 * PALSIZE, PPULOG_LINECHUNK);
+    write_chunks(log, log->oam, nds->oam, 2 * OAMSIZE, PPULOG_LINECHUNK);
+    log->first = false;
+}
@@ -0,0 +1,56 @@
+#ifndef PPULOG_H
+#define PPULOG_H
+
+#include <stdio.h>
+
+#include "io.h"
+#include "ppu.h"
+#include "types.h"
+
+#define PPULOG_MAGIC 0x55505452
+#define PPULOG_VERSION 1
+
+#define PPULOG_CHUNK (1 << 12)
+#define PPULOG_LINECHUNK (1 << 8)
+#define PPULOG_NOPTR 0xffffffff
+
+// the file starts with the magic and version as u32, followed by records.
+// a frame record is written before the first line is drawn and has vram, the
+// 3d layer, the vram mapping, the screen swap bit and the extended palette
+// offsets into vram. a line record has the line, the io and line state of
+// both engines and the palette and oam. memory is written as a list of
+// changed chunks, each being the chunk index as u16 and the data, terminated
+// by PPULOG_END
+enum { PPULOG_FRAME, PPULOG_LINE };
+
+#define PPULOG_END 0xffff
+
+typedef struct {
+    u32 bgaffintr[2][4];
+    u8 bgmos_y;
+    u8 bgmos_ct;
+    u8 objmos_y;
+    u8 objmos_ct;
+    bool in_win[2];
+} PPULineState;
+
+typedef struct _NDS NDS;
+
+typedef struct {
+    FILE* fp;
+    bool first;
+    u8* vram;
+    u8* screen3d;
+    u8* pal;
+    u8* oam;
+} PPULog;
+
+PPULog* ppulog_open(char* filename);
+void ppulog_close(PPULog* log);
+
+void ppulog_line(PPULog* log, NDS* nds);
+
+void ppulog_save_line_state(PPU* ppu, PPULineState* s);
+void ppulog_load_line_state(PPU* ppu, PPULineState* s);
+
+#endif
@@ -0,0 +1,323 @@
+#include "profiler.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nds.h"
+
+static const char* cpu_names[2] = {"ARM9", "ARM7"};
+
+static u32 table_hash(u32 key, u32 cap) {
+    key ^= key >> 16;
+    key *= 0x45d9f3b;
+    key ^= key >> 16;
+    return key & (cap - 1);
+}
+
+static void table_insert(ProfTable* t, u32 key, u32 n) {
+    u32 i = table_hash(key, t->cap);
+    while (t->keys[i] && t->keys[i] != key) i = (i + 1) & (t->cap - 1);
+    if (!t->keys[i]) {
+        t->keys[i] = key;
+        t->size++;
+    }
+    t->counts[i] += n;
+}
+
+static void table_add(ProfTable* t, u32 addr, u32 n) {
+    if (2 * (t->size + 1) > t->cap) {
+        ProfTable old = *t;
+        t->cap = old.cap ? 2 * old.cap : 1024;
+        t->size = 0;
+        t->keys = calloc(t->cap, sizeof *t->keys);
+        t->counts = calloc(t->cap, sizeof *t->counts);
+        for (u32 i = 0; i < old.cap; i++) {
+            if (old.keys[i]) table_insert(t, old.keys[i], old.counts[i]);
+        }
+        free(old.keys);
+        free(old.counts);
+    }
+    table_insert(t, addr | 1, n);
+}
+
+static u32 table_get(ProfTable* t, u32 addr) {
+    if (!t->cap) return 0;
+    u32 key = addr | 1;
+    u32 i = table_hash(key, t->cap);
+    while (t->keys[i]) {
+        if (t->keys[i] == key) return t->counts[i];
+        i = (i + 1) & (t->cap - 1);
+    }
+    return 0;
+}
+
+static void table_free(ProfTable* t) {
+    free(t->keys);
+    free(t->counts);
+}
+
+Profiler* profiler_open(char* filename) {
+    FILE* fp = fopen(filename, "w");
+    if (!fp) return NULL;
+    Profiler* p = calloc(1, sizeof *p);
+    p->fp = fp;
+    return p;
+}
+
+void profiler_close(Profiler* p) {
+    if (!p) return;
+    profiler_report(p, p->fp, PROF_TOP);
+    fclose(p->fp);
+    for (int cpu = 0; cpu < 2; cpu++) {
+        table_free(&p->addrs[cpu]);
+        table_free(&p->calls[cpu]);
+        for (int i = 0; i < p->n_syms[cpu]; i++) {
+            free(p->syms[cpu][i].name);
+        }
+        free(p->syms[cpu]);
+    }
+    free(p);
+}
+
+static void add_symbol(Profiler* p, int cpu, u32 addr, u32 size,
+                       const char* name) {
+    p->syms[cpu] = realloc(p->syms[cpu],
+                           (p->n_syms[cpu] + 1) * sizeof *p->syms[cpu]);
+    p->syms[cpu][p->n_syms[cpu]++] =
+        (ProfSymbol){.addr = addr & ~1, .size = size, .name = strdup(name)};
+}
+
+#define RD16(b, o) ((b)[o] | (b)[(o) + 1] << 8)
+#define RD32(b, o) (RD16(b, o) | (u32) RD16(b, (o) + 2) << 16)
+
+// only function symbols from the 32 bit little endian symbol tables are used
+static bool load_elf_symbols(Profiler* p, int cpu, u8* data, size_t len) {
+    if (len < 0x34 || data[4] != 1 || data[5] != 1) return false;
+    u32 shoff = RD32(data, 0x20);
+    u32 shentsize = RD16(data, 0x2e);
+    u32 shnum = RD16(data, 0x30);
+    if (shentsize < 0x28 || shoff + (u64) shnum * shentsize > len) return false;
+
+    for (u32 i = 0; i < shnum; i++) {
+        u8* sh = &data[shoff + i * shentsize];
+        if (RD32(sh, 4) != 2) continue; // SHT_SYMTAB
+        u32 symoff = RD32(sh, 0x10);
+        u32 symsize = RD32(sh, 0x14);
+        u32 link = RD32(sh, 0x18);
+        if (link >= shnum || symoff + (u64) symsize > len) continue;
+        u8* strsh = &data[shoff + link * shentsize];
+        u32 stroff = RD32(strsh, 0x10);
+        u32 strsize = RD32(strsh, 0x14);
+        if (stroff + (u64) strsize > len) continue;
+
+        for (u32 s = 0; s + 16 <= symsize; s += 16) {
+            u8* sym = &data[symoff + s];
+            u32 name = RD32(sym, 0);
+            if ((sym[12] & 0xf) != 2 || !name || name >= strsize) continue;
+            // names must be terminated inside the string table
+            if (!memchr(&data[stroff + name], '\0', strsize - name)) continue;
+            add_symbol(p, cpu, RD32(sym, 4), RD32(sym, 8),
+                       (char*) &data[stroff + name]);
+        }
+    }
+    return true;
+}
+
+// any line which is just an address and a name, which covers gnu ld maps
+// as well as plain symbol lists
+static bool load_map_symbols(Profiler* p, int cpu, char* filename) {
+    FILE* fp = fopen(filename, "r");
+    if (!fp) return false;
+    char line[1024];
+    while (fgets(line, sizeof line, fp)) {
+        u32 addr;
+        char name[256];
+        char extra[2];
+        if (sscanf(line, " %x %255s %1s", &addr, name, extra) != 2) continue;
+        if (!(name[0] == '_' || (name[0] >= 'a' && name[0] <= 'z') ||
+              (name[0] >= 'A' && name[0] <= 'Z')))
+            continue;
+        add_symbol(p, cpu, addr, 0, name);
+    }
+    fclose(fp);
+    return true;
+}
+
+static int cmp_symbol(const void* a, const void* b) {
+    u32 x = ((ProfSymbol*) a)->addr;
+    u32 y = ((ProfSymbol*) b)->addr;
+    return (x > y) - (x < y);
+}
+
+bool profiler_load_symbols(Profiler* p, int cpu, char* filename) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) return false;
+    fseek(fp, 0, SEEK_END);
+    size_t len = ftell(fp);
+    rewind(fp);
+    u8* data = malloc(len ? len : 1);
+    bool ok = fread(data, 1, len, fp) == len;
+    fclose(fp);
+
+    if (ok) {
+        if (len >= 4 && !memcmp(data, "\x7f" "ELF", 4)) {
+            ok = load_elf_symbols(p, cpu, data, len);
+        } else {
+            ok = load_map_symbols(p, cpu, filename);
+        }
+    }
+    free(data);
+    qsort(p->syms[cpu], p->n_syms[cpu], sizeof *p->syms[cpu], cmp_symbol);
+    return ok;
+}
+
+static void call_hook7(ArmCore* cpu, u32 dest) {
+    table_add(&((Arm7TDMI*) cpu)->master->prof->calls[CPU7], dest & ~1, 1);
+}
+
+static void call_hook9(ArmCore* cpu, u32 dest) {
+    table_add(&((Arm946E*) cpu)->master->prof->calls[CPU9], dest & ~1, 1);
+}
+
+void profiler_attach(Profiler* p, NDS* nds) {
+    nds->prof = p;
+    nds->cpu7.c.call_hook = call_hook7;
+    nds->cpu9.c.call_hook = call_hook9;
+    p->next_sample[CPU9] = nds->sched.now;
+    p->next_sample[CPU7] = nds->sched.now;
+}
+
+void profiler_sample(Profiler* p, int cpu, ArmCore* core, bool halt, u64 now) {
+    // time goes backwards after a reset or loading a state
+    if (now + PROF_PERIOD < p->next_sample[cpu]) p->next_sample[cpu] = now;
+    if (now < p->next_sample[cpu]) return;
+    u32 n = (now - p->next_sample[cpu]) / PROF_PERIOD + 1;
+    p->next_sample[cpu] += (u64) n * PROF_PERIOD;
+    p->samples[cpu] += n;
+    if (halt) p->halted[cpu] += n;
+    else table_add(&p->addrs[cpu], core->cur_instr_addr, n);
+}
+
+static ProfSymbol* find_symbol(Profiler* p, int cpu, u32 addr) {
+    int lo = 0, hi = p->n_syms[cpu] - 1;
+    ProfSymbol* res = NULL;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (p->syms[cpu][mid].addr <= addr) {
+            res = &p->syms[cpu][mid];
+            lo = mid + 1;
+        } else hi = mid - 1;
+    }
+    if (!res) return NULL;
+    if (res->size) {
+        if (addr - res->addr >= res->size) return NULL;
+    } else if ((addr ^ res->addr) >> 24) return NULL;
+    return res;
+}
+
+static void format_name(Profiler* p, int cpu, u32 addr, bool func, char* buf,
+                        size_t len) {
+    ProfSymbol* s = find_symbol(p, cpu, addr);
+    if (s && s->addr == addr) snprintf(buf, len, "%s", s->name);
+    else if (s) snprintf(buf, len, "%s+0x%x", s->name, addr - s->addr);
+    else if (func) snprintf(buf, len, "sub_%08x", addr);
+    else buf[0] = '\0';
+}
+
+typedef struct {
+    u32 addr;
+    u64 count;
+} ProfRow;
+
+static int cmp_row_count(const void* a, const void* b) {
+    u64 x = ((ProfRow*) a)->count;
+    u64 y = ((ProfRow*) b)->count;
+    return (x < y) - (x > y);
+}
+
+static int cmp_row_addr(const void* a, const void* b) {
+    u32 x = ((ProfRow*) a)->addr;
+    u32 y = ((ProfRow*) b)->addr;
+    return (x > y) - (x < y);
+}
+
+static ProfRow* table_rows(ProfTable* t) {
+    ProfRow* rows = malloc((t->size + 1) * sizeof *rows);
+    u32 n = 0;
+    for (u32 i = 0; i < t->cap; i++) {
+        if (t->keys[i]) rows[n++] = (ProfRow){t->keys[i] & ~1, t->counts[i]};
+    }
+    return rows;
+}
+
+static void report_cpu(Profiler* p, int cpu, FILE* out, int top) {
+    u64 total = p->samples[cpu];
+    fprintf(out, "%s: %llu samples every %d cycles, %.2f%% halted\n",
+            cpu_names[cpu], (unsigned long long) total, PROF_PERIOD,
+            total ? 100.0 * p->halted[cpu] / total : 0);
+    if (!total) return;
+
+    ProfRow* addrs = table_rows(&p->addrs[cpu]);
+    u32 n_addrs = p->addrs[cpu].size;
+
+    // the last row collects samples before the first detected function
+    u32 n_funcs = p->calls[cpu].size;
+    ProfRow* funcs = table_rows(&p->calls[cpu]);
+    qsort(funcs, n_funcs, sizeof *funcs, cmp_row_addr);
+    for (u32 i = 0; i < n_funcs; i++) funcs[i].count = 0;
+    funcs[n_funcs] = (ProfRow){0xffffffff, 0};
+    for (u32 i = 0; i < n_addrs; i++) {
+        int lo = 0, hi = n_funcs - 1, f = -1;
+        while (lo <= hi) {
+            int mid = (lo + hi) / 2;
+            if (funcs[mid].addr <= addrs[i].addr) {
+                f = mid;
+                lo = mid + 1;
+            } else hi = mid - 1;
+        }
+        if (f < 0 || (funcs[f].addr ^ addrs[i].addr) >> 24) f = n_funcs;
+        funcs[f].count += addrs[i].count;
+    }
+    qsort(funcs, n_funcs + 1, sizeof *funcs, cmp_row_count);
+    qsort(addrs, n_addrs, sizeof *addrs, cmp_row_count);
+
+    char name[300];
+    fprintf(out, "\n  functions (by bl target)\n");
+    fprintf(out, "  %7s %10s %10s  %-8s  %s\n", "self%", "samples", "calls",
+            "address", "name");
+    for (u32 i = 0; i < n_funcs + 1 && i < top; i++) {
+        if (!funcs[i].count) break;
+        if (funcs[i].addr == 0xffffffff) {
+            fprintf(out, "  %6.2f%% %10llu %10s  %-8s  %s\n",
+                    100.0 * funcs[i].count / total,
+                    (unsigned long long) funcs[i].count, "-", "-",
+                    "(unknown)");
+            continue;
+        }
+        format_name(p, cpu, funcs[i].addr, true, name, sizeof name);
+        fprintf(out, "  %6.2f%% %10llu %10u  %08x  %s\n",
+                100.0 * funcs[i].count / total,
+                (unsigned long long) funcs[i].count,
+                table_get(&p->calls[cpu], funcs[i].addr), funcs[i].addr, name);
+    }
+
+    fprintf(out, "\n  addresses\n");
+    fprintf(out, "  %7s %10s  %-8s  %s\n", "self%", "samples", "address",
+            "name");
+    for (u32 i = 0; i < n_addrs && i < top; i++) {
+        format_name(p, cpu, addrs[i].addr, false, name, sizeof name);
+        fprintf(out, "  %6.2f%% %10llu  %08x  %s\n",
+                100.0 * addrs[i].count / total,
+                (unsigned long long) addrs[i].count, addrs[i].addr, name);
+    }
+    fprintf(out, "\n");
+
+    free(addrs);
+    free(funcs);
+}
+
+void profiler_report(Profiler* p, FILE* out, int top) {
+    report_cpu(p, CPU9, out, top);
+    report_cpu(p, CPU7, out, top);
+    fflush(out);
+}
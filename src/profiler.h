@@ -0,0 +1,56 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+#define PROF_PERIOD 1024
+#define PROF_TOP 40
+
+typedef struct {
+    u32 addr;
+    u32 size;
+    char* name;
+} ProfSymbol;
+
+// open addressing, keys are stored with bit 0 set so 0 marks an empty slot
+typedef struct {
+    u32* keys;
+    u32* counts;
+    u32 cap;
+    u32 size;
+} ProfTable;
+
+// each cpu is sampled every PROF_PERIOD cycles at the end of its slice in
+// nds_run. functions are detected from bl/blx targets and each sample is
+// attributed to the closest preceding target in the same memory region
+typedef struct {
+    FILE* fp;
+
+    u64 next_sample[2];
+    u64 samples[2];
+    u64 halted[2];
+
+    ProfTable addrs[2];
+    ProfTable calls[2];
+
+    ProfSymbol* syms[2];
+    int n_syms[2];
+} Profiler;
+
+typedef struct _NDS NDS;
+typedef struct _ArmCore ArmCore;
+
+Profiler* profiler_open(char* filename);
+void profiler_close(Profiler* p);
+
+// elf or linker map file, cpu is CPU9 or CPU7
+bool profiler_load_symbols(Profiler* p, int cpu, char* filename);
+
+void profiler_attach(Profiler* p, NDS* nds);
+void profiler_sample(Profiler* p, int cpu, ArmCore* core, bool halt, u64 now);
+
+void profiler_report(Profiler* p, FILE* out, int top);
+
+#endif
@@ -0,0 +1,363 @@
+#include "rewind.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "nds.h"
+
+// the recorders and the debugger's breakpoints are detached while replaying
+typedef struct {
+    Breakpoints* bkpt;
+    Watchpoints* watch;
+    Tracer* trace;
+    GXLog* gxlog;
+    PPULog* ppulog;
+    Profiler* prof;
+    CpuTrace* cputrace;
+    void (*call_hook7)(ArmCore* cpu, u32 dest);
+    void (*call_hook9)(ArmCore* cpu, u32 dest);
+    void (*exec_hook7)(ArmCore* cpu);
+    void (*exec_hook9)(ArmCore* cpu);
+} Attached;
+
+static void detach(Rewind* r, NDS* nds, Attached* a) {
+    *a = (Attached){nds->bkpt,
+                    nds->watch,
+                    nds->trace,
+                    nds->gxlog,
+                    nds->ppulog,
+                    nds->prof,
+                    nds->cputrace,
+                    nds->cpu7.c.call_hook,
+                    nds->cpu9.c.call_hook,
+                    nds->cpu7.c.exec_hook,
+                    nds->cpu9.c.exec_hook};
+    nds->bkpt = &r->bkpt;
+    nds->watch = NULL;
+    nds->trace = NULL;
+    nds->gxlog = NULL;
+    nds->ppulog = NULL;
+    nds->prof = NULL;
+    nds->cputrace = NULL;
+    nds->cpu7.c.call_hook = NULL;
+    nds->cpu9.c.call_hook = NULL;
+    nds->cpu7.c.exec_hook = NULL;
+    nds->cpu9.c.exec_hook = NULL;
+}
+
+static void attach(NDS* nds, Attached* a) {
+    nds->bkpt = a->bkpt;
+    nds->watch = a->watch;
+    nds->trace = a->trace;
+    nds->gxlog = a->gxlog;
+    nds->ppulog = a->ppulog;
+    nds->prof = a->prof;
+    nds->cputrace = a->cputrace;
+    nds->cpu7.c.call_hook = a->call_hook7;
+    nds->cpu9.c.call_hook = a->call_hook9;
+    nds->cpu7.c.exec_hook = a->exec_hook7;
+    nds->cpu9.c.exec_hook = a->exec_hook9;
+}
+
+static u64 total_steps(NDS* nds) {
+    return nds->steps[CPU9] + nds->steps[CPU7];
+}
+
+void rewind_init(Rewind* r) {
+    r->budget = REWIND_BUDGET;
+    r->interval = REWIND_INTERVAL;
+    bkpt_clear(&r->bkpt);
+}
+
+void rewind_free(Rewind* r) {
+    for (int i = 0; i < r->n; i++) free(r->cp[i].data);
+    free(r->cp);
+    free(r->input);
+    free(r->state);
+    free(r->comp);
+}
+
+// one input from before the first checkpoint is kept to compare the next
+// against
+static void drop_oldest(Rewind* r) {
+    r->bytes -= r->cp[0].len;
+    free(r->cp[0].data);
+    r->n--;
+    memmove(&r->cp[0], &r->cp[1], r->n * sizeof *r->cp);
+
+    int i = 0;
+    while (i + 1 < r->n_input && r->input[i + 1].time < r->cp[0].time) i++;
+    r->n_input -= i;
+    memmove(&r->input[0], &r->input[i], r->n_input * sizeof *r->input);
+}
+
+static void checkpoint(Rewind* r, NDS* nds) {
+    // the size changes with the save
+    size_t size = nds_state_size(nds);
+    if (size > r->state_cap) {
+        r->state_cap = size;
+        r->state = realloc(r->state, size);
+        r->comp = realloc(r->comp, LZ_BOUND(size));
+    }
+    nds_save_state(nds, r->state);
+    size_t len = lz_compress(r->state, size, r->comp, r->lz_table);
+    u8* data = r->comp;
+    if (len >= size) {
+        len = size;
+        data = r->state;
+    }
+
+    if (r->n == r->cap) {
+        r->cap = r->cap ? 2 * r->cap : 64;
+        r->cp = realloc(r->cp, r->cap * sizeof *r->cp);
+    }
+    Checkpoint* c = &r->cp[r->n++];
+    c->data = malloc(len);
+    memcpy(c->data, data, len);
+    c->len = len;
+    c->size = size;
+    c->steps[CPU9] = nds->steps[CPU9];
+    c->steps[CPU7] = nds->steps[CPU7];
+    c->time = nds->last_event;
+    c->frameskip = nds->frameskip;
+    r->bytes += len;
+    r->next = total_steps(nds) + r->interval;
+
+    while (r->bytes > r->budget && r->n > 1) drop_oldest(r);
+}
+
+// the frontend only changes the input at the start of a batch, after an
+// nds_run which reached its end and before any instruction
+static void batch_end(Rewind* r, NDS* nds) {
+    r->batch_steps = total_steps(nds);
+    r->batch_time = nds->last_event;
+}
+
+bool rewind_at_batch(Rewind* r, NDS* nds) {
+    return nds->cur_cpu_type == CPU9 && nds->sched.now == nds->last_event &&
+           nds->last_event == r->batch_time &&
+           total_steps(nds) == r->batch_steps;
+}
+
+void rewind_reset(Rewind* r, NDS* nds) {
+    for (int i = 0; i < r->n; i++) free(r->cp[i].data);
+    r->n = 0;
+    r->bytes = 0;
+    r->n_input = 0;
+    batch_end(r, nds);
+    checkpoint(r, nds);
+}
+
+void rewind_update(Rewind* r, NDS* nds) {
+    batch_end(r, nds);
+    if (total_steps(nds) >= r->next) checkpoint(r, nds);
+}
+
+void rewind_input(Rewind* r, NDS* nds) {
+    RewindInput in = {.time = nds->last_event,
+                      .keys = nds->io7.keyinput.keys,
+                      .x = nds->io7.extkeyin.x,
+                      .y = nds->io7.extkeyin.y,
+                      .pen = nds->io7.extkeyin.pen,
+                      .tsc_x = nds->tsc.x,
+                      .tsc_y = nds->tsc.y,
+                      .frameskip = nds->frameskip};
+    if (r->n_input) {
+        RewindInput* last = &r->input[r->n_input - 1];
+        if (in.keys == last->keys && in.x == last->x && in.y == last->y &&
+            in.pen == last->pen && in.tsc_x == last->tsc_x &&
+            in.tsc_y == last->tsc_y && in.frameskip == last->frameskip)
+            return;
+    }
+    if (r->n_input == r->cap_input) {
+        r->cap_input = r->cap_input ? 2 * r->cap_input : 256;
+        r->input = realloc(r->input, r->cap_input * sizeof *r->input);
+    }
+    r->input[r->n_input++] = in;
+}
+
+void rewind_set_limits(Rewind* r, u64 interval, size_t budget) {
+    r->interval = interval;
+    r->budget = budget;
+    Checkpoint* c = &r->cp[r->n - 1];
+    r->next = c->steps[CPU9] + c->steps[CPU7] + interval;
+    while (r->bytes > r->budget && r->n > 1) drop_oldest(r);
+}
+
+// same as the frontend's apply_input
+static void apply_inputs(Rewind* r, NDS* nds) {
+    for (; r->replay_input < r->n_input &&
+           r->input[r->replay_input].time <= nds->last_event;
+         r->replay_input++) {
+        RewindInput* in = &r->input[r->replay_input];
+        nds->io7.keyinput.keys = in->keys;
+        nds->io9.keyinput = nds->io7.keyinput;
+        nds->io7.extkeyin.x = in->x;
+        nds->io7.extkeyin.y = in->y;
+        nds->io7.extkeyin.pen = in->pen;
+        nds->tsc.x = in->tsc_x;
+        nds->tsc.y = in->tsc_y;
+        nds->frameskip = in->frameskip;
+    }
+}
+
+static void restore(Rewind* r, NDS* nds, int i) {
+    Checkpoint* c = &r->cp[i];
+    if (c->len == c->size) memcpy(r->state, c->data, c->size);
+    else lz_decompress(c->data, c->len, r->state, c->size);
+    nds_load_state(nds, r->state, c->size);
+    nds->frameskip = c->frameskip;
+    nds->frame_complete = false;
+    nds->samples_full = false;
+
+    r->replay_input = 0;
+    while (r->replay_input < r->n_input &&
+           r->input[r->replay_input].time < c->time)
+        r->replay_input++;
+    r->batch_steps = c->steps[CPU9] + c->steps[CPU7];
+    r->batch_time = c->time;
+}
+
+// a hit is only kept if it was before the position the search started from.
+// a watchpoint hit by the instruction just before it is the one that stopped
+// there
+static void record_hit(Rewind* r, RewindHit kind, int cpu, u64 steps, int i) {
+    if (steps >= r->end_steps[cpu]) return;
+    if (kind == REWIND_WATCH && cpu == r->end_cpu &&
+        steps + 1 == r->end_steps[cpu])
+        return;
+    r->hit = kind;
+    r->hit_cpu = cpu;
+    r->hit_steps = steps;
+    r->hit_index = i;
+}
+
+// replays until the stop in r->bkpt is reached, returning true, or until a
+// batch ends at or after end. hits of r->bkpt and r->watch are recorded and
+// breakpoints are stepped over
+static bool replay(Rewind* r, NDS* nds, u64 end) {
+    bool stop = r->bkpt.stop;
+    if (rewind_at_batch(r, nds)) apply_inputs(r, nds);
+    while (true) {
+        nds_run(nds);
+        bool batch = !nds->debug_stop;
+        if (nds->debug_stop) {
+            nds->debug_stop = false;
+            if (stop && !r->bkpt.stop) return true;
+            if (r->bkpt.hit) {
+                r->bkpt.hit = false;
+                int cpu = nds->cur_cpu_type;
+                record_hit(r, REWIND_BKPT, cpu, nds->steps[cpu],
+                           r->bkpt.hit_bp);
+                batch = nds_step(nds) && nds->cur_cpu_type == CPU9;
+                nds->debug_stop = false;
+            }
+            if (r->watch.hit) {
+                r->watch.hit = false;
+                int cpu = r->watch.hit_cpu;
+                record_hit(r, REWIND_WATCH, cpu, nds->steps[cpu] - 1,
+                           r->watch.hit_wp);
+            }
+        }
+        nds->frame_complete = false;
+        nds->samples_full = false;
+        if (batch) {
+            batch_end(r, nds);
+            if (nds->last_event >= end) return false;
+            apply_inputs(r, nds);
+        }
+    }
+}
+
+// the last checkpoint where the cpu has executed at most steps
+static int find(Rewind* r, int cpu, u64 steps) {
+    int i = r->n - 1;
+    while (i >= 0 && r->cp[i].steps[cpu] > steps) i--;
+    return i;
+}
+
+// goes to just before the cpu executes the instruction after steps
+static void seek(Rewind* r, NDS* nds, int cpu, u64 steps) {
+    restore(r, nds, find(r, cpu, steps));
+    bkpt_clear(&r->bkpt);
+    r->bkpt.stop = true;
+    r->bkpt.stop_cpu = cpu;
+    r->bkpt.stop_steps = steps;
+    replay(r, nds, -1);
+}
+
+// what runs after a position reached by going back replaces the rest of the
+// history
+static void cut_history(Rewind* r, NDS* nds) {
+    while (r->n > 1 && r->cp[r->n - 1].time > nds->last_event) {
+        r->n--;
+        r->bytes -= r->cp[r->n].len;
+        free(r->cp[r->n].data);
+    }
+    while (r->n_input && r->input[r->n_input - 1].time > nds->last_event)
+        r->n_input--;
+    Checkpoint* c = &r->cp[r->n - 1];
+    r->next = c->steps[CPU9] + c->steps[CPU7] + r->interval;
+}
+
+bool rewind_step(Rewind* r, NDS* nds) {
+    int cpu = nds->cur_cpu_type;
+    if (!nds->steps[cpu] || find(r, cpu, nds->steps[cpu] - 1) < 0)
+        return false;
+    Attached a;
+    detach(r, nds, &a);
+    seek(r, nds, cpu, nds->steps[cpu] - 1);
+    attach(nds, &a);
+    cut_history(r, nds);
+    return true;
+}
+
+// each interval between checkpoints is replayed from the newest back until
+// one has a hit. breakpoints are checked without their ignore counts
+RewindHit rewind_continue(Rewind* r, NDS* nds, Breakpoints* b, Watchpoints* w) {
+    Attached a;
+    detach(r, nds, &a);
+    r->end_steps[CPU9] = nds->steps[CPU9];
+    r->end_steps[CPU7] = nds->steps[CPU7];
+    r->end_cpu = nds->cur_cpu_type;
+    u64 end = nds->last_event + 1;
+
+    memcpy(&r->bkpt, b, sizeof *b);
+    for (int i = 0; i < r->bkpt.n; i++) r->bkpt.bp[i].ignore = 0;
+    r->bkpt.hit = false;
+    r->bkpt.stop = false;
+    memcpy(&r->watch, w, sizeof *w);
+    r->watch.hit = false;
+    nds->watch = &r->watch;
+
+    r->hit = REWIND_NONE;
+    for (int i = r->n - 1; i >= 0 && !r->hit; i--) {
+        restore(r, nds, i);
+        replay(r, nds, i + 1 < r->n ? r->cp[i + 1].time : end);
+    }
+
+    nds->watch = NULL;
+    RewindHit hit = r->hit;
+    if (hit == REWIND_NONE) {
+        restore(r, nds, 0);
+    } else {
+        seek(r, nds, r->hit_cpu, r->hit_steps);
+        if (hit == REWIND_BKPT) {
+            b->hit = true;
+            b->hit_bp = r->hit_index;
+        } else {
+            // run the instruction again to stop after it like the hit did
+            nds->watch = w;
+            w->hit = false;
+            r->bkpt.stop = true;
+            r->bkpt.stop_cpu = r->hit_cpu;
+            r->bkpt.stop_steps = r->hit_steps + 1;
+            while (!nds->debug_stop) nds_run(nds);
+            nds->debug_stop = false;
+            r->bkpt.stop = false;
+        }
+    }
+    attach(nds, &a);
+    cut_history(r, nds);
+    return hit;
+}
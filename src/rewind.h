@@ -0,0 +1,104 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+
+#include "breakpoint.h"
+#include "lz.h"
+#include "types.h"
+#include "watch.h"
+
+// instructions run by both cpus between checkpoints
+#define REWIND_INTERVAL (1 << 24)
+// compressed bytes kept for checkpoints
+#define REWIND_BUDGET (256 << 20)
+
+typedef struct {
+    u8* data;
+    size_t len;
+    size_t size;
+    u64 steps[2];
+    u64 time;
+    int frameskip;
+} Checkpoint;
+
+// the input registers written by the frontend and the frameskip from the
+// batch starting at time
+typedef struct {
+    u64 time;
+    u16 keys;
+    u8 x;
+    u8 y;
+    u8 pen;
+    u8 tsc_x;
+    u8 tsc_y;
+    int frameskip;
+} RewindInput;
+
+typedef enum { REWIND_NONE, REWIND_BKPT, REWIND_WATCH } RewindHit;
+
+// the history since the last reset or change made by the debugger. full
+// states are compressed at the end of the first batch after interval
+// instructions since the last one, and the oldest are dropped to stay in
+// budget. emulation is deterministic given the input, which the frontend
+// only changes between batches, so any earlier position is reached by
+// loading the last checkpoint before it and replaying with nds_run and a
+// stop at the step count in the breakpoints. the sd card is not part of the
+// state and is not rewound
+typedef struct {
+    Checkpoint* cp;
+    int n;
+    int cap;
+    size_t bytes;
+    size_t budget;
+    u64 interval;
+    u64 next;
+
+    RewindInput* input;
+    int n_input;
+    int cap_input;
+    int replay_input;
+    u64 batch_steps;
+    u64 batch_time;
+
+    // used in place of the debugger's while replaying, with copies of its
+    // breakpoints and watchpoints when searching for hits
+    Breakpoints bkpt;
+    Watchpoints watch;
+    u64 end_steps[2];
+    int end_cpu;
+    RewindHit hit;
+    int hit_cpu;
+    u64 hit_steps;
+    int hit_index;
+
+    u8* state;
+    u8* comp;
+    size_t state_cap;
+    u32 lz_table[1 << LZ_HASH_BITS];
+} Rewind;
+
+typedef struct _NDS NDS;
+
+void rewind_init(Rewind* r);
+void rewind_free(Rewind* r);
+
+// starts the history at the current state
+void rewind_reset(Rewind* r, NDS* nds);
+// called after each nds_run which reached the end of its batch
+void rewind_update(Rewind* r, NDS* nds);
+// true if no instruction ran since the last batch ended, the frontend only
+// changes the input then
+bool rewind_at_batch(Rewind* r, NDS* nds);
+// called after the input is applied at the start of a batch
+void rewind_input(Rewind* r, NDS* nds);
+void rewind_set_limits(Rewind* r, u64 interval, size_t budget);
+
+// goes back to before the current cpu's previous instruction, returns false
+// if it isn't in the history
+bool rewind_step(Rewind* r, NDS* nds);
+// goes back to the last hit of b or w and sets its hit info, or to the start
+// of the history if there is none
+RewindHit rewind_continue(Rewind* r, NDS* nds, Breakpoints* b, Watchpoints* w);
+
+#endif
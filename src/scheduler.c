@@ -23,6 +23,8 @@ int run_next_event(Scheduler* sched) {
     FIFO_pop(sched->event_queue, e);
     sched->now = e.time;
 
+    u64 host_start = sched->master->trace ? trace_host_time() : 0;
+
     if (e.type == EVENT_LCD_HDRAW) {
         lcd_hdraw(sched->master);
     } else if (e.type == EVENT_LCD_HBLANK) {
@@ -55,6 +57,11 @@ int run_next_event(Scheduler* sched) {
         spu_tick_capture(&sched->master->spu, e.type - EVENT_SPU_CAP0);
     }
 
+    if (sched->master->trace) {
+        trace_span(sched->master->trace, TRACE_SCHED, event_name(e.type),
+                   e.time, sched->now, host_start, NULL);
+    }
+
     return sched->now - e.time;
 }
 
@@ -98,20 +105,26 @@ u64 find_event(Scheduler* sched, EventType t) {
     return -1;
 }
 
-void print_scheduled_events(Scheduler* sched) {
-    static char* event_names[EVENT_MAX] = {
-        "LCD HDraw",    "LCD HBlank",   "GameCard DRQ", "TM0-7 Reload",
-        "TM1-7 Reload", "TM2-7 Reload", "TM3-7 Reload", "TM0-9 Reload",
-        "TM1-9 Reload", "TM2-9 Reload", "TM3-9 Reload", "SPU Sample"};
+const char* event_name(EventType t) {
+    static const char* event_names[EVENT_MAX] = {
+        "LCD HDraw",        "LCD HBlank",       "GameCard DRQ",
+        "TM0-7 Reload",     "TM1-7 Reload",     "TM2-7 Reload",
+        "TM3-7 Reload",     "TM0-9 Reload",     "TM1-9 Reload",
+        "TM2-9 Reload",     "TM3-9 Reload",     "SPU Sample",
+        "SPU CH0 Reload",   "SPU CH1 Reload",   "SPU CH2 Reload",
+        "SPU CH3 Reload",   "SPU CH4 Reload",   "SPU CH5 Reload",
+        "SPU CH6 Reload",   "SPU CH7 Reload",   "SPU CH8 Reload",
+        "SPU CH9 Reload",   "SPU CHA Reload",   "SPU CHB Reload",
+        "SPU CHC Reload",   "SPU CHD Reload",   "SPU CHE Reload",
+        "SPU CHF Reload",   "SPU CAP0 Reload",  "SPU CAP1 Reload"};
+    if (t >= EVENT_MAX || !event_names[t]) return "Unknown";
+    return event_names[t];
+}
 
+void print_scheduled_events(Scheduler* sched) {
     printf("Now: %ld\n", sched->now);
     FIFO_foreach(i, sched->event_queue) {
-        if (sched->event_queue.d[i].type < EVENT_SPU_CH0) {
-            printf("%ld => %s\n", sched->event_queue.d[i].time,
-                   event_names[sched->event_queue.d[i].type]);
-        } else {
-            printf("%ld => SPU CH%x Reload\n", sched->event_queue.d[i].time,
-                   sched->event_queue.d[i].type - EVENT_SPU_CH0);
-        }
+        printf("%ld => %s\n", sched->event_queue.d[i].time,
+               event_name(sched->event_queue.d[i].type));
     }
 }
@@ -49,6 +49,7 @@ void add_event(Scheduler* sched, EventType t, u64 time);
 void remove_event(Scheduler* sched, EventType t);
 u64 find_event(Scheduler* sched, EventType t);
 
+const char* event_name(EventType t);
 void print_scheduled_events(Scheduler* sched);
 
 #endif
\ No newline at end of file
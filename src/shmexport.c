@@ -0,0 +1,70 @@
+#include "shmexport.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+ShmExport* shmexport_open(char* name) {
+    int fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, sizeof(ShmLayout)) < 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    ShmLayout* shm = mmap(NULL, sizeof(ShmLayout), PROT_READ | PROT_WRITE,
+                          MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // the segment may be left over from a previous run
+    memset(shm, 0, sizeof *shm);
+    shm->version = SHM_VERSION;
+    shm->width = NDS_SCREEN_W;
+    shm->height = NDS_SCREEN_H;
+    shm->sample_freq = SAMPLE_FREQ;
+    shm->audio_len = SHM_AUDIO_LEN;
+    // readers check the magic last
+    atomic_thread_fence(memory_order_release);
+    shm->magic = SHM_MAGIC;
+
+    ShmExport* e = calloc(1, sizeof *e);
+    e->name = strdup(name);
+    e->shm = shm;
+    return e;
+}
+
+void shmexport_close(ShmExport* e) {
+    if (!e) return;
+    munmap(e->shm, sizeof(ShmLayout));
+    shm_unlink(e->name);
+    free(e->name);
+    free(e);
+}
+
+void shmexport_frame(ShmExport* e, u16* top, u16* bottom) {
+    u32 n = e->frames + 1;
+    atomic_uint* seq = &e->shm->frames[n % 2].seq;
+    atomic_fetch_add_explicit(seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(e->shm->frames[n % 2].top, top, sizeof e->shm->frames[0].top);
+    memcpy(e->shm->frames[n % 2].bottom, bottom,
+           sizeof e->shm->frames[0].bottom);
+    atomic_fetch_add_explicit(seq, 1, memory_order_release);
+    atomic_store_explicit(&e->shm->frame_count, n, memory_order_release);
+    e->frames = n;
+}
+
+// buffers are a divisor of the ring size so they never wrap
+void shmexport_audio(ShmExport* e, float* samples, int len) {
+    memcpy(&e->shm->audio[e->audio_pos % SHM_AUDIO_LEN], samples,
+           len * sizeof *samples);
+    e->audio_pos += len;
+    atomic_store_explicit(&e->shm->audio_pos, e->audio_pos,
+                          memory_order_release);
+}
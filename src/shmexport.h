@@ -0,0 +1,65 @@
+#ifndef SHMEXPORT_H
+#define SHMEXPORT_H
+
+#include <stdatomic.h>
+
+#include "ppu.h"
+#include "spu.h"
+#include "types.h"
+
+#define SHM_MAGIC 0x4d48534e
+#define SHM_VERSION 1
+#define SHM_AUDIO_LEN (32 * SAMPLE_BUF_LEN)
+#define SHM_TOUCH_PRESSED (1u << 31)
+
+// layout of the shared memory segment, which other processes map read/write
+//
+// frame n is written to frames[n % 2] and frame_count is set to n once it is
+// complete. the seq of a slot is odd while it is being written, so a reader
+// loads frame_count, reads the slot in place and checks the seq was even and
+// did not change. the slot is not written again until the next frame is done.
+//
+// audio is a ring of interleaved stereo samples at SAMPLE_FREQ and audio_pos
+// is the total number of floats written, it is updated after each buffer is
+// copied in. samples from audio_pos - SHM_AUDIO_LEN + SAMPLE_BUF_LEN on are
+// safe to read.
+//
+// keys and touch are written by the other process. keys has a set bit for
+// each pressed key in keyinput order followed by x and y, and is combined
+// with the host input. touch is SHM_TOUCH_PRESSED | y << 8 | x or 0
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 width;
+    u32 height;
+    u32 sample_freq;
+    u32 audio_len;
+
+    atomic_uint frame_count;
+    atomic_uint keys;
+    atomic_uint touch;
+    _Atomic u64 audio_pos;
+
+    struct {
+        atomic_uint seq;
+        u16 top[NDS_SCREEN_H][NDS_SCREEN_W];
+        u16 bottom[NDS_SCREEN_H][NDS_SCREEN_W];
+    } frames[2];
+
+    float audio[SHM_AUDIO_LEN];
+} ShmLayout;
+
+typedef struct {
+    char* name;
+    ShmLayout* shm;
+    u32 frames;
+    u64 audio_pos;
+} ShmExport;
+
+ShmExport* shmexport_open(char* name);
+void shmexport_close(ShmExport* e);
+
+void shmexport_frame(ShmExport* e, u16* top, u16* bottom);
+void shmexport_audio(ShmExport* e, float* samples, int len);
+
+#endif
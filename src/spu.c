@@ -233,8 +233,10 @@ void spu_sample(SPU* spu) {
         spu->sample_buf[spu->sample_idx++] = 0;
         spu->sample_buf[spu->sample_idx++] = 0;
     }
-    if (spu->sample_idx == SAMPLE_BUF_LEN) {
-        spu->sample_idx = 0;
+    if (spu->sample_idx % SAMPLE_BUF_LEN == 0) {
+        spu->sample_full = spu->sample_idx - SAMPLE_BUF_LEN;
+        if (spu->sample_idx == SAMPLE_BUFS * SAMPLE_BUF_LEN)
+            spu->sample_idx = 0;
         spu->master->samples_full = true;
     }
     add_event(&spu->master->sched, EVENT_SPU_SAMPLE,
@@ -4,6 +4,9 @@
 #include "types.h"
 
 #define SAMPLE_BUF_LEN 1024
+// samples are written to a ring of blocks and samples_full is set whenever
+// one is filled
+#define SAMPLE_BUFS 4
 #define SAMPLE_FREQ (1 << 15)
 
 #define BUS_CLK (1 << 25)
@@ -15,8 +18,10 @@ typedef struct _NDS NDS;
 typedef struct {
     NDS* master;
 
-    float sample_buf[SAMPLE_BUF_LEN];
+    float sample_buf[SAMPLE_BUFS * SAMPLE_BUF_LEN];
     int sample_idx;
+    // start of the last filled block
+    int sample_full;
 
     u32 sample_ptrs[16];
     bool adpcm_hi[16];
@@ -0,0 +1,100 @@
+#include "stretch.h"
+
+#include <math.h>
+#include <string.h>
+
+#define COARSE_STEP 4
+
+void stretch_init(Stretch* s, double speed) {
+    s->len = 0;
+    s->pos = 0;
+    s->prev = -1;
+    s->speed = speed;
+}
+
+void stretch_set_speed(Stretch* s, double speed) {
+    s->speed = speed;
+}
+
+static void drop(Stretch* s, int n) {
+    if (n <= 0) return;
+    if (n > s->len) n = s->len;
+    memmove(s->buf, &s->buf[2 * n], 2 * (s->len - n) * sizeof *s->buf);
+    s->len -= n;
+    s->pos -= n;
+    s->prev = s->prev >= n ? s->prev - n : -1;
+}
+
+// normalized correlation of the mono mix, step skips frames for the coarse
+// search
+static float similarity(const float* a, const float* b, int step) {
+    float corr = 0, energy = 1e-9;
+    for (int i = 0; i < STRETCH_HOP; i += step) {
+        float x = a[2 * i] + a[2 * i + 1];
+        float y = b[2 * i] + b[2 * i + 1];
+        corr += x * y;
+        energy += y * y;
+    }
+    return corr / sqrtf(energy);
+}
+
+static int best_offset(Stretch* s, const float* ref, int lo, int hi) {
+    int best = lo;
+    float best_sim = -INFINITY;
+    for (int k = lo; k <= hi; k += COARSE_STEP) {
+        float sim = similarity(ref, &s->buf[2 * k], 2);
+        if (sim > best_sim) best_sim = sim, best = k;
+    }
+    int center = best;
+    for (int k = center - COARSE_STEP + 1; k < center + COARSE_STEP; k++) {
+        if (k < lo || k > hi || k == center) continue;
+        float sim = similarity(ref, &s->buf[2 * k], 1);
+        if (sim > best_sim) best_sim = sim, best = k;
+    }
+    return best;
+}
+
+int stretch_process(Stretch* s, const float* in, int frames, float* out,
+                    int max_out) {
+    // input which can no longer be used is dropped to make space
+    if (s->len + frames > STRETCH_BUF) drop(s, s->len + frames - STRETCH_BUF);
+    if (frames > STRETCH_BUF) {
+        in += 2 * (frames - STRETCH_BUF);
+        frames = STRETCH_BUF;
+    }
+    memcpy(&s->buf[2 * s->len], in, 2 * frames * sizeof *in);
+    s->len += frames;
+
+    int n = 0;
+    while (n + STRETCH_HOP <= max_out) {
+        int pos = s->pos;
+        if (pos < 0) pos = 0;
+        if (pos + STRETCH_SEEK + STRETCH_HOP > s->len) break;
+        if (s->prev >= 0 && s->prev + 2 * STRETCH_HOP > s->len) break;
+
+        int seg = pos;
+        float* dst = &out[2 * n];
+        if (s->prev >= 0) {
+            const float* ref = &s->buf[2 * (s->prev + STRETCH_HOP)];
+            int lo = pos - STRETCH_SEEK;
+            if (lo < 0) lo = 0;
+            seg = best_offset(s, ref, lo, pos + STRETCH_SEEK);
+            const float* src = &s->buf[2 * seg];
+            for (int i = 0; i < STRETCH_HOP; i++) {
+                float w = 0.5f - 0.5f * cosf(M_PI * (i + 0.5f) / STRETCH_HOP);
+                dst[2 * i] = ref[2 * i] * (1 - w) + src[2 * i] * w;
+                dst[2 * i + 1] = ref[2 * i + 1] * (1 - w) + src[2 * i + 1] * w;
+            }
+        } else {
+            memcpy(dst, &s->buf[2 * seg], 2 * STRETCH_HOP * sizeof *dst);
+        }
+        n += STRETCH_HOP;
+        s->prev = seg;
+        s->pos += STRETCH_HOP * s->speed;
+
+        int keep = s->pos - STRETCH_SEEK;
+        if (s->prev < keep) keep = s->prev;
+        drop(s, keep);
+    }
+    return n;
+}
@@ -0,0 +1,33 @@
+#ifndef STRETCH_H
+#define STRETCH_H
+
+#include "types.h"
+
+// all lengths are in stereo frames
+#define STRETCH_HOP 512
+#define STRETCH_SEEK 256
+#define STRETCH_BUF (1 << 14)
+
+// wsola time stretching, changes the duration of audio without changing its
+// pitch. output is made of STRETCH_HOP long segments taken from the input
+// every STRETCH_HOP * speed frames. each segment start is moved by up to
+// STRETCH_SEEK frames to where it best matches the continuation of the
+// previous segment and the two are crossfaded
+typedef struct {
+    float buf[2 * STRETCH_BUF];
+    int len;
+    double pos;
+    // start of the previous segment or -1
+    int prev;
+    double speed;
+} Stretch;
+
+void stretch_init(Stretch* s, double speed);
+void stretch_set_speed(Stretch* s, double speed);
+
+// returns the number of frames written to out, at most max_out. input which
+// did not fit is kept for the next call
+int stretch_process(Stretch* s, const float* in, int frames, float* out,
+                    int max_out);
+
+#endif
@@ -7,21 +7,36 @@
 
 const int RATES[4] = {0, 6, 8, 10};
 
-void update_timer_count(TimerController* tmc, int i) {
-    if (!tmc->io->tm[i].cnt.enable || tmc->io->tm[i].cnt.countup) {
-        tmc->set_time[i] = tmc->master->sched.now;
-        return;
-    }
+u16 timer_peek_count(TimerController* tmc, int i) {
+    if (!tmc->io->tm[i].cnt.enable || tmc->io->tm[i].cnt.countup)
+        return tmc->counter[i];
 
     int rate = RATES[tmc->io->tm[i].cnt.rate];
-    tmc->counter[i] += (tmc->master->sched.now >> rate) - (tmc->set_time[i] >> rate);
+    s64 count = tmc->counter[i] + (s64) ((tmc->master->sched.now >> rate) -
+                                         (tmc->set_time[i] >> rate));
+    if (count >= 0x10000) {
+        u32 period = 0x10000 - tmc->io->tm[i].reload;
+        count = tmc->io->tm[i].reload + (count - 0x10000) % period;
+    }
+    return count;
+}
+
+void update_timer_count(TimerController* tmc, int i) {
+    tmc->counter[i] = timer_peek_count(tmc, i);
     tmc->set_time[i] = tmc->master->sched.now;
 }
 
+bool timer_overflow_observable(TimerController* tmc, int i) {
+    if (tmc->io->tm[i].cnt.irq) return true;
+    return i + 1 < 4 && tmc->io->tm[i + 1].cnt.enable &&
+           tmc->io->tm[i + 1].cnt.countup;
+}
+
 void update_timer_reload(TimerController* tmc, int i) {
     remove_event(&tmc->master->sched, tmc->tm0_event + i);
 
     if (!tmc->io->tm[i].cnt.enable || tmc->io->tm[i].cnt.countup) return;
+    if (!timer_overflow_observable(tmc, i)) return;
 
     int rate = RATES[tmc->io->tm[i].cnt.rate];
     u64 rel_time = (tmc->set_time[i] + ((0x10000 - tmc->counter[i]) << rate)) & ~((1 << rate) - 1);
@@ -39,4 +54,20 @@ void reload_timer(TimerController* tmc, int i) {
         tmc->counter[i + 1]++;
         if (tmc->counter[i + 1] == 0) reload_timer(tmc, i + 1);
     }
-}
\ No newline at end of file
+}
+
+void write_timer_reload(TimerController* tmc, int i, u16 data) {
+    update_timer_count(tmc, i);
+    tmc->io->tm[i].reload = data;
+}
+
+void write_timer_cnt(TimerController* tmc, int i, u16 data) {
+    update_timer_count(tmc, i);
+    tmc->io->tm[i].cnt.h = data;
+    update_timer_reload(tmc, i);
+
+    if (i > 0) {
+        update_timer_count(tmc, i - 1);
+        update_timer_reload(tmc, i - 1);
+    }
+}
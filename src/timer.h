@@ -17,9 +17,14 @@ typedef struct {
     EventType tm0_event;
 } TimerController;
 
+// the current count without updating the stored one
+u16 timer_peek_count(TimerController* tmc, int i);
 void update_timer_count(TimerController* tmc, int i);
 void update_timer_reload(TimerController* tmc, int i);
 
 void reload_timer(TimerController* tmc, int i);
 
+void write_timer_reload(TimerController* tmc, int i, u16 data);
+void write_timer_cnt(TimerController* tmc, int i, u16 data);
+
 #endif
\ No newline at end of file
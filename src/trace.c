@@ -0,0 +1,123 @@
+#include "trace.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "nds.h"
+
+#define PID_EMU 1
+#define PID_HOST 2
+
+static const char* track_names[TRACE_MAX] = {
+    "Scheduler", "ARM9", "ARM7", "DMA9", "DMA7", "GX Commands", "GPU Render"};
+
+static void trace_flush(Tracer* t) {
+    fwrite(t->buf, 1, t->len, t->fp);
+    t->len = 0;
+}
+
+static void trace_printf(Tracer* t, const char* fmt, ...) {
+    if (t->len > TRACE_BUF_LEN - 1024) trace_flush(t);
+    va_list args;
+    va_start(args, fmt);
+    t->len += vsnprintf(t->buf + t->len, TRACE_BUF_LEN - t->len, fmt, args);
+    va_end(args);
+}
+
+static void trace_vprintf(Tracer* t, const char* fmt, va_list args) {
+    t->len += vsnprintf(t->buf + t->len, TRACE_BUF_LEN - t->len, fmt, args);
+}
+
+u64 trace_host_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+Tracer* trace_open(char* filename) {
+    FILE* fp = fopen(filename, "w");
+    if (!fp) return NULL;
+    Tracer* t = malloc(sizeof *t);
+    t->fp = fp;
+    t->len = 0;
+    t->host_start = trace_host_time();
+    pthread_mutex_init(&t->lock, NULL);
+
+    // every record after the first is preceded by its separator
+    trace_printf(t,
+                 "[\n{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\","
+                 "\"args\":{\"name\":\"Emulated\"}}",
+                 PID_EMU);
+    trace_printf(t,
+                 ",\n{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\","
+                 "\"args\":{\"name\":\"Host\"}}",
+                 PID_HOST);
+    for (int i = 0; i < TRACE_MAX; i++) {
+        trace_printf(t,
+                     ",\n{\"ph\":\"M\",\"pid\":%d,\"tid\":%d,"
+                     "\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                     i == TRACE_RENDER ? PID_HOST : PID_EMU, i,
+                     track_names[i]);
+    }
+    return t;
+}
+
+void trace_close(Tracer* t) {
+    if (!t) return;
+    trace_printf(t, "\n]\n");
+    trace_flush(t);
+    fclose(t->fp);
+    pthread_mutex_destroy(&t->lock);
+    free(t);
+}
+
+void trace_span(Tracer* t, TraceTrack track, const char* name, u64 start,
+                u64 end, u64 host_start, const char* args, ...) {
+    u64 host_end = trace_host_time();
+    pthread_mutex_lock(&t->lock);
+    trace_printf(t,
+                 ",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\","
+                 "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"host_us\":%.3f,"
+                 "\"host_dur_us\":%.3f",
+                 PID_EMU, track, name, start * 1e6 / NDS_CLOCK,
+                 (end - start) * 1e6 / NDS_CLOCK,
+                 (host_start - t->host_start) / 1e3,
+                 (host_end - host_start) / 1e3);
+    if (args) {
+        trace_printf(t, ",");
+        va_list ap;
+        va_start(ap, args);
+        trace_vprintf(t, args, ap);
+        va_end(ap);
+    }
+    trace_printf(t, "}}");
+    pthread_mutex_unlock(&t->lock);
+}
+
+void trace_host_span(Tracer* t, TraceTrack track, const char* name,
+                     u64 host_start, u64 host_end) {
+    pthread_mutex_lock(&t->lock);
+    trace_printf(t,
+                 ",\n{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"name\":\"%s\","
+                 "\"ts\":%.3f,\"dur\":%.3f}",
+                 PID_HOST, track, name, (host_start - t->host_start) / 1e3,
+                 (host_end - host_start) / 1e3);
+    pthread_mutex_unlock(&t->lock);
+}
+
+// args is the inside of a json object with the counter values
+void trace_host_counter(Tracer* t, const char* name, u64 host_time,
+                        const char* args, ...) {
+    pthread_mutex_lock(&t->lock);
+    trace_printf(t,
+                 ",\n{\"ph\":\"C\",\"pid\":%d,\"name\":\"%s\",\"ts\":%.3f,"
+                 "\"args\":{",
+                 PID_HOST, name, (host_time - t->host_start) / 1e3);
+    va_list ap;
+    va_start(ap, args);
+    trace_vprintf(t, args, ap);
+    va_end(ap);
+    trace_printf(t, "}}");
+    pthread_mutex_unlock(&t->lock);
+}
@@ -0,0 +1,45 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "types.h"
+
+#define TRACE_BUF_LEN (1 << 20)
+
+// emulated events are timestamped in emulated time, the render thread in host
+// time, each is shown as a separate process
+typedef enum {
+    TRACE_SCHED,
+    TRACE_ARM9,
+    TRACE_ARM7,
+    TRACE_DMA9,
+    TRACE_DMA7,
+    TRACE_GX,
+    TRACE_RENDER,
+    TRACE_MAX
+} TraceTrack;
+
+typedef struct {
+    FILE* fp;
+    pthread_mutex_t lock;
+    u64 host_start;
+    size_t len;
+    char buf[TRACE_BUF_LEN];
+} Tracer;
+
+Tracer* trace_open(char* filename);
+void trace_close(Tracer* t);
+
+u64 trace_host_time();
+
+// args is the inside of a json object or NULL
+void trace_span(Tracer* t, TraceTrack track, const char* name, u64 start,
+                u64 end, u64 host_start, const char* args, ...);
+void trace_host_span(Tracer* t, TraceTrack track, const char* name,
+                     u64 host_start, u64 host_end);
+void trace_host_counter(Tracer* t, const char* name, u64 host_time,
+                        const char* args, ...);
+
+#endif
@@ -0,0 +1,38 @@
+#include "triplebuf.h"
+
+#include <stdlib.h>
+
+void triplebuf_init(TripleBuf* tb, size_t size) {
+    for (int i = 0; i < 3; i++) {
+        tb->bufs[i] = calloc(1, size);
+    }
+    tb->back = 0;
+    atomic_init(&tb->middle, 1);
+    tb->front = 2;
+}
+
+void triplebuf_free(TripleBuf* tb) {
+    for (int i = 0; i < 3; i++) {
+        free(tb->bufs[i]);
+    }
+}
+
+void* triplebuf_back(TripleBuf* tb) {
+    return tb->bufs[tb->back];
+}
+
+void triplebuf_publish(TripleBuf* tb) {
+    tb->back = atomic_exchange_explicit(&tb->middle, tb->back | TRIPLEBUF_FRESH,
+                                        memory_order_acq_rel) &
+               ~TRIPLEBUF_FRESH;
+}
+
+void* triplebuf_acquire(TripleBuf* tb) {
+    if (!(atomic_load_explicit(&tb->middle, memory_order_acquire) &
+          TRIPLEBUF_FRESH))
+        return NULL;
+    tb->front = atomic_exchange_explicit(&tb->middle, tb->front,
+                                         memory_order_acq_rel) &
+                ~TRIPLEBUF_FRESH;
+    return tb->bufs[tb->front];
+}
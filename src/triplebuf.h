@@ -0,0 +1,32 @@
+#ifndef TRIPLEBUF_H
+#define TRIPLEBUF_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "types.h"
+
+#define TRIPLEBUF_FRESH 4
+
+// single producer single consumer triple buffer. the producer fills the back
+// buffer and swaps it with the middle one, the consumer swaps the middle one
+// with its front buffer when there is a newer frame. neither side ever waits
+typedef struct {
+    void* bufs[3];
+    int back;
+    int front;
+    // index of the middle buffer, TRIPLEBUF_FRESH is set until it is read
+    atomic_uint middle;
+} TripleBuf;
+
+void triplebuf_init(TripleBuf* tb, size_t size);
+void triplebuf_free(TripleBuf* tb);
+
+void* triplebuf_back(TripleBuf* tb);
+void triplebuf_publish(TripleBuf* tb);
+
+// the newest published buffer or NULL if nothing was published since the
+// last call
+void* triplebuf_acquire(TripleBuf* tb);
+
+#endif
@@ -0,0 +1,651 @@
+#include "vfat.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FAT_EOC 0x0fffffff
+#define ATTR_DIR 0x10
+#define ATTR_ARCHIVE 0x20
+#define ATTR_VOLUME 0x08
+#define ATTR_LFN 0x0f
+
+#define WR16(b, o, v) ((b)[o] = (v) & 0xff, (b)[(o) + 1] = ((v) >> 8) & 0xff)
+#define WR32(b, o, v) (WR16(b, o, v), WR16(b, (o) + 2, (v) >> 16))
+#define RD16(b, o) ((b)[o] | (b)[(o) + 1] << 8)
+#define RD32(b, o) (RD16(b, o) | (u32) RD16(b, (o) + 2) << 16)
+
+static int cmp_node_name(const void* a, const void* b) {
+    return strcmp((*(VFatNode**) a)->name, (*(VFatNode**) b)->name);
+}
+
+static VFatNode* new_node(char* path, char* name, VFatNode* parent) {
+    struct stat st;
+    if (stat(path, &st) < 0) return NULL;
+    if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) return NULL;
+    if (S_ISREG(st.st_mode) && st.st_size > 0xffffffff) return NULL;
+    VFatNode* n = calloc(1, sizeof *n);
+    n->path = strdup(path);
+    n->name = strdup(name);
+    n->dir = S_ISDIR(st.st_mode);
+    n->size = n->dir ? 0 : st.st_size;
+    n->mtime = st.st_mtime;
+    n->parent = parent;
+    n->fd = -1;
+    return n;
+}
+
+static void scan_dir(VFatNode* n) {
+    DIR* d = opendir(n->path);
+    if (!d) return;
+    struct dirent* e;
+    while ((e = readdir(d))) {
+        if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+        char* path = malloc(strlen(n->path) + strlen(e->d_name) + 2);
+        sprintf(path, "%s/%s", n->path, e->d_name);
+        VFatNode* c = new_node(path, e->d_name, n);
+        free(path);
+        if (!c) continue;
+        n->children =
+            realloc(n->children, (n->n_children + 1) * sizeof *n->children);
+        n->children[n->n_children++] = c;
+        if (c->dir) scan_dir(c);
+    }
+    closedir(d);
+    qsort(n->children, n->n_children, sizeof *n->children, cmp_node_name);
+}
+
+static void free_node(VFatNode* n) {
+    for (int i = 0; i < n->n_children; i++) free_node(n->children[i]);
+    free(n->children);
+    free(n->path);
+    free(n->name);
+    free(n->dirdata);
+    if (n->fd >= 0) close(n->fd);
+    free(n);
+}
+
+// decodes one code point, invalid bytes are taken as latin-1
+static u32 utf8_next(const char** s) {
+    const u8* p = (const u8*) *s;
+    u32 c = *p++;
+    int extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+    if (extra) {
+        u32 cp = c & (0x3f >> extra);
+        int i;
+        for (i = 0; i < extra && (p[i] & 0xc0) == 0x80; i++) {
+            cp = cp << 6 | (p[i] & 0x3f);
+        }
+        if (i == extra) {
+            c = cp;
+            p += extra;
+        }
+    }
+    *s = (const char*) p;
+    return c;
+}
+
+static int name_to_ucs2(const char* name, u16* out, int max) {
+    int len = 0;
+    while (*name && len < max) {
+        u32 c = utf8_next(&name);
+        out[len++] = c > 0xffff ? '_' : c;
+    }
+    return len;
+}
+
+static bool short_char(u8 c) {
+    return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           (c && strchr("$%'-_@~`!(){}^#&", c));
+}
+
+// names which are already valid upper case 8.3 names don't need a long name
+static bool is_short_name(const char* name, u8* out) {
+    memset(out, ' ', 11);
+    const char* dot = strrchr(name, '.');
+    int base = dot ? dot - name : strlen(name);
+    int ext = dot ? strlen(dot + 1) : 0;
+    if (base < 1 || base > 8 || ext > 3 || (dot && !ext)) return false;
+    for (int i = 0; i < base; i++) {
+        if (!short_char(name[i])) return false;
+        out[i] = name[i];
+    }
+    for (int i = 0; i < ext; i++) {
+        if (!short_char(dot[1 + i])) return false;
+        out[8 + i] = dot[1 + i];
+    }
+    return true;
+}
+
+static void make_short_name(const char* name, int idx, u8* out) {
+    memset(out, ' ', 11);
+    const char* dot = strrchr(name, '.');
+    if (dot == name) dot = NULL;
+    char tail[12];
+    int tlen = snprintf(tail, sizeof tail, "~%d", idx);
+    int n = 0;
+    for (const char* p = name; *p && p != dot && n < 8 - tlen; p++) {
+        u8 c = *p >= 'a' && *p <= 'z' ? *p - 'a' + 'A' : *p;
+        if (short_char(c) && c != '~') out[n++] = c;
+    }
+    if (!n) out[n++] = '_';
+    memcpy(&out[n], tail, tlen);
+    if (dot) {
+        n = 0;
+        for (const char* p = dot + 1; *p && n < 3; p++) {
+            u8 c = *p >= 'a' && *p <= 'z' ? *p - 'a' + 'A' : *p;
+            if (short_char(c)) out[8 + n++] = c;
+        }
+    }
+}
+
+static int lfn_entries(VFatNode* n) {
+    u8 tmp[11];
+    if (is_short_name(n->name, tmp)) return 0;
+    u16 ucs[256];
+    return (name_to_ucs2(n->name, ucs, 255) + 12) / 13;
+}
+
+static void assign_clusters(VFat* v, VFatNode* n, u32* next) {
+    if (n->dir) {
+        u32 entries = n == v->root ? 0 : 2;
+        for (int i = 0; i < n->n_children; i++) {
+            VFatNode* c = n->children[i];
+            if (!is_short_name(c->name, c->short_name)) {
+                make_short_name(c->name, i + 1, c->short_name);
+            }
+            entries += 1 + lfn_entries(c);
+        }
+        n->dirlen = entries * 32;
+        n->n_clusters = (n->dirlen + VFAT_CLUSTER - 1) / VFAT_CLUSTER;
+        if (!n->n_clusters) n->n_clusters = 1;
+    } else {
+        n->n_clusters = ((u64) n->size + VFAT_CLUSTER - 1) / VFAT_CLUSTER;
+    }
+    if (n->n_clusters) {
+        n->cluster = *next;
+        *next += n->n_clusters;
+        v->extents =
+            realloc(v->extents, (v->n_extents + 1) * sizeof *v->extents);
+        v->extents[v->n_extents++] = n;
+    }
+    for (int i = 0; i < n->n_children; i++) {
+        assign_clusters(v, n->children[i], next);
+    }
+}
+
+VFat* vfat_open(char* path) {
+    VFat* v = calloc(1, sizeof *v);
+    v->root_path = strdup(path);
+    v->fd = -1;
+    v->root = new_node(path, "", NULL);
+    if (!v->root || !v->root->dir) {
+        vfat_close(v);
+        return NULL;
+    }
+    scan_dir(v->root);
+
+    u32 next = 2;
+    assign_clusters(v, v->root, &next);
+    v->clusters = next - 2 + VFAT_FREE_CLUSTERS;
+    v->fat_sectors = ((u64) (v->clusters + 2) * 4 + VFAT_SECTOR - 1) /
+                     VFAT_SECTOR;
+    v->data_start = VFAT_RESERVED + 2 * v->fat_sectors;
+    u64 total = v->data_start + (u64) v->clusters * VFAT_CLUSTER_SECTORS;
+    if (total > 0xffffffff) {
+        vfat_close(v);
+        return NULL;
+    }
+    v->total_sectors = total;
+    return v;
+}
+
+void vfat_close(VFat* v) {
+    if (!v) return;
+    if (v->root) vfat_sync(v);
+    if (v->fd >= 0) close(v->fd);
+    overlay_clear(&v->ov);
+    if (v->root) free_node(v->root);
+    free(v->extents);
+    free(v->root_path);
+    free(v);
+}
+
+static VFatNode* find_extent(VFat* v, u32 cluster) {
+    int lo = 0, hi = v->n_extents - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        VFatNode* n = v->extents[mid];
+        if (cluster < n->cluster) hi = mid - 1;
+        else if (cluster >= n->cluster + n->n_clusters) lo = mid + 1;
+        else return n;
+    }
+    return NULL;
+}
+
+static void fat_time(s64 t, u16* time, u16* date) {
+    time_t tt = t;
+    struct tm tm;
+    localtime_r(&tt, &tm);
+    if (tm.tm_year < 80) {
+        *time = 0;
+        *date = 1 << 5 | 1;
+        return;
+    }
+    *time = tm.tm_hour << 11 | tm.tm_min << 5 | tm.tm_sec / 2;
+    *date = (tm.tm_year - 80) << 9 | (tm.tm_mon + 1) << 5 | tm.tm_mday;
+}
+
+static u8 short_checksum(const u8* name) {
+    u8 sum = 0;
+    for (int i = 0; i < 11; i++) sum = ((sum & 1) << 7) + (sum >> 1) + name[i];
+    return sum;
+}
+
+static u8* write_entry(u8* e, const u8* name, u8 attr, u32 cluster, u32 size,
+                       s64 mtime) {
+    memcpy(e, name, 11);
+    e[11] = attr;
+    u16 time, date;
+    fat_time(mtime, &time, &date);
+    WR16(e, 14, time);
+    WR16(e, 16, date);
+    WR16(e, 18, date);
+    WR16(e, 20, cluster >> 16);
+    WR16(e, 22, time);
+    WR16(e, 24, date);
+    WR16(e, 26, cluster);
+    WR32(e, 28, size);
+    return e + 32;
+}
+
+static u8* write_lfn(u8* e, VFatNode* c) {
+    static const int pos[13] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+    u16 ucs[256];
+    int len = name_to_ucs2(c->name, ucs, 255);
+    int n = (len + 12) / 13;
+    u8 sum = short_checksum(c->short_name);
+    for (int i = n - 1; i >= 0; i--) {
+        e[0] = (i + 1) | (i == n - 1 ? 0x40 : 0);
+        e[11] = ATTR_LFN;
+        e[13] = sum;
+        for (int j = 0; j < 13; j++) {
+            int k = 13 * i + j;
+            u16 ch = k < len ? ucs[k] : k == len ? 0 : 0xffff;
+            WR16(e, pos[j], ch);
+        }
+        e += 32;
+    }
+    return e;
+}
+
+static void build_dir(VFat* v, VFatNode* n) {
+    n->dirdata = calloc(1, n->n_clusters * VFAT_CLUSTER);
+    u8* e = n->dirdata;
+    if (n != v->root) {
+        u32 parent = n->parent == v->root ? 0 : n->parent->cluster;
+        e = write_entry(e, (u8*) ".          ", ATTR_DIR, n->cluster, 0,
+                        n->mtime);
+        e = write_entry(e, (u8*) "..         ", ATTR_DIR, parent, 0,
+                        n->parent->mtime);
+    }
+    for (int i = 0; i < n->n_children; i++) {
+        VFatNode* c = n->children[i];
+        if (lfn_entries(c)) e = write_lfn(e, c);
+        e = write_entry(e, c->short_name, c->dir ? ATTR_DIR : ATTR_ARCHIVE,
+                        c->cluster, c->size, c->mtime);
+    }
+}
+
+static void gen_boot(VFat* v, u8* b) {
+    memcpy(b, "\xeb\x58\x90NTREMU  ", 11);
+    WR16(b, 0x0b, VFAT_SECTOR);
+    b[0x0d] = VFAT_CLUSTER_SECTORS;
+    WR16(b, 0x0e, VFAT_RESERVED);
+    b[0x10] = 2;
+    b[0x15] = 0xf8;
+    WR16(b, 0x18, 63);
+    WR16(b, 0x1a, 255);
+    WR32(b, 0x20, v->total_sectors);
+    WR32(b, 0x24, v->fat_sectors);
+    WR32(b, 0x2c, 2);
+    WR16(b, 0x30, 1);
+    WR16(b, 0x32, 6);
+    b[0x40] = 0x80;
+    b[0x42] = 0x29;
+    WR32(b, 0x43, 0x4e545245);
+    memcpy(&b[0x47], "NTREMU     FAT32   ", 19);
+    b[0x1fe] = 0x55;
+    b[0x1ff] = 0xaa;
+}
+
+static void gen_fsinfo(u8* b) {
+    WR32(b, 0, 0x41615252);
+    WR32(b, 0x1e4, 0x61417272);
+    WR32(b, 0x1e8, 0xffffffff);
+    WR32(b, 0x1ec, 0xffffffff);
+    WR32(b, 0x1fc, 0xaa550000);
+}
+
+static void gen_fat(VFat* v, u32 idx, u8* b) {
+    for (u32 i = 0; i < VFAT_SECTOR / 4; i++) {
+        u32 c = idx * (VFAT_SECTOR / 4) + i;
+        u32 val = 0;
+        if (c == 0) val = 0x0ffffff8;
+        else if (c == 1) val = FAT_EOC;
+        else {
+            VFatNode* n = find_extent(v, c);
+            if (n) val = c == n->cluster + n->n_clusters - 1 ? FAT_EOC : c + 1;
+        }
+        WR32(b, 4 * i, val);
+    }
+}
+
+static bool read_file(VFat* v, VFatNode* n, u8* buf, u32 len, u64 ofs) {
+    memset(buf, 0, len);
+    if (ofs >= n->size) return true;
+    if (len > n->size - ofs) len = n->size - ofs;
+    int fd = n->fd;
+    if (fd < 0 && v->fd_node != n) {
+        if (v->fd >= 0) close(v->fd);
+        v->fd = open(n->path, O_RDONLY);
+        v->fd_node = v->fd >= 0 ? n : NULL;
+        if (v->fd < 0) return false;
+    }
+    if (fd < 0) fd = v->fd;
+    while (len) {
+        ssize_t r = pread(fd, buf, len, ofs);
+        if (r <= 0) return r == 0;
+        buf += r;
+        len -= r;
+        ofs += r;
+    }
+    return true;
+}
+
+// generates up to count sectors from the host files, stopping at the end of
+// a file so a file range is read at once
+static u32 gen_sectors(VFat* v, u32 sector, u32 count, u8* b, bool* ok) {
+    memset(b, 0, VFAT_SECTOR);
+    if (sector < VFAT_RESERVED) {
+        if (sector == 0 || sector == 6) gen_boot(v, b);
+        else if (sector == 1 || sector == 7) gen_fsinfo(b);
+        return 1;
+    }
+    if (sector < v->data_start) {
+        gen_fat(v, (sector - VFAT_RESERVED) % v->fat_sectors, b);
+        return 1;
+    }
+    u32 rel = sector - v->data_start;
+    u32 c = 2 + rel / VFAT_CLUSTER_SECTORS;
+    VFatNode* n = find_extent(v, c);
+    if (!n) return 1;
+    u64 ofs = (u64) (c - n->cluster) * VFAT_CLUSTER +
+              (rel % VFAT_CLUSTER_SECTORS) * VFAT_SECTOR;
+    if (n->dir) {
+        if (!n->dirdata) build_dir(v, n);
+        memcpy(b, &n->dirdata[ofs], VFAT_SECTOR);
+        return 1;
+    }
+    u32 left = ((u64) n->n_clusters * VFAT_CLUSTER - ofs) / VFAT_SECTOR;
+    if (count > left) count = left;
+    if (!read_file(v, n, b, count * VFAT_SECTOR, ofs)) *ok = false;
+    return count;
+}
+
+bool vfat_read(VFat* v, u32 sector, u32 count, u8* buf) {
+    if ((u64) sector + count > v->total_sectors) return false;
+    bool ok = true;
+    while (count) {
+        u8* data = overlay_find(&v->ov, sector);
+        if (data) {
+            memcpy(buf, data, VFAT_SECTOR);
+            sector++;
+            count--;
+            buf += VFAT_SECTOR;
+            continue;
+        }
+        // the run is cut at the first sector which was written
+        u32 run = 1;
+        while (run < count && !overlay_find(&v->ov, sector + run)) run++;
+        u32 n = gen_sectors(v, sector, run, buf, &ok);
+        sector += n;
+        count -= n;
+        buf += n * VFAT_SECTOR;
+    }
+    return ok;
+}
+
+bool vfat_write(VFat* v, u32 sector, u32 count, const u8* buf) {
+    if ((u64) sector + count > v->total_sectors) return false;
+    for (u32 i = 0; i < count; i++) {
+        memcpy(overlay_get(&v->ov, sector + i), buf + i * VFAT_SECTOR,
+               VFAT_SECTOR);
+    }
+    v->dirty = true;
+    return true;
+}
+
+static u32 guest_fat(VFat* v, u32 c) {
+    u8 b[VFAT_SECTOR];
+    if (c >= v->clusters + 2) return FAT_EOC;
+    vfat_read(v, VFAT_RESERVED + c / (VFAT_SECTOR / 4), 1, b);
+    return RD32(b, 4 * (c % (VFAT_SECTOR / 4))) & 0x0fffffff;
+}
+
+static bool valid_cluster(VFat* v, u32 c) {
+    return c >= 2 && c < v->clusters + 2;
+}
+
+static bool read_cluster(VFat* v, u32 c, u8* buf) {
+    return vfat_read(v, v->data_start + (c - 2) * VFAT_CLUSTER_SECTORS,
+                     VFAT_CLUSTER_SECTORS, buf);
+}
+
+// a file needs to be written back unless it still has its original clusters,
+// none of them were written to and its host file wasn't replaced
+static bool file_changed(VFat* v, VFatNode* orig, u32 cluster, u32 size) {
+    if (!orig || orig->dir || orig->size != size || orig->fd >= 0) return true;
+    if (orig->n_clusters && orig->cluster != cluster) return true;
+    u32 c = cluster;
+    for (u32 i = 0; i < orig->n_clusters; i++) {
+        u32 sector = v->data_start + (c - 2) * VFAT_CLUSTER_SECTORS;
+        for (int s = 0; s < VFAT_CLUSTER_SECTORS; s++) {
+            if (overlay_find(&v->ov, sector + s)) return true;
+        }
+        u32 next = guest_fat(v, c);
+        if (i + 1 < orig->n_clusters ? next != c + 1 : next < 0x0ffffff8)
+            return true;
+        c = next;
+    }
+    return false;
+}
+
+// files are written next to their host path and only renamed over it once
+// all are written, since the data of other guest files is still read from the
+// host files they replace. the replaced files are kept open for the same
+// reason
+typedef struct {
+    char** paths;
+    VFatNode** replaced;
+    int n;
+    int cap;
+} Pending;
+
+static char* temp_path(char* path) {
+    char* tmp = malloc(strlen(path) + 8);
+    sprintf(tmp, "%s.vfat~", path);
+    return tmp;
+}
+
+static void write_back(VFat* v, Pending* p, char* path, VFatNode* orig,
+                       u32 cluster, u32 size) {
+    char* tmp = temp_path(path);
+    FILE* fp = fopen(tmp, "wb");
+    free(tmp);
+    if (!fp) return;
+    u8* buf = malloc(VFAT_CLUSTER);
+    u32 c = cluster;
+    u32 left = size;
+    for (u32 i = 0; left && valid_cluster(v, c) && i < v->clusters; i++) {
+        read_cluster(v, c, buf);
+        u32 n = left < VFAT_CLUSTER ? left : VFAT_CLUSTER;
+        fwrite(buf, 1, n, fp);
+        left -= n;
+        c = guest_fat(v, c);
+    }
+    free(buf);
+    fclose(fp);
+    if (p->n == p->cap) {
+        p->cap = p->cap ? 2 * p->cap : 16;
+        p->paths = realloc(p->paths, p->cap * sizeof *p->paths);
+        p->replaced = realloc(p->replaced, p->cap * sizeof *p->replaced);
+    }
+    p->paths[p->n] = strdup(path);
+    p->replaced[p->n++] = orig && !orig->dir ? orig : NULL;
+}
+
+static void entry_name(u8* e, char* out) {
+    int n = 0;
+    for (int i = 0; i < 8 && e[i] != ' '; i++) {
+        bool lower = e[12] & 0x08 && e[i] >= 'A' && e[i] <= 'Z';
+        out[n++] = lower ? e[i] + 32 : e[i];
+    }
+    if (out[0] == 0x05) out[0] = 0xe5;
+    if (e[8] != ' ') out[n++] = '.';
+    for (int i = 8; i < 11 && e[i] != ' '; i++) {
+        bool lower = e[12] & 0x10 && e[i] >= 'A' && e[i] <= 'Z';
+        out[n++] = lower ? e[i] + 32 : e[i];
+    }
+    out[n] = '\0';
+}
+
+static void put_utf8(char** p, u16 c) {
+    u8* o = (u8*) *p;
+    if (c < 0x80) *o++ = c;
+    else if (c < 0x800) {
+        *o++ = 0xc0 | c >> 6;
+        *o++ = 0x80 | (c & 0x3f);
+    } else {
+        *o++ = 0xe0 | c >> 12;
+        *o++ = 0x80 | ((c >> 6) & 0x3f);
+        *o++ = 0x80 | (c & 0x3f);
+    }
+    *p = (char*) o;
+}
+
+static VFatNode* find_child(VFatNode* n, const char* name) {
+    if (!n) return NULL;
+    int lo = 0, hi = n->n_children - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int c = strcmp(name, n->children[mid]->name);
+        if (!c) return n->children[mid];
+        if (c < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
+
+static void sync_dir(VFat* v, Pending* p, u32 cluster, char* path,
+                     VFatNode* orig, int depth) {
+    static const int pos[13] = {1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30};
+    if (depth > 64) return;
+    u8* buf = malloc(VFAT_CLUSTER);
+    u16 lfn[260];
+    int lfn_len = 0;
+    u8 lfn_sum = 0;
+    bool end = false;
+    for (u32 i = 0; !end && valid_cluster(v, cluster) && i < v->clusters;
+         i++) {
+        read_cluster(v, cluster, buf);
+        for (u8* e = buf; e < buf + VFAT_CLUSTER; e += 32) {
+            if (e[0] == 0) {
+                end = true;
+                break;
+            }
+            if (e[0] == 0xe5) {
+                lfn_len = 0;
+                continue;
+            }
+            if (e[11] == ATTR_LFN) {
+                int seq = e[0] & 0x1f;
+                if (e[0] & 0x40) {
+                    lfn_len = seq * 13;
+                    lfn_sum = e[13];
+                    for (int k = 0; k < 260; k++) lfn[k] = 0;
+                }
+                if (seq < 1 || seq > 20) continue;
+                for (int j = 0; j < 13; j++) {
+                    lfn[13 * (seq - 1) + j] = RD16(e, pos[j]);
+                }
+                continue;
+            }
+            if (e[11] & ATTR_VOLUME || e[0] == '.') {
+                lfn_len = 0;
+                continue;
+            }
+
+            char name[1024];
+            if (lfn_len && lfn_sum == short_checksum(e)) {
+                char* q = name;
+                for (int k = 0; k < lfn_len && lfn[k] && lfn[k] != 0xffff;
+                     k++) {
+                    put_utf8(&q, lfn[k]);
+                }
+                *q = '\0';
+            } else entry_name(e, name);
+            lfn_len = 0;
+            if (!name[0] || strchr(name, '/') || !strcmp(name, "..")) continue;
+
+            u32 c = RD16(e, 20) << 16 | RD16(e, 26);
+            char* child = malloc(strlen(path) + strlen(name) + 2);
+            sprintf(child, "%s/%s", path, name);
+            VFatNode* o = find_child(orig, name);
+            if (e[11] & ATTR_DIR) {
+                if (!o) mkdir(child, 0755);
+                sync_dir(v, p, c, child, o && o->dir ? o : NULL, depth + 1);
+            } else {
+                u32 size = RD32(e, 28);
+                if (file_changed(v, o, c, size)) {
+                    write_back(v, p, child, o, c, size);
+                }
+            }
+            free(child);
+        }
+        cluster = guest_fat(v, cluster);
+    }
+    free(buf);
+}
+
+// new and changed files and directories are written to the host, files
+// removed by the guest are left in place
+bool vfat_sync(VFat* v) {
+    if (!v->dirty) return true;
+    v->dirty = false;
+    u8 boot[VFAT_SECTOR];
+    vfat_read(v, 0, 1, boot);
+    Pending p = {0};
+    sync_dir(v, &p, RD32(boot, 0x2c), v->root_path, v->root, 0);
+    for (int i = 0; i < p.n; i++) {
+        VFatNode* o = p.replaced[i];
+        if (o && o->fd < 0) o->fd = open(o->path, O_RDONLY);
+    }
+    for (int i = 0; i < p.n; i++) {
+        char* tmp = temp_path(p.paths[i]);
+        rename(tmp, p.paths[i]);
+        free(tmp);
+        free(p.paths[i]);
+    }
+    free(p.paths);
+    free(p.replaced);
+    if (v->fd >= 0) close(v->fd);
+    v->fd = -1;
+    v->fd_node = NULL;
+    return true;
+}
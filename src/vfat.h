@@ -0,0 +1,69 @@
+#ifndef VFAT_H
+#define VFAT_H
+
+#include "overlay.h"
+#include "types.h"
+
+#define VFAT_SECTOR 512
+#define VFAT_CLUSTER_SECTORS 8
+#define VFAT_CLUSTER (VFAT_SECTOR * VFAT_CLUSTER_SECTORS)
+#define VFAT_RESERVED 32
+// space left for the guest to create files in
+#define VFAT_FREE_CLUSTERS (1 << 18)
+
+typedef struct _VFatNode {
+    char* path;
+    char* name;
+    bool dir;
+    u32 size;
+    s64 mtime;
+
+    u32 cluster;
+    u32 n_clusters;
+
+    struct _VFatNode* parent;
+    struct _VFatNode** children;
+    int n_children;
+
+    u8 short_name[11];
+    u8* dirdata;
+    u32 dirlen;
+
+    // the host file opened before it was replaced on sync
+    int fd;
+} VFatNode;
+
+// a fat32 volume generated from a host directory. every file and directory is
+// given a contiguous cluster range when opened and the boot sector, fat and
+// directory entries are generated when read, file data is read from the host
+// files. writes are kept in memory and the host directory is updated from
+// the resulting filesystem on sync
+typedef struct {
+    char* root_path;
+    VFatNode* root;
+
+    VFatNode** extents;
+    int n_extents;
+
+    u32 clusters;
+    u32 fat_sectors;
+    u32 data_start;
+    u32 total_sectors;
+
+    Overlay ov;
+    // set by writes since the last sync
+    bool dirty;
+
+    VFatNode* fd_node;
+    int fd;
+} VFat;
+
+VFat* vfat_open(char* path);
+void vfat_close(VFat* v);
+
+bool vfat_read(VFat* v, u32 sector, u32 count, u8* buf);
+bool vfat_write(VFat* v, u32 sector, u32 count, const u8* buf);
+
+bool vfat_sync(VFat* v);
+
+#endif
@@ -0,0 +1,61 @@
+#include "watch.h"
+
+#include <string.h>
+
+#include "nds.h"
+
+static void update_pages(Watchpoints* w) {
+    memset(w->pages, 0, sizeof w->pages);
+    for (int i = 0; i < w->n; i++) {
+        Watchpoint* wp = &w->wp[i];
+        for (u64 page = wp->start >> 12; page <= wp->last >> 12; page++) {
+            w->pages[wp->cpu][page >> 6] |= 1ull << (page & 63);
+        }
+    }
+}
+
+// len is at least 1 and the range does not wrap around
+bool watch_add(Watchpoints* w, int cpu, u32 start, u32 len, WatchKind kind) {
+    if (w->n == WATCH_MAX || !len || start + (u64) len > 1ull << 32)
+        return false;
+    w->wp[w->n++] = (Watchpoint){cpu, start, start + len - 1, kind};
+    update_pages(w);
+    return true;
+}
+
+void watch_remove(Watchpoints* w, int i) {
+    if (i < 0 || i >= w->n) return;
+    memmove(&w->wp[i], &w->wp[i + 1], (w->n - i - 1) * sizeof *w->wp);
+    w->n--;
+    update_pages(w);
+}
+
+void watch_clear(Watchpoints* w) {
+    w->n = 0;
+    w->hit = false;
+    update_pages(w);
+}
+
+// only the first hit is kept until the frontend handles it
+void watch_check(NDS* nds, int cpu, u32 addr, int size, WatchKind kind,
+                 u32 data) {
+    Watchpoints* w = nds->watch;
+    if (w->hit) return;
+    for (int i = 0; i < w->n; i++) {
+        Watchpoint* wp = &w->wp[i];
+        if (wp->cpu != cpu || !(wp->kind & kind)) continue;
+        if (addr + size - 1 < wp->start || addr > wp->last) continue;
+        w->hit = true;
+        w->hit_wp = i;
+        w->hit_cpu = cpu;
+        w->hit_addr = addr;
+        // accesses are made after the next instruction is fetched
+        ArmCore* c = cpu == CPU9 ? &nds->cpu9.c : &nds->cpu7.c;
+        w->hit_pc = c->cur_instr_addr - (c->cpsr.t ? 2 : 4);
+        w->hit_size = size;
+        w->hit_kind = kind;
+        w->hit_data = data;
+        nds->debug_stop = true;
+        return;
+    }
+}
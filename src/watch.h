@@ -0,0 +1,54 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "types.h"
+
+#define WATCH_MAX 64
+
+typedef enum { WATCH_READ = 1, WATCH_WRITE = 2, WATCH_ACCESS = 3 } WatchKind;
+
+typedef struct {
+    int cpu;
+    u32 start;
+    u32 last;
+    WatchKind kind;
+} Watchpoint;
+
+// each bus has a bit per 4k page which contains a watchpoint, the cpu memory
+// handlers only compare against the ranges for accesses to those pages. on a
+// hit the access still completes and nds_run returns after the instruction
+typedef struct {
+    Watchpoint wp[WATCH_MAX];
+    int n;
+
+    u64 pages[2][1 << 14];
+
+    bool hit;
+    int hit_wp;
+    int hit_cpu;
+    u32 hit_addr;
+    u32 hit_pc;
+    int hit_size;
+    WatchKind hit_kind;
+    u32 hit_data;
+} Watchpoints;
+
+typedef struct _NDS NDS;
+
+#define WATCH_PAGE(w, cpu, addr)                                               \
+    ((w)->pages[cpu][(addr) >> 18] >> ((addr) >> 12 & 63) & 1)
+
+#define WATCH(nds, cpu, addr, size, kind, data)                                \
+    do {                                                                       \
+        if ((nds)->watch && WATCH_PAGE((nds)->watch, cpu, addr))               \
+            watch_check(nds, cpu, addr, size, kind, data);                     \
+    } while (false)
+
+bool watch_add(Watchpoints* w, int cpu, u32 start, u32 len, WatchKind kind);
+void watch_remove(Watchpoints* w, int i);
+void watch_clear(Watchpoints* w);
+
+void watch_check(NDS* nds, int cpu, u32 addr, int size, WatchKind kind,
+                 u32 data);
+
+#endif
@@ -0,0 +1,355 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libntremu.h"
+
+#define eprintf(...) fprintf(stderr, __VA_ARGS__)
+
+const char usage[] =
+    "ntremu-batch [options] <directory|manifest>\n"
+    "-n <frames> -- frames to run per rom (default 600)\n"
+    "-j <threads> -- number of worker threads (default all cores)\n"
+    "-p <path> -- path to bios/firmware files, hle bios is used if missing\n"
+    "-o <file> -- write results to file instead of stdout\n"
+    "-r <dir> -- record each rom to <dir>/<rom>.y4m and <dir>/<rom>.wav\n"
+    "-J -- output json instead of csv\n"
+    "-h -- print help";
+
+typedef struct {
+    char* path;
+
+    enum { RES_OK, RES_CPUERR, RES_BADROM } status;
+    int frames;
+    int err_cpu;
+    uint32_t err_addr;
+    uint64_t hash_top;
+    uint64_t hash_bottom;
+    double seconds;
+} Result;
+
+const char* status_names[] = {"ok", "cpuerr", "badrom"};
+
+struct {
+    int frames;
+    int threads;
+    char* bios_path;
+    char* out_path;
+    char* capture_dir;
+    bool json;
+    char* input;
+
+    void* bios7;
+    size_t bios7_len;
+    void* bios9;
+    size_t bios9_len;
+    void* firmware;
+    size_t firmware_len;
+
+    Result* roms;
+    int n_roms;
+
+    pthread_mutex_t lock;
+    int next_rom;
+} batch;
+
+void* read_file(const char* path, size_t* len) {
+    FILE* fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    *len = ftell(fp);
+    rewind(fp);
+    void* data = malloc(*len ? *len : 1);
+    if (fread(data, 1, *len, fp) != *len) {
+        free(data);
+        data = NULL;
+    }
+    fclose(fp);
+    return data;
+}
+
+void add_rom(char* path) {
+    batch.roms = realloc(batch.roms, (batch.n_roms + 1) * sizeof *batch.roms);
+    memset(&batch.roms[batch.n_roms], 0, sizeof *batch.roms);
+    batch.roms[batch.n_roms++].path = path;
+}
+
+int cmp_rom(const void* a, const void* b) {
+    return strcmp(((Result*) a)->path, ((Result*) b)->path);
+}
+
+void scan_dir(const char* dir) {
+    DIR* d = opendir(dir);
+    if (!d) return;
+    struct dirent* e;
+    while ((e = readdir(d))) {
+        if (e->d_name[0] == '.') continue;
+        char* path = malloc(strlen(dir) + strlen(e->d_name) + 2);
+        sprintf(path, "%s/%s", dir, e->d_name);
+        DIR* sub = opendir(path);
+        if (sub) {
+            closedir(sub);
+            scan_dir(path);
+            free(path);
+            continue;
+        }
+        char* ext = strrchr(e->d_name, '.');
+        if (ext && !strcasecmp(ext, ".nds")) add_rom(path);
+        else free(path);
+    }
+    closedir(d);
+}
+
+// one path per line, blank lines and lines starting with # are skipped
+bool read_manifest(const char* file) {
+    FILE* fp = fopen(file, "r");
+    if (!fp) return false;
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, fp)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (!len || line[0] == '#') continue;
+        add_rom(strdup(line));
+    }
+    free(line);
+    fclose(fp);
+    return true;
+}
+
+uint64_t hash_screen(const uint16_t* fb) {
+    uint64_t h = 0xcbf29ce484222325;
+    const uint8_t* p = (const uint8_t*) fb;
+    for (size_t i = 0; i < NTREMU_SCREEN_W * NTREMU_SCREEN_H * 2; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+void run_rom(Result* res) {
+    size_t len;
+    void* rom = read_file(res->path, &len);
+    NtremuCtx* ctx = ntremu_create();
+    if (!rom || !ctx) {
+        res->status = RES_BADROM;
+        free(rom);
+        ntremu_destroy(ctx);
+        return;
+    }
+    ntremu_load_bios(ctx, batch.bios7, batch.bios7_len, batch.bios9,
+                     batch.bios9_len);
+    ntremu_load_firmware(ctx, batch.firmware, batch.firmware_len);
+    if (!ntremu_load_rom(ctx, rom, len)) {
+        res->status = RES_BADROM;
+        free(rom);
+        ntremu_destroy(ctx);
+        return;
+    }
+    free(rom);
+
+    if (batch.capture_dir) {
+        char* name = strrchr(res->path, '/');
+        name = name ? name + 1 : res->path;
+        char* prefix = malloc(strlen(batch.capture_dir) + strlen(name) + 2);
+        sprintf(prefix, "%s/%s", batch.capture_dir, name);
+        char* ext = strrchr(prefix, '.');
+        if (ext && !strcasecmp(ext, ".nds")) *ext = '\0';
+        if (!ntremu_capture_start(ctx, prefix))
+            eprintf("Could not record to '%s'\n", prefix);
+        free(prefix);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    res->status = RES_OK;
+    while (res->frames < batch.frames) {
+        if (!ntremu_run_frame(ctx)) {
+            res->status = RES_CPUERR;
+            ntremu_get_error(ctx, &res->err_cpu, &res->err_addr);
+            break;
+        }
+        res->frames++;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    res->seconds =
+        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    res->hash_top =
+        hash_screen(ntremu_get_framebuffer(ctx, NTREMU_SCREEN_TOP));
+    res->hash_bottom =
+        hash_screen(ntremu_get_framebuffer(ctx, NTREMU_SCREEN_BOTTOM));
+
+    ntremu_destroy(ctx);
+}
+
+void* worker(void* arg) {
+    while (true) {
+        pthread_mutex_lock(&batch.lock);
+        int i = batch.next_rom++;
+        pthread_mutex_unlock(&batch.lock);
+        if (i >= batch.n_roms) break;
+        run_rom(&batch.roms[i]);
+        eprintf("[%d/%d] %s: %s\n", i + 1, batch.n_roms, batch.roms[i].path,
+                status_names[batch.roms[i].status]);
+    }
+    return NULL;
+}
+
+void print_json_string(FILE* fp, const char* s) {
+    fputc('"', fp);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(fp, "\\%c", *s);
+        else if ((unsigned char) *s < 0x20) fprintf(fp, "\\u%04x", *s);
+        else fputc(*s, fp);
+    }
+    fputc('"', fp);
+}
+
+// timing is in the last columns so the rest can be diffed against a baseline
+void print_results(FILE* fp) {
+    if (batch.json) {
+        fprintf(fp, "[\n");
+        for (int i = 0; i < batch.n_roms; i++) {
+            Result* r = &batch.roms[i];
+            fprintf(fp, "  {\"rom\": ");
+            print_json_string(fp, r->path);
+            fprintf(fp,
+                    ", \"status\": \"%s\", \"frames\": %d, \"err_cpu\": %d, "
+                    "\"err_addr\": \"0x%08x\", \"hash_top\": \"%016llx\", "
+                    "\"hash_bottom\": \"%016llx\", \"seconds\": %.3f, "
+                    "\"fps\": %.1f}%s\n",
+                    status_names[r->status], r->frames, r->err_cpu,
+                    r->err_addr, (unsigned long long) r->hash_top,
+                    (unsigned long long) r->hash_bottom, r->seconds,
+                    r->seconds > 0 ? r->frames / r->seconds : 0,
+                    i + 1 < batch.n_roms ? "," : "");
+        }
+        fprintf(fp, "]\n");
+    } else {
+        fprintf(fp, "rom,status,frames,err_cpu,err_addr,hash_top,hash_bottom,"
+                    "seconds,fps\n");
+        for (int i = 0; i < batch.n_roms; i++) {
+            Result* r = &batch.roms[i];
+            fprintf(fp, "\"%s\",%s,%d,%d,0x%08x,%016llx,%016llx,%.3f,%.1f\n",
+                    r->path, status_names[r->status], r->frames, r->err_cpu,
+                    r->err_addr, (unsigned long long) r->hash_top,
+                    (unsigned long long) r->hash_bottom, r->seconds,
+                    r->seconds > 0 ? r->frames / r->seconds : 0);
+        }
+    }
+}
+
+void load_system_files() {
+    char path[4096];
+    const char* dir = batch.bios_path ? batch.bios_path : ".";
+    snprintf(path, sizeof path, "%s/bios7.bin", dir);
+    batch.bios7 = read_file(path, &batch.bios7_len);
+    snprintf(path, sizeof path, "%s/bios9.bin", dir);
+    batch.bios9 = read_file(path, &batch.bios9_len);
+    snprintf(path, sizeof path, "%s/firmware.bin", dir);
+    batch.firmware = read_file(path, &batch.firmware_len);
+    if (!batch.bios7 || !batch.bios9) {
+        free(batch.bios7);
+        free(batch.bios9);
+        batch.bios7 = batch.bios9 = NULL;
+    }
+}
+
+int read_args(int argc, char** argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:j:p:o:r:Jh")) != -1) {
+        switch (opt) {
+            case 'n':
+                batch.frames = atoi(optarg);
+                break;
+            case 'j':
+                batch.threads = atoi(optarg);
+                break;
+            case 'p':
+                batch.bios_path = optarg;
+                break;
+            case 'o':
+                batch.out_path = optarg;
+                break;
+            case 'r':
+                batch.capture_dir = optarg;
+                break;
+            case 'J':
+                batch.json = true;
+                break;
+            default:
+                return -1;
+        }
+    }
+    if (optind != argc - 1) return -1;
+    batch.input = argv[optind];
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    batch.frames = 600;
+    batch.threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (read_args(argc, argv) < 0) {
+        eprintf("%s\n", usage);
+        return 1;
+    }
+    if (batch.threads < 1) batch.threads = 1;
+
+    DIR* d = opendir(batch.input);
+    if (d) {
+        closedir(d);
+        scan_dir(batch.input);
+        qsort(batch.roms, batch.n_roms, sizeof *batch.roms, cmp_rom);
+    } else if (!read_manifest(batch.input)) {
+        eprintf("Invalid input '%s'\n", batch.input);
+        return 1;
+    }
+    if (!batch.n_roms) {
+        eprintf("No roms found\n");
+        return 1;
+    }
+
+    load_system_files();
+
+    FILE* out = stdout;
+    if (batch.out_path) {
+        out = fopen(batch.out_path, "w");
+        if (!out) {
+            eprintf("Could not open '%s'\n", batch.out_path);
+            return 1;
+        }
+    }
+
+    if (batch.threads > batch.n_roms) batch.threads = batch.n_roms;
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_t* threads = malloc(batch.threads * sizeof *threads);
+    for (int i = 0; i < batch.threads; i++) {
+        pthread_create(&threads[i], NULL, worker, NULL);
+    }
+    for (int i = 0; i < batch.threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    pthread_mutex_destroy(&batch.lock);
+
+    print_results(out);
+    if (out != stdout) fclose(out);
+
+    int failed = 0;
+    for (int i = 0; i < batch.n_roms; i++) {
+        if (batch.roms[i].status != RES_OK) failed++;
+        free(batch.roms[i].path);
+    }
+    free(batch.roms);
+    free(batch.bios7);
+    free(batch.bios9);
+    free(batch.firmware);
+    return failed ? 2 : 0;
+}
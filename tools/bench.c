@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "arm/arm_core.h"
+#include "arm/thumb.h"
+
+#define MEMSIZE (1 << 20)
+#define MEMMASK (MEMSIZE - 1)
+#define DATA_BASE 0x80000
+
+#define ARM_BODY 1024
+#define THUMB_BODY 512
+
+const char usage[] =
+    "ntremu-bench [options]\n"
+    "-n <millions> -- instructions to run per class (default 50)\n"
+    "-c <class> -- only run the given class\n"
+    "-l -- list the classes\n"
+    "-h -- print help";
+
+u8 mem[MEMSIZE];
+u32 rng_state = 0x12345678;
+
+u32 rng() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+u32 rand_reg(int n) {
+    return rng() % n;
+}
+
+u32 flat_read8(ArmCore* cpu, u32 addr, bool sx) {
+    u32 data = mem[addr & MEMMASK];
+    if (sx) data = (s8) data;
+    return data;
+}
+
+u32 flat_read16(ArmCore* cpu, u32 addr, bool sx) {
+    u32 data = *(u16*) &mem[addr & MEMMASK & ~1];
+    if (sx) data = (s16) data;
+    return data;
+}
+
+u32 flat_read32(ArmCore* cpu, u32 addr) {
+    return *(u32*) &mem[addr & MEMMASK & ~3];
+}
+
+void flat_write8(ArmCore* cpu, u32 addr, u8 b) {
+    mem[addr & MEMMASK] = b;
+}
+
+void flat_write16(ArmCore* cpu, u32 addr, u16 h) {
+    *(u16*) &mem[addr & MEMMASK & ~1] = h;
+}
+
+void flat_write32(ArmCore* cpu, u32 addr, u32 w) {
+    *(u32*) &mem[addr & MEMMASK & ~3] = w;
+}
+
+u16 flat_fetch16(ArmCore* cpu, u32 addr) {
+    return *(u16*) &mem[addr & MEMMASK & ~1];
+}
+
+u32 flat_fetch32(ArmCore* cpu, u32 addr) {
+    return *(u32*) &mem[addr & MEMMASK & ~3];
+}
+
+void emit32(int i, u32 w) {
+    *(u32*) &mem[4 * i] = w;
+}
+
+void emit16(int i, u16 h) {
+    *(u16*) &mem[2 * i] = h;
+}
+
+// the body is followed by an unconditional branch back to the start
+void arm_loop(int n) {
+    emit32(n, 0xea000000 | (((0 - (4 * n + 8)) >> 2) & 0xffffff));
+}
+
+void thumb_loop(int n) {
+    emit16(n, 0xe000 | (((0 - (2 * n + 4)) >> 1) & 0x7ff));
+}
+
+// rd is kept below r12 so r12 can hold shift amounts and r13 the data base
+u32 dp_op(u32 operand) {
+    u32 op = rng() % 16;
+    u32 s = rng() & 1;
+    if (op >= 8 && op < 12) s = 1;
+    return 0xe0000000 | op << 21 | s << 20 | rand_reg(13) << 16 |
+           rand_reg(12) << 12 | operand;
+}
+
+void gen_dp_imm() {
+    for (int i = 0; i < ARM_BODY; i++) {
+        emit32(i, dp_op(1 << 25 | (rng() & 0xfff)));
+    }
+    arm_loop(ARM_BODY);
+}
+
+void gen_dp_reg() {
+    for (int i = 0; i < ARM_BODY; i++) {
+        emit32(i, dp_op(rand_reg(13)));
+    }
+    arm_loop(ARM_BODY);
+}
+
+void gen_dp_shift_imm() {
+    for (int i = 0; i < ARM_BODY; i++) {
+        u32 shamt = 1 + rng() % 31;
+        emit32(i, dp_op(shamt << 7 | (rng() % 4) << 5 | rand_reg(13)));
+    }
+    arm_loop(ARM_BODY);
+}
+
+void gen_dp_shift_reg() {
+    for (int i = 0; i < ARM_BODY; i++) {
+        emit32(i, dp_op(12 << 8 | (rng() % 4) << 5 | 1 << 4 | rand_reg(12)));
+    }
+    arm_loop(ARM_BODY);
+}
+
+void gen_ldr_str() {
+    for (int i = 0; i < ARM_BODY; i++) {
+        u32 l = rng() & 1;
+        u32 rd = rand_reg(12);
+        if (rng() % 4) {
+            u32 b = rng() & 1;
+            u32 ofs = rng() & (b ? 0xfff : 0xffc);
+            emit32(i, 0xe5800000 | b << 22 | l << 20 | 13 << 16 | rd << 12 |
+                          ofs);
+        } else {
+            u32 ofs = rng() & 0xfe;
+            emit32(i, 0xe1c000b0 | l << 20 | 13 << 16 | rd << 12 |
+                          (ofs >> 4) << 8 | (ofs & 0xf));
+        }
+    }
+    arm_loop(ARM_BODY);
+}
+
+void gen_ldm_stm() {
+    for (int i = 0; i < ARM_BODY; i++) {
+        u32 rlist = rng() & 0xfff;
+        if (!rlist) rlist = 1;
+        emit32(i, 0xe8800000 | (i & 1) << 20 | 13 << 16 | rlist);
+    }
+    arm_loop(ARM_BODY);
+}
+
+// every branch targets the next instruction, z is never changed so beq is
+// always taken and bne never is
+void gen_branch() {
+    const u32 ops[] = {0xea000000, 0xeb000000, 0x0a000000, 0x1a000000};
+    for (int i = 0; i < ARM_BODY; i++) {
+        emit32(i, ops[rng() % 4] | 0xffffff);
+    }
+    arm_loop(ARM_BODY);
+}
+
+void gen_multiply() {
+    for (int i = 0; i < ARM_BODY; i++) {
+        u32 rm = rand_reg(13);
+        u32 rs = rand_reg(13);
+        u32 s = rng() & 1;
+        if (rng() & 1) {
+            u32 a = rng() & 1;
+            emit32(i, 0xe0000090 | a << 21 | s << 20 | rand_reg(12) << 16 |
+                          rand_reg(13) << 12 | rs << 8 | rm);
+        } else {
+            u32 rdlo = rand_reg(12);
+            u32 rdhi = (rdlo + 1 + rand_reg(11)) % 12;
+            emit32(i, 0xe0800090 | (rng() % 4) << 21 | s << 20 | rdhi << 16 |
+                          rdlo << 12 | rs << 8 | rm);
+        }
+    }
+    arm_loop(ARM_BODY);
+}
+
+// r7 holds the data base and is never written
+void gen_thumb() {
+    for (int i = 0; i < THUMB_BODY; i++) {
+        u32 rd = rand_reg(7);
+        u32 rs = rand_reg(8);
+        u16 h;
+        switch (rng() % 7) {
+            case 0:
+                h = (rng() % 3) << 11 | (rng() & 0x1f) << 6 | rs << 3 | rd;
+                break;
+            case 1:
+                h = 0x1800 | (rng() & 3) << 9 | rand_reg(8) << 6 | rs << 3 | rd;
+                break;
+            case 2:
+                h = 0x2000 | (rng() % 4) << 11 | rd << 8 | (rng() & 0xff);
+                break;
+            case 3:
+            case 4:
+                h = 0x4000 | (rng() % 16) << 6 | rs << 3 | rd;
+                break;
+            case 5:
+                h = 0x6000 | (rng() & 3) << 11 | (rng() & 0x1f) << 6 | 7 << 3 |
+                    rd;
+                break;
+            default:
+                h = 0x8000 | (rng() & 1) << 11 | (rng() & 0x1f) << 6 | 7 << 3 |
+                    rd;
+                break;
+        }
+        emit16(i, h);
+    }
+    thumb_loop(THUMB_BODY);
+}
+
+struct {
+    char* name;
+    void (*gen)();
+    bool thumb;
+} classes[] = {
+    {"dp_imm", gen_dp_imm},
+    {"dp_reg", gen_dp_reg},
+    {"dp_shift_imm", gen_dp_shift_imm},
+    {"dp_shift_reg", gen_dp_shift_reg},
+    {"ldr_str", gen_ldr_str},
+    {"ldm_stm", gen_ldm_stm},
+    {"branch", gen_branch},
+    {"multiply", gen_multiply},
+    {"thumb", gen_thumb, true},
+};
+
+#define N_CLASSES (sizeof classes / sizeof classes[0])
+
+void reset_cpu(ArmCore* cpu, bool thumb) {
+    memset(cpu, 0, sizeof *cpu);
+    cpu->read8 = flat_read8;
+    cpu->read16 = flat_read16;
+    cpu->read32 = flat_read32;
+    cpu->write8 = flat_write8;
+    cpu->write16 = flat_write16;
+    cpu->write32 = flat_write32;
+    cpu->fetch16 = flat_fetch16;
+    cpu->fetch32 = flat_fetch32;
+    cpu->v5 = true;
+
+    for (int i = 0; i < 13; i++) {
+        cpu->r[i] = rng();
+    }
+    cpu->r[12] &= 0x1f;
+    cpu->r[7] = DATA_BASE;
+    cpu->sp = DATA_BASE;
+    cpu->pc = 0;
+    cpu->cpsr.m = M_SYSTEM;
+    cpu->cpsr.t = thumb;
+    cpu->cpsr.z = 1;
+    cpu_flush(cpu);
+}
+
+double host_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+double run_class(ArmCore* cpu, int c, u64 n) {
+    memset(mem, 0, sizeof mem);
+    rng_state = 0x12345678 + c;
+    classes[c].gen();
+    reset_cpu(cpu, classes[c].thumb);
+
+    // warm up the caches and branch predictor before timing
+    for (int i = 0; i < 100000; i++) {
+        arm_exec_instr(cpu);
+    }
+
+    double start = host_seconds();
+    for (u64 i = 0; i < n; i++) {
+        arm_exec_instr(cpu);
+    }
+    return host_seconds() - start;
+}
+
+int main(int argc, char** argv) {
+    u64 n = 50;
+    char* only = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:c:lh")) != -1) {
+        switch (opt) {
+            case 'n': {
+                int m = atoi(optarg);
+                n = m < 1 ? 1 : m;
+                break;
+            }
+            case 'c':
+                only = optarg;
+                break;
+            case 'l':
+                for (int c = 0; c < N_CLASSES; c++) {
+                    printf("%s\n", classes[c].name);
+                }
+                return 0;
+            default:
+                fprintf(stderr, "%s\n", usage);
+                return 1;
+        }
+    }
+    n *= 1000000;
+
+    arm_generate_lookup();
+    thumb_generate_lookup();
+
+    ArmCore* cpu = malloc(sizeof *cpu);
+    bool found = false;
+    printf("%-14s %10s %10s %10s\n", "class", "seconds", "mips", "ns/instr");
+    for (int c = 0; c < N_CLASSES; c++) {
+        if (only && strcmp(only, classes[c].name)) continue;
+        found = true;
+        double t = run_class(cpu, c, n);
+        printf("%-14s %10.3f %10.1f %10.2f\n", classes[c].name, t, n / t / 1e6,
+               t * 1e9 / n);
+    }
+    free(cpu);
+
+    if (!found) {
+        fprintf(stderr, "Unknown class '%s'\n", only);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gxlog.h"
+#include "nds.h"
+
+const char usage[] =
+    "ntremu-gxreplay [options] <logfile>\n"
+    "-r <n> -- replay the log n times and average the timings\n"
+    "-q -- only print the summary\n"
+    "-h -- print help";
+
+struct {
+    int repeat;
+    bool quiet;
+
+    u8* data;
+    size_t len;
+
+    NDS* nds;
+    GameCard* card;
+    u8* bios7;
+    u8* bios9;
+    u8* firmware;
+
+    u64 geometry_ns;
+    u64 render_ns;
+    int frames;
+} replay;
+
+u64 host_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+u64 hash_screen(GPU* gpu) {
+    u64 h = 0xcbf29ce484222325;
+    u8* p = (u8*) gpu->screen_back;
+    for (size_t i = 0; i < sizeof gpu->framebuffers[0]; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+void reset_nds() {
+    init_nds(replay.nds, replay.card, replay.bios7, replay.bios9,
+             replay.firmware, -1, NULL, false);
+    replay.nds->io7.vcount = 0;
+}
+
+// returns the offset after the frame record or 0 if it is truncated
+size_t apply_frame(NDS* nds, size_t pos) {
+    u8* data = replay.data;
+    size_t len = replay.len;
+    if (pos + 2 + (GXFIFO - EDGE_COLOR) + 2 > len) return 0;
+    memcpy(&nds->io9.b[DISP3DCNT], &data[pos], 2);
+    pos += 2;
+    memcpy(&nds->io9.b[EDGE_COLOR], &data[pos], GXFIFO - EDGE_COLOR);
+    pos += GXFIFO - EDGE_COLOR;
+    u16 count;
+    memcpy(&count, &data[pos], 2);
+    pos += 2;
+    for (int i = 0; i < count; i++) {
+        if (pos + 2 + GXLOG_CHUNK > len) return 0;
+        u8 slot = data[pos];
+        u32 ofs = data[pos + 1] * GXLOG_CHUNK;
+        pos += 2;
+        if (slot < 4 && ofs < GXLOG_TEXSIZE) {
+            memcpy(nds->gpu.texram[slot] + ofs, &data[pos], GXLOG_CHUNK);
+        } else if (slot < GXLOG_SLOTS && ofs < GXLOG_PALSIZE) {
+            memcpy((u8*) nds->gpu.texpal[slot - 4] + ofs, &data[pos],
+                   GXLOG_CHUNK);
+        }
+        pos += GXLOG_CHUNK;
+    }
+    return pos;
+}
+
+void run_replay(bool print) {
+    NDS* nds = replay.nds;
+    GPU* gpu = &nds->gpu;
+    u8* data = replay.data;
+    size_t pos = 8;
+    u32 swap_param = 0;
+    bool swap_pending = false;
+    u64 geometry = 0;
+
+    reset_nds();
+    while (pos < replay.len) {
+        u8 type = data[pos++];
+        if (type == GXLOG_CMD) {
+            if (pos + 2 > replay.len) break;
+            u8 cmd = data[pos];
+            u8 n = data[pos + 1];
+            pos += 2;
+            if (pos + 4 * n > replay.len) break;
+            if (cmd == SWAP_BUFFERS) {
+                // executed once the frame state that follows is loaded
+                if (n) memcpy(&swap_param, &data[pos], 4);
+                swap_pending = true;
+                pos += 4 * n;
+                continue;
+            }
+            FIFO_clear(gpu->cmd_fifo);
+            FIFO_clear(gpu->param_fifo);
+            FIFO_push(gpu->cmd_fifo, cmd);
+            for (int i = 0; i < n; i++) {
+                u32 p;
+                memcpy(&p, &data[pos + 4 * i], 4);
+                FIFO_push(gpu->param_fifo, p);
+            }
+            pos += 4 * n;
+            u64 start = host_time();
+            gxcmd_execute(gpu);
+            geometry += host_time() - start;
+        } else if (type == GXLOG_FRAME) {
+            pos = apply_frame(nds, pos);
+            if (!pos) break;
+            if (!swap_pending) continue;
+            swap_pending = false;
+
+            FIFO_clear(gpu->cmd_fifo);
+            FIFO_clear(gpu->param_fifo);
+            FIFO_push(gpu->cmd_fifo, SWAP_BUFFERS);
+            FIFO_push(gpu->param_fifo, swap_param);
+            gpu->drawing = false;
+            nds->io7.vcount = 0;
+            u64 start = host_time();
+            gxcmd_execute(gpu);
+            u64 render = host_time() - start;
+            gpu->blocked = false;
+            gpu->drawing = false;
+
+            if (print) {
+                printf("%d,%.1f,%.1f,%d,%016llx\n", replay.frames,
+                       geometry / 1e3, render / 1e3, gpu->n_polys_rendering,
+                       (unsigned long long) hash_screen(gpu));
+            }
+            replay.geometry_ns += geometry;
+            replay.render_ns += render;
+            replay.frames++;
+            geometry = 0;
+        } else {
+            fprintf(stderr, "Invalid record at offset %zu\n", pos - 1);
+            break;
+        }
+    }
+}
+
+bool load_log(char* filename) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) return false;
+    fseek(fp, 0, SEEK_END);
+    replay.len = ftell(fp);
+    rewind(fp);
+    replay.data = malloc(replay.len ? replay.len : 1);
+    if (fread(replay.data, 1, replay.len, fp) != replay.len) {
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+    u32 hdr[2];
+    if (replay.len < sizeof hdr) return false;
+    memcpy(hdr, replay.data, sizeof hdr);
+    return hdr[0] == GXLOG_MAGIC && hdr[1] == GXLOG_VERSION;
+}
+
+int main(int argc, char** argv) {
+    replay.repeat = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:qh")) != -1) {
+        switch (opt) {
+            case 'r':
+                replay.repeat = atoi(optarg);
+                if (replay.repeat < 1) replay.repeat = 1;
+                break;
+            case 'q':
+                replay.quiet = true;
+                break;
+            default:
+                fprintf(stderr, "%s\n", usage);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "%s\n", usage);
+        return 1;
+    }
+    if (!load_log(argv[optind])) {
+        fprintf(stderr, "Invalid gx log '%s'\n", argv[optind]);
+        return 1;
+    }
+
+    // the gpu only needs vram and io, the rest of the system stays idle
+    u8 header[sizeof(CardHeader)] = {0};
+    replay.card = create_card_from_buffer(header, sizeof header);
+    replay.bios7 = calloc(1, BIOS7SIZE);
+    replay.bios9 = calloc(1, BIOS9SIZE);
+    replay.firmware = calloc(1, FIRMWARESIZE);
+    replay.nds = calloc(1, sizeof *replay.nds);
+
+    if (!replay.quiet) printf("frame,geometry_us,render_us,polys,hash\n");
+    for (int i = 0; i < replay.repeat; i++) {
+        run_replay(!replay.quiet && i == 0);
+    }
+
+    if (replay.frames) {
+        printf("%d frames, geometry %.3f ms/frame, render %.3f ms/frame, "
+               "%.1f fps\n",
+               replay.frames / replay.repeat,
+               replay.geometry_ns / 1e6 / replay.frames,
+               replay.render_ns / 1e6 / replay.frames,
+               replay.frames * 1e9 /
+                   (replay.geometry_ns + replay.render_ns + 1));
+    } else {
+        printf("No frames in log\n");
+    }
+
+    destroy_card(replay.card);
+    free(replay.nds);
+    free(replay.bios7);
+    free(replay.bios9);
+    free(replay.firmware);
+    free(replay.data);
+    return 0;
+}
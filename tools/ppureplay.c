@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "nds.h"
+#include "ppulog.h"
+
+const char usage[] =
+    "ntremu-ppureplay [options] <logfile>\n"
+    "-r <n> -- replay the log n times and average the timings\n"
+    "-q -- only print the summary\n"
+    "-h -- print help";
+
+struct {
+    int repeat;
+    bool quiet;
+
+    u8* data;
+    size_t len;
+    size_t pos;
+
+    NDS* nds;
+    GameCard* card;
+    u8* bios7;
+    u8* bios9;
+    u8* firmware;
+
+    u64 draw_ns;
+    int frames;
+} replay;
+
+u64 host_time() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+u64 hash_screens(NDS* nds) {
+    u64 h = 0xcbf29ce484222325;
+    u8* p = (u8*) nds->screen_top;
+    for (size_t i = 0; i < sizeof nds->screen_top; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3;
+    }
+    p = (u8*) nds->screen_bottom;
+    for (size_t i = 0; i < sizeof nds->screen_bottom; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
+bool read_bytes(void* dst, size_t len) {
+    if (replay.pos + len > replay.len) return false;
+    memcpy(dst, &replay.data[replay.pos], len);
+    replay.pos += len;
+    return true;
+}
+
+bool read_chunks(u8* mem, u32 size, u32 chunk) {
+    while (true) {
+        u16 idx;
+        if (!read_bytes(&idx, 2)) return false;
+        if (idx == PPULOG_END) return true;
+        if ((idx + 1) * chunk > size) return false;
+        if (!read_bytes(&mem[idx * chunk], chunk)) return false;
+    }
+}
+
+u16* vram_ptr(NDS* nds, u32 ofs) {
+    if (ofs >= VRAMSIZE) return NULL;
+    return (u16*) &nds->vram[ofs];
+}
+
+bool read_frame(NDS* nds) {
+    if (!read_chunks(nds->vram, VRAMSIZE, PPULOG_CHUNK)) return false;
+    if (!read_chunks((u8*) nds->gpu.screen, sizeof nds->gpu.framebuffers[0],
+                     PPULOG_CHUNK))
+        return false;
+    if (!read_bytes(&nds->vramstate, sizeof nds->vramstate)) return false;
+    u8 screenswap;
+    if (!read_bytes(&screenswap, 1)) return false;
+    nds->io9.powcnt.screenswap = screenswap;
+    apply_screenswap(nds);
+    PPU* ppus[2] = {&nds->ppuA, &nds->ppuB};
+    for (int p = 0; p < 2; p++) {
+        u32 ofs[5];
+        if (!read_bytes(ofs, sizeof ofs)) return false;
+        for (int i = 0; i < 4; i++) {
+            ppus[p]->extPalBg[i] = vram_ptr(nds, ofs[i]);
+        }
+        ppus[p]->extPalObj = vram_ptr(nds, ofs[4]);
+    }
+    return true;
+}
+
+bool read_line(NDS* nds) {
+    u16 ly;
+    PPULineState s[2];
+    if (!read_bytes(&ly, 2)) return false;
+    if (!read_bytes(&nds->io9.ppuA, sizeof(PPUIO))) return false;
+    if (!read_bytes(&nds->io9.ppuB, sizeof(PPUIO))) return false;
+    if (!read_bytes(s, sizeof s)) return false;
+    if (!read_chunks(nds->pal, 2 * PALSIZE, PPULOG_LINECHUNK)) return false;
+    if (!read_chunks(nds->oam, 2 * OAMSIZE, PPULOG_LINECHUNK)) return false;
+    if (ly >= NDS_SCREEN_H) return false;
+    ppulog_load_line_state(&nds->ppuA, &s[0]);
+    ppulog_load_line_state(&nds->ppuB, &s[1]);
+    nds->ppuA.ly = ly;
+    nds->ppuB.ly = ly;
+    return true;
+}
+
+void run_replay(bool print) {
+    NDS* nds = replay.nds;
+    u64 frame_ns = 0;
+
+    init_nds(nds, replay.card, replay.bios7, replay.bios9, replay.firmware,
+             -1, NULL, false);
+    replay.pos = 8;
+    while (replay.pos < replay.len) {
+        u8 type = replay.data[replay.pos++];
+        if (type == PPULOG_FRAME) {
+            if (!read_frame(nds)) break;
+            frame_ns = 0;
+        } else if (type == PPULOG_LINE) {
+            if (!read_line(nds)) break;
+            u64 start = host_time();
+            draw_scanline(&nds->ppuA);
+            draw_scanline(&nds->ppuB);
+            frame_ns += host_time() - start;
+
+            if (nds->ppuA.ly == NDS_SCREEN_H - 1) {
+                if (print) {
+                    printf("%d,%.1f,%016llx\n", replay.frames, frame_ns / 1e3,
+                           (unsigned long long) hash_screens(nds));
+                }
+                replay.draw_ns += frame_ns;
+                replay.frames++;
+            }
+        } else {
+            fprintf(stderr, "Invalid record at offset %zu\n", replay.pos - 1);
+            break;
+        }
+    }
+}
+
+bool load_log(char* filename) {
+    FILE* fp = fopen(filename, "rb");
+    if (!fp) return false;
+    fseek(fp, 0, SEEK_END);
+    replay.len = ftell(fp);
+    rewind(fp);
+    replay.data = malloc(replay.len ? replay.len : 1);
+    if (fread(replay.data, 1, replay.len, fp) != replay.len) {
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+    u32 hdr[2];
+    if (replay.len < sizeof hdr) return false;
+    memcpy(hdr, replay.data, sizeof hdr);
+    return hdr[0] == PPULOG_MAGIC && hdr[1] == PPULOG_VERSION;
+}
+
+int main(int argc, char** argv) {
+    replay.repeat = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:qh")) != -1) {
+        switch (opt) {
+            case 'r':
+                replay.repeat = atoi(optarg);
+                if (replay.repeat < 1) replay.repeat = 1;
+                break;
+            case 'q':
+                replay.quiet = true;
+                break;
+            default:
+                fprintf(stderr, "%s\n", usage);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "%s\n", usage);
+        return 1;
+    }
+    if (!load_log(argv[optind])) {
+        fprintf(stderr, "Invalid ppu log '%s'\n", argv[optind]);
+        return 1;
+    }
+
+    // only the ppus are used, the rest of the system stays idle
+    u8 header[sizeof(CardHeader)] = {0};
+    replay.card = create_card_from_buffer(header, sizeof header);
+    replay.bios7 = calloc(1, BIOS7SIZE);
+    replay.bios9 = calloc(1, BIOS9SIZE);
+    replay.firmware = calloc(1, FIRMWARESIZE);
+    replay.nds = calloc(1, sizeof *replay.nds);
+
+    if (!replay.quiet) printf("frame,draw_us,hash\n");
+    for (int i = 0; i < replay.repeat; i++) {
+        run_replay(!replay.quiet && i == 0);
+    }
+
+    if (replay.frames) {
+        printf("%d frames, %.3f ms/frame, %.1f fps\n",
+               replay.frames / replay.repeat,
+               replay.draw_ns / 1e6 / replay.frames,
+               replay.frames * 1e9 / (replay.draw_ns + 1));
+    } else {
+        printf("No frames in log\n");
+    }
+
+    destroy_card(replay.card);
+    free(replay.nds);
+    free(replay.bios7);
+    free(replay.bios9);
+    free(replay.firmware);
+    free(replay.data);
+    return 0;
+}
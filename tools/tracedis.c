@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "arm/arm.h"
+#include "cputrace.h"
+#include "lz.h"
+
+const char usage[] = "ntremu-tracedis [options] <tracefile>\n"
+                     "-n <count> -- stop after count instructions\n"
+                     "-s -- only print statistics\n"
+                     "-h -- print help";
+
+struct {
+    u64 limit;
+    bool stats;
+
+    FILE* fp;
+    u32 cpu;
+    u32 start;
+    u32 last;
+    u32 flags;
+
+    u8* raw;
+    u8* comp;
+
+    u32 next_pc;
+    u32 cache[1 << CPUTRACE_CACHE_BITS];
+    u32 regs[16];
+    u32 prev_addr;
+    u32 prev_instr;
+
+    u64 instrs;
+    u64 thumb;
+    u64 jumps;
+    u64 raw_bytes;
+    u64 file_bytes;
+} dis;
+
+static const char* reg_names[16] = {"r0", "r1", "r2",  "r3",  "r4",  "r5",
+                                    "r6", "r7", "r8",  "r9",  "r10", "r11",
+                                    "r12", "sp", "lr", "cpsr"};
+
+bool get_u32(u32* v) {
+    return fread(v, 4, 1, dis.fp) == 1;
+}
+
+bool get_varint(u8** p, u8* end, u32* v) {
+    *v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*p == end) return false;
+        u8 b = *(*p)++;
+        *v |= (u32) (b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+u32 unzigzag(u32 v) {
+    return v >> 1 ^ -(v & 1);
+}
+
+// thumb instructions are stored decoded, which is what thumb_disassemble
+// prints
+void print_regs(u32 mask) {
+    if (mask) {
+        printf("\t;");
+        for (int i = 0; i < 16; i++) {
+            if (mask & 1 << i) printf(" %s=%08x", reg_names[i], dis.regs[i]);
+        }
+    }
+    printf("\n");
+}
+
+void print_instr(u32 mask) {
+    printf("%08x: ", dis.prev_addr);
+    arm_disassemble((ArmInstr){dis.prev_instr}, dis.prev_addr, stdout);
+    print_regs(mask);
+}
+
+// returns false if the block is truncated or invalid
+bool decode_block(u8* p, u8* end) {
+    while (p < end) {
+        if (dis.limit && dis.instrs == dis.limit) return true;
+        u8 tag = *p++;
+        bool thumb = tag & CPUTRACE_THUMB;
+        u32 addr = dis.next_pc;
+        if (tag & CPUTRACE_PC) {
+            u32 d;
+            if (!get_varint(&p, end, &d)) return false;
+            addr += unzigzag(d);
+            dis.jumps++;
+        }
+        dis.next_pc = addr + (thumb ? 2 : 4);
+
+        u32* slot = &dis.cache[addr >> 1 & ((1 << CPUTRACE_CACHE_BITS) - 1)];
+        if (tag & CPUTRACE_INSTR) {
+            if (end - p < 4) return false;
+            memcpy(slot, p, 4);
+            p += 4;
+        }
+
+        u32 mask = 0;
+        if (tag & CPUTRACE_REGS_CHANGED) {
+            if (end - p < 2) return false;
+            mask = p[0] | p[1] << 8;
+            p += 2;
+            for (int i = 0; i < 16; i++) {
+                if (!(mask & 1 << i)) continue;
+                u32 d;
+                if (!get_varint(&p, end, &d)) return false;
+                dis.regs[i] += unzigzag(d);
+            }
+        }
+
+        // the registers are recorded before each instruction, so the
+        // changes are printed with the one before which made them
+        if (!dis.stats) {
+            if (dis.instrs) print_instr(mask);
+            else if (mask) {
+                printf("initial");
+                print_regs(mask);
+            }
+        }
+        dis.instrs++;
+        if (thumb) dis.thumb++;
+        dis.prev_addr = addr;
+        dis.prev_instr = *slot;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:sh")) != -1) {
+        switch (opt) {
+            case 'n':
+                dis.limit = strtoull(optarg, NULL, 0);
+                break;
+            case 's':
+                dis.stats = true;
+                break;
+            default:
+                fprintf(stderr, "%s\n", usage);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "%s\n", usage);
+        return 1;
+    }
+
+    dis.fp = fopen(argv[optind], "rb");
+    if (!dis.fp) {
+        fprintf(stderr, "Could not open '%s'\n", argv[optind]);
+        return 1;
+    }
+    u32 magic, version;
+    if (!get_u32(&magic) || !get_u32(&version) || magic != CPUTRACE_MAGIC ||
+        version != CPUTRACE_VERSION || !get_u32(&dis.cpu) ||
+        !get_u32(&dis.start) || !get_u32(&dis.last) || !get_u32(&dis.flags)) {
+        fprintf(stderr, "Invalid trace file '%s'\n", argv[optind]);
+        return 1;
+    }
+    dis.raw = malloc(CPUTRACE_CHUNK);
+    dis.comp = malloc(LZ_BOUND(CPUTRACE_CHUNK));
+    dis.file_bytes = 24;
+
+    bool ok = true;
+    u32 raw_len, comp_len;
+    while (ok && !(dis.limit && dis.instrs == dis.limit) &&
+           get_u32(&raw_len)) {
+        if (!get_u32(&comp_len) || raw_len > CPUTRACE_CHUNK ||
+            comp_len > LZ_BOUND(CPUTRACE_CHUNK) ||
+            fread(dis.comp, 1, comp_len, dis.fp) != comp_len) {
+            ok = false;
+            break;
+        }
+        dis.file_bytes += 8 + comp_len;
+        dis.raw_bytes += raw_len;
+        u8* data = dis.comp;
+        if (comp_len != raw_len) {
+            if (lz_decompress(dis.comp, comp_len, dis.raw, CPUTRACE_CHUNK) !=
+                raw_len) {
+                ok = false;
+                break;
+            }
+            data = dis.raw;
+        }
+        ok = decode_block(data, data + raw_len);
+    }
+    if (dis.instrs && !dis.stats) print_instr(0);
+    if (!ok) fprintf(stderr, "Trace file is truncated or corrupt\n");
+
+    if (dis.stats) {
+        printf("arm%d trace of %08x-%08x%s\n", dis.cpu ? 7 : 9, dis.start,
+               dis.last, dis.flags & CPUTRACE_REGS ? " with registers" : "");
+        printf("%llu instructions (%llu thumb), %llu jumps\n",
+               (unsigned long long) dis.instrs, (unsigned long long) dis.thumb,
+               (unsigned long long) dis.jumps);
+        if (dis.instrs) {
+            printf("%.3f bytes per instruction encoded, %.3f in the file\n",
+                   (double) dis.raw_bytes / dis.instrs,
+                   (double) dis.file_bytes / dis.instrs);
+        }
+    }
+
+    fclose(dis.fp);
+    free(dis.raw);
+    free(dis.comp);
+    return ok ? 0 : 1;
+}